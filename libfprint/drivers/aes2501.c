@@ -65,13 +65,12 @@ static void complete_deactivation (FpImageDevice *dev);
 
 struct _FpiDeviceAes2501
 {
-  FpImageDevice parent;
+  FpImageDevice      parent;
 
-  guint8        read_regs_retry_count;
-  GSList       *strips;
-  size_t        strips_len;
-  gboolean      deactivating;
-  int           no_finger_cnt;
+  guint8             read_regs_retry_count;
+  FpiFrameAssembler *assembler;
+  gboolean           deactivating;
+  int                no_finger_cnt;
 };
 G_DECLARE_FINAL_TYPE (FpiDeviceAes2501, fpi_device_aes2501, FPI, DEVICE_AES2501,
                       FpImageDevice);
@@ -81,7 +80,7 @@ static struct fpi_frame_asmbl_ctx assembling_ctx = {
   .frame_width = FRAME_WIDTH,
   .frame_height = FRAME_HEIGHT,
   .image_width = IMAGE_WIDTH,
-  .get_pixel = aes_get_pixel,
+  .format = FPI_FRAME_FORMAT_4BIT_PACKED,
 };
 
 typedef void (*aes2501_read_regs_cb)(FpImageDevice *dev,
@@ -399,7 +398,6 @@ capture_read_strip_cb (FpiUsbTransfer *transfer, FpDevice *_dev,
                        gpointer user_data, GError *error)
 {
   FpiSsm *ssm = transfer->ssm;
-  unsigned char *stripdata;
   FpImageDevice *dev = FP_IMAGE_DEVICE (_dev);
   FpiDeviceAes2501 *self = FPI_DEVICE_AES2501 (_dev);
   unsigned char *data = transfer->buffer;
@@ -454,14 +452,8 @@ capture_read_strip_cb (FpiUsbTransfer *transfer, FpDevice *_dev,
         {
           FpImage *img;
 
-          self->strips = g_slist_reverse (self->strips);
-          fpi_do_movement_estimation (&assembling_ctx, self->strips);
-          img = fpi_assemble_frames (&assembling_ctx,
-                                     self->strips);
+          img = fpi_frame_assembler_finish (self->assembler);
           img->flags |= FPI_IMAGE_PARTIAL;
-          g_slist_free_full (self->strips, g_free);
-          self->strips = NULL;
-          self->strips_len = 0;
           fpi_image_device_image_captured (dev, img);
           fpi_image_device_report_finger_status (dev, FALSE);
           /* marking machine complete will re-trigger finger detection loop */
@@ -475,15 +467,8 @@ capture_read_strip_cb (FpiUsbTransfer *transfer, FpDevice *_dev,
   else
     {
       /* obtain next strip */
-      /* FIXME: would preallocating strip buffers be a decent optimization? */
-      struct fpi_frame *stripe = g_malloc (FRAME_WIDTH * FRAME_HEIGHT / 2 + sizeof (struct fpi_frame));
-      stripe->delta_x = 0;
-      stripe->delta_y = 0;
-      stripdata = stripe->data;
-      memcpy (stripdata, data + 1, 192 * 8);
       self->no_finger_cnt = 0;
-      self->strips = g_slist_prepend (self->strips, stripe);
-      self->strips_len++;
+      fpi_frame_assembler_add_frame_data (self->assembler, data + 1, 0, 0);
 
       fpi_ssm_jump_to_state (ssm, CAPTURE_REQUEST_STRIP);
     }
@@ -823,28 +808,32 @@ complete_deactivation (FpImageDevice *dev)
    * maybe we can do this with a master reset, unconditionally? */
 
   self->deactivating = FALSE;
-  g_slist_free (self->strips);
-  self->strips = NULL;
-  self->strips_len = 0;
+  fpi_frame_assembler_reset (self->assembler);
   fpi_image_device_deactivate_complete (dev, NULL);
 }
 
 static void
 dev_init (FpImageDevice *dev)
 {
+  FpiDeviceAes2501 *self = FPI_DEVICE_AES2501 (dev);
   GError *error = NULL;
 
   /* FIXME check endpoints */
 
-  g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error);
+  if (g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error))
+    self->assembler = fpi_frame_assembler_new (&assembling_ctx, TRUE);
+
   fpi_image_device_open_complete (dev, error);
 }
 
 static void
 dev_deinit (FpImageDevice *dev)
 {
+  FpiDeviceAes2501 *self = FPI_DEVICE_AES2501 (dev);
   GError *error = NULL;
 
+  g_clear_pointer (&self->assembler, fpi_frame_assembler_free);
+
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
   fpi_image_device_close_complete (dev, error);
@@ -39,7 +39,7 @@ static struct fpi_frame_asmbl_ctx assembling_ctx = {
   .frame_width = FRAME_WIDTH,
   .frame_height = AESX660_FRAME_HEIGHT,
   .image_width = IMAGE_WIDTH,
-  .get_pixel = aes_get_pixel,
+  .format = FPI_FRAME_FORMAT_4BIT_PACKED,
 };
 
 static const FpIdEntry id_table[] = {
@@ -34,103 +34,45 @@
 
 struct write_regv_data
 {
-  unsigned int               num_regs;
-  const struct aes_regwrite *regs;
-  unsigned int               offset;
-  aes_write_regv_cb          callback;
-  void                      *user_data;
+  aes_write_regv_cb callback;
+  void             *user_data;
 };
 
-static void continue_write_regv (FpImageDevice          *dev,
-                                 struct write_regv_data *wdata);
-
-/* libusb bulk callback for regv write completion transfer. continues the
- * transaction */
-static void
-write_regv_trf_complete (FpiUsbTransfer *transfer, FpDevice *device,
-                         gpointer user_data, GError *error)
-{
-  struct write_regv_data *wdata = user_data;
-
-  if (error)
-    {
-      wdata->callback (FP_IMAGE_DEVICE (device), error, wdata->user_data);
-      g_free (wdata);
-    }
-  else
-    {
-      continue_write_regv (FP_IMAGE_DEVICE (device), wdata);
-    }
-}
-
-/* write from wdata->offset to upper_bound (inclusive) of wdata->regs */
-static void
-do_write_regv (FpImageDevice *dev, struct write_regv_data *wdata, int upper_bound)
+/* pack up to MAX_REGWRITES_PER_REQUEST register/value pairs into one
+ * bulk packet */
+static guint
+aes_pack_regs (FpiUsbTransfer *transfer, const FpiRegmapWrite *writes,
+               guint n_writes)
 {
-  unsigned int offset = wdata->offset;
-  unsigned int num = upper_bound - offset + 1;
-  size_t alloc_size = num * 2;
-  unsigned int i;
-  size_t data_offset = 0;
-  FpiUsbTransfer *transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
+  guint num = MIN (n_writes, MAX_REGWRITES_PER_REQUEST);
+  guint i;
 
-  fpi_usb_transfer_fill_bulk (transfer, EP_OUT, alloc_size);
+  fpi_usb_transfer_fill_bulk (transfer, EP_OUT, num * 2);
 
-  for (i = offset; i < offset + num; i++)
+  for (i = 0; i < num; i++)
     {
-      const struct aes_regwrite *regwrite = &wdata->regs[i];
-      transfer->buffer[data_offset++] = regwrite->reg;
-      transfer->buffer[data_offset++] = regwrite->value;
+      transfer->buffer[i * 2] = writes[i].reg;
+      transfer->buffer[i * 2 + 1] = writes[i].value;
     }
 
   transfer->short_is_error = TRUE;
-  fpi_usb_transfer_submit (transfer, BULK_TIMEOUT, NULL,
-                           write_regv_trf_complete, wdata);
+
+  return num;
 }
 
-/* write the next batch of registers to be written, or if there are no more,
- * indicate completion to the caller */
+static const FpiRegmapProtocol aes_protocol = {
+  .pack = aes_pack_regs,
+  .timeout_ms = BULK_TIMEOUT,
+  .max_in_flight = 1,
+};
+
 static void
-continue_write_regv (FpImageDevice *dev, struct write_regv_data *wdata)
+write_regv_complete (FpDevice *device, gpointer user_data, GError *error)
 {
-  unsigned int offset = wdata->offset;
-  unsigned int regs_remaining;
-  unsigned int limit;
-  unsigned int upper_bound;
-  int i;
-
-  /* skip all zeros and ensure there is still work to do */
-  while (TRUE)
-    {
-      if (offset >= wdata->num_regs)
-        {
-          fp_dbg ("all registers written");
-          wdata->callback (dev, 0, wdata->user_data);
-          g_free (wdata);
-          return;
-        }
-      if (wdata->regs[offset].reg)
-        break;
-      offset++;
-    }
-
-  wdata->offset = offset;
-  regs_remaining = wdata->num_regs - offset;
-  limit = MIN (regs_remaining, MAX_REGWRITES_PER_REQUEST);
-  upper_bound = offset + limit - 1;
-
-  /* determine if we can write the entire of the regs at once, or if there
-   * is a zero dividing things up */
-  for (i = offset; i <= upper_bound; i++)
-    if (!wdata->regs[i].reg)
-      {
-        upper_bound = i - 1;
-        break;
-      }
-
-  do_write_regv (dev, wdata, upper_bound);
+  struct write_regv_data *wdata = user_data;
 
-  wdata->offset = upper_bound + 1;
+  wdata->callback (FP_IMAGE_DEVICE (device), error, wdata->user_data);
+  g_free (wdata);
 }
 
 /* write a load of registers to the device, combining multiple writes in a
@@ -141,29 +83,22 @@ aes_write_regv (FpImageDevice *dev, const struct aes_regwrite *regs,
                 unsigned int num_regs, aes_write_regv_cb callback,
                 void *user_data)
 {
+  g_autofree FpiRegmapWrite *writes = g_new (FpiRegmapWrite, num_regs);
   struct write_regv_data *wdata;
+  unsigned int i;
 
-  fp_dbg ("write %d regs", num_regs);
-  wdata = g_malloc (sizeof (*wdata));
-  wdata->num_regs = num_regs;
-  wdata->regs = regs;
-  wdata->offset = 0;
+  /* register 0 does not exist, it separates groups of writes */
+  for (i = 0; i < num_regs; i++)
+    {
+      writes[i].reg = regs[i].reg ? regs[i].reg : FPI_REGMAP_SYNC;
+      writes[i].value = regs[i].value;
+    }
+
+  wdata = g_new (struct write_regv_data, 1);
   wdata->callback = callback;
   wdata->user_data = user_data;
-  continue_write_regv (dev, wdata);
-}
 
-unsigned char
-aes_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
-               struct fpi_frame           *frame,
-               unsigned int                x,
-               unsigned int                y)
-{
-  unsigned char ret;
-
-  ret = frame->data[x * (ctx->frame_height >> 1) + (y >> 1)];
-  ret = y % 2 ? ret >> 4 : ret & 0xf;
-  ret *= 17;
-
-  return ret;
+  fpi_regmap_write_full (FP_DEVICE (dev), &aes_protocol, writes, num_regs,
+                         NULL, write_regv_complete, wdata);
 }
+
@@ -39,8 +39,3 @@ void aes_write_regv (FpImageDevice             *dev,
                      unsigned int               num_regs,
                      aes_write_regv_cb          callback,
                      void                      *user_data);
-
-unsigned char aes_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
-                             struct fpi_frame           *frame,
-                             unsigned int                x,
-                             unsigned int                y);
@@ -30,8 +30,7 @@
 typedef struct
 {
   GByteArray         *stripe_packet;
-  GSList             *strips;
-  size_t              strips_len;
+  FpiFrameAssembler  *assembler;
   gboolean            deactivating;
   struct aesX660_cmd *init_seq;
   size_t              init_seq_len;
@@ -283,8 +282,7 @@ process_stripe_data (FpiSsm *ssm, FpiDeviceAesX660 *self,
 {
   FpiDeviceAesX660Private *priv = fpi_device_aes_x660_get_instance_private (self);
   FpiDeviceAesX660Class *cls = FPI_DEVICE_AES_X660_GET_CLASS (self);
-  struct fpi_frame *stripe;
-  unsigned char *stripdata;
+  int delta_x, delta_y;
 
   if (length < AESX660_IMAGE_OFFSET + cls->assembling_ctx->frame_width * FRAME_HEIGHT / 2)
     {
@@ -294,26 +292,20 @@ process_stripe_data (FpiSsm *ssm, FpiDeviceAesX660 *self,
       return 0;
     }
 
-  stripe = g_malloc (cls->assembling_ctx->frame_width * FRAME_HEIGHT / 2 + sizeof (struct fpi_frame));     /* 4 bpp */
-  stripdata = stripe->data;
-
   fp_dbg ("Processing frame %.2x %.2x", data[AESX660_IMAGE_OK_OFFSET],
           data[AESX660_LAST_FRAME_OFFSET]);
 
-  stripe->delta_x = (int8_t) data[AESX660_FRAME_DELTA_X_OFFSET];
-  stripe->delta_y = -(int8_t) data[AESX660_FRAME_DELTA_Y_OFFSET];
-  fp_dbg ("Offset to previous frame: %d %d", stripe->delta_x, stripe->delta_y);
+  delta_x = (int8_t) data[AESX660_FRAME_DELTA_X_OFFSET];
+  delta_y = -(int8_t) data[AESX660_FRAME_DELTA_Y_OFFSET];
+  fp_dbg ("Offset to previous frame: %d %d", delta_x, delta_y);
 
   if (data[AESX660_IMAGE_OK_OFFSET] == AESX660_IMAGE_OK)
     {
-      memcpy (stripdata, data + AESX660_IMAGE_OFFSET, cls->assembling_ctx->frame_width * FRAME_HEIGHT / 2);
-
-      priv->strips = g_slist_prepend (priv->strips, stripe);
-      priv->strips_len++;
+      fpi_frame_assembler_add_frame_data (priv->assembler, data + AESX660_IMAGE_OFFSET,
+                                          delta_x, delta_y);
       return data[AESX660_LAST_FRAME_OFFSET] & AESX660_LAST_FRAME_BIT;
     }
 
-  g_free (stripe);
   return 0;
 }
 
@@ -324,19 +316,13 @@ capture_set_idle_cmd_cb (FpiUsbTransfer *transfer, FpDevice *device,
   FpImageDevice *dev = FP_IMAGE_DEVICE (device);
   FpiDeviceAesX660 *self = FPI_DEVICE_AES_X660 (device);
   FpiDeviceAesX660Private *priv = fpi_device_aes_x660_get_instance_private (self);
-  FpiDeviceAesX660Class *cls = FPI_DEVICE_AES_X660_GET_CLASS (self);
 
   if (!error)
     {
       FpImage *img;
 
-      priv->strips = g_slist_reverse (priv->strips);
-      img = fpi_assemble_frames (cls->assembling_ctx, priv->strips);
+      img = fpi_frame_assembler_finish (priv->assembler);
       img->flags |= FPI_IMAGE_PARTIAL;
-      g_slist_foreach (priv->strips, (GFunc) g_free, NULL);
-      g_slist_free (priv->strips);
-      priv->strips = NULL;
-      priv->strips_len = 0;
       fpi_image_device_image_captured (dev, img);
       fpi_image_device_report_finger_status (dev, FALSE);
       fpi_ssm_mark_completed (transfer->ssm);
@@ -441,7 +427,7 @@ capture_run_state (FpiSsm *ssm, FpDevice *_dev)
       break;
 
     case CAPTURE_SET_IDLE:
-      fp_dbg ("Got %" G_GSIZE_FORMAT " frames", priv->strips_len);
+      fp_dbg ("Got %u frames", fpi_frame_assembler_get_n_frames (priv->assembler));
       aesX660_send_cmd (ssm, _dev, set_idle_cmd, sizeof (set_idle_cmd),
                         capture_set_idle_cmd_cb);
       break;
@@ -688,11 +674,14 @@ aesX660_dev_init (FpImageDevice *dev)
 {
   FpiDeviceAesX660 *self = FPI_DEVICE_AES_X660 (dev);
   FpiDeviceAesX660Private *priv = fpi_device_aes_x660_get_instance_private (self);
+  FpiDeviceAesX660Class *cls = FPI_DEVICE_AES_X660_GET_CLASS (self);
   GError *error = NULL;
 
   g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error);
 
   priv->stripe_packet = g_byte_array_new ();
+  /* The deltas are reported by the hardware */
+  priv->assembler = fpi_frame_assembler_new (cls->assembling_ctx, FALSE);
 
   fpi_image_device_open_complete (dev, error);
 }
@@ -708,6 +697,7 @@ aesX660_dev_deinit (FpImageDevice *dev)
                                   0, 0, &error);
 
   g_clear_pointer (&priv->stripe_packet, g_byte_array_unref);
+  g_clear_pointer (&priv->assembler, fpi_frame_assembler_free);
 
   fpi_image_device_close_complete (dev, error);
 }
@@ -722,9 +712,7 @@ complete_deactivation (FpImageDevice *dev)
   G_DEBUG_HERE ();
 
   priv->deactivating = FALSE;
-  g_slist_free (priv->strips);
-  priv->strips = NULL;
-  priv->strips_len = 0;
+  fpi_frame_assembler_reset (priv->assembler);
   fpi_image_device_deactivate_complete (dev, NULL);
 }
 
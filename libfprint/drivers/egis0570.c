@@ -32,30 +32,23 @@ struct _FpDeviceEgis0570
 {
   FpImageDevice parent;
 
-  gboolean      running;
-  gboolean      stop;
+  gboolean           running;
+  gboolean           stop;
 
-  GSList       *strips;
-  guint8       *background;
-  gsize         strips_len;
+  FpiFrameAssembler *assembler;
+  guint8            *background;
 
-  int           pkt_num;
-  int           pkt_type;
+  int                pkt_num;
+  int                pkt_type;
 };
 G_DECLARE_FINAL_TYPE (FpDeviceEgis0570, fpi_device_egis0570, FPI, DEVICE_EGIS0570, FpImageDevice);
 G_DEFINE_TYPE (FpDeviceEgis0570, fpi_device_egis0570, FP_TYPE_IMAGE_DEVICE);
 
-static unsigned char
-egis_get_pixel (struct fpi_frame_asmbl_ctx *ctx, struct fpi_frame *frame, unsigned int x, unsigned int y)
-{
-  return frame->data[x + y * ctx->frame_width];
-}
-
 static struct fpi_frame_asmbl_ctx assembling_ctx = {
   .frame_width = EGIS0570_IMGWIDTH,
   .frame_height = EGIS0570_RFMGHEIGHT,
   .image_width = EGIS0570_IMGWIDTH * 4 / 3,
-  .get_pixel = egis_get_pixel,
+  .format = FPI_FRAME_FORMAT_8BIT,
 };
 
 /*
@@ -139,7 +132,6 @@ postprocess_frames (FpDeviceEgis0570 *self, guint8 * img)
 static void
 data_resp_cb (FpiUsbTransfer *transfer, FpDevice *dev, gpointer user_data, GError *error)
 {
-  unsigned char *stripdata;
   gboolean end = FALSE;
   FpImageDevice *img_self = FP_IMAGE_DEVICE (dev);
   FpDeviceEgis0570 *self = FPI_DEVICE_EGIS0570 (dev);
@@ -165,13 +157,9 @@ data_resp_cb (FpiUsbTransfer *transfer, FpDevice *dev, gpointer user_data, GErro
             {
               if (where_finger_is & (1 << k))
                 {
-                  struct fpi_frame *stripe = g_malloc (EGIS0570_IMGWIDTH * EGIS0570_RFMGHEIGHT + sizeof (struct fpi_frame));
-                  stripe->delta_x = 0;
-                  stripe->delta_y = 0;
-                  stripdata = stripe->data;
-                  memcpy (stripdata, (transfer->buffer) + (((k) * EGIS0570_IMGSIZE) + EGIS0570_IMGWIDTH * EGIS0570_RFMDIS), EGIS0570_IMGWIDTH * EGIS0570_RFMGHEIGHT);
-                  self->strips = g_slist_prepend (self->strips, stripe);
-                  self->strips_len += 1;
+                  fpi_frame_assembler_add_frame_data (self->assembler,
+                                                      (transfer->buffer) + (((k) * EGIS0570_IMGSIZE) + EGIS0570_IMGWIDTH * EGIS0570_RFMDIS),
+                                                      0, 0);
                 }
               else
                 {
@@ -188,19 +176,18 @@ data_resp_cb (FpiUsbTransfer *transfer, FpDevice *dev, gpointer user_data, GErro
 
   if (end)
     {
-      if (!self->stop && (self->strips_len > 0))
+      if (!self->stop && (fpi_frame_assembler_get_n_frames (self->assembler) > 0))
         {
           g_autoptr(FpImage) img = NULL;
-          self->strips = g_slist_reverse (self->strips);
-          fpi_do_movement_estimation (&assembling_ctx, self->strips);
-          img = fpi_assemble_frames (&assembling_ctx, self->strips);
+          img = fpi_frame_assembler_finish (self->assembler);
           img->flags |= (FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_PARTIAL);
-          g_slist_free_full (self->strips, g_free);
-          self->strips = NULL;
-          self->strips_len = 0;
           FpImage *resizeImage = fpi_image_resize (img, EGIS0570_RESIZE, EGIS0570_RESIZE);
           fpi_image_device_image_captured (img_self, g_steal_pointer (&resizeImage));
         }
+      else
+        {
+          fpi_frame_assembler_reset (self->assembler);
+        }
 
       fpi_image_device_report_finger_status (img_self, FALSE);
     }
@@ -369,9 +356,11 @@ dev_activate (FpImageDevice *dev)
 static void
 dev_init (FpImageDevice *dev)
 {
+  FpDeviceEgis0570 *self = FPI_DEVICE_EGIS0570 (dev);
   GError *error = NULL;
 
-  g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error);
+  if (g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error))
+    self->assembler = fpi_frame_assembler_new (&assembling_ctx, TRUE);
 
   fpi_image_device_open_complete (dev, error);
 }
@@ -383,8 +372,11 @@ dev_init (FpImageDevice *dev)
 static void
 dev_deinit (FpImageDevice *dev)
 {
+  FpDeviceEgis0570 *self = FPI_DEVICE_EGIS0570 (dev);
   GError *error = NULL;
 
+  g_clear_pointer (&self->assembler, fpi_frame_assembler_free);
+
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error);
 
   fpi_image_device_close_complete (dev, error);
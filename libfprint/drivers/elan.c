@@ -41,19 +41,11 @@
 #include "drivers_api.h"
 #include "elan.h"
 
-static unsigned char
-elan_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
-                struct fpi_frame *frame, unsigned int x,
-                unsigned int y)
-{
-  return frame->data[x + y * ctx->frame_width];
-}
-
 static struct fpi_frame_asmbl_ctx assembling_ctx = {
   .frame_width = 0,
   .frame_height = 0,
   .image_width = 0,
-  .get_pixel = elan_get_pixel,
+  .format = FPI_FRAME_FORMAT_8BIT,
 };
 
 struct _FpiDeviceElan
@@ -78,22 +70,20 @@ struct _FpiDeviceElan
   unsigned char  *last_read;
   unsigned char   calib_atts_left;
   unsigned char   calib_status;
+  unsigned short  calib_mean;
+  gboolean        calib_mean_cached;
   unsigned short *background;
   unsigned char   frame_width;
   unsigned char   frame_height;
   unsigned char   raw_frame_height;
   int             num_frames;
   GSList         *frames;
+  /* processed frames while the movement is being estimated */
+  GSList         *img_frames;
   /* end state */
 };
 G_DEFINE_TYPE (FpiDeviceElan, fpi_device_elan, FP_TYPE_IMAGE_DEVICE);
 
-static int
-cmp_short (const void *a, const void *b)
-{
-  return (int) (*(short *) a - *(short *) b);
-}
-
 static void
 elan_dev_reset_state (FpiDeviceElan *elandev)
 {
@@ -206,14 +196,13 @@ elan_save_img_frame (FpiDeviceElan *elandev)
   unsigned short *frame = g_malloc (frame_size * sizeof (short));
 
   elan_save_frame (elandev, frame);
+  const unsigned short *background = elandev->background;
   unsigned int sum = 0;
 
+  /* Branch-free saturating subtraction, which compilers can vectorize */
   for (int i = 0; i < frame_size; i++)
     {
-      if (elandev->background[i] > frame[i])
-        frame[i] = 0;
-      else
-        frame[i] -= elandev->background[i];
+      frame[i] = MAX (frame[i], background[i]) - background[i];
       sum += frame[i];
     }
 
@@ -277,15 +266,16 @@ elan_process_frame_thirds (unsigned short *raw_frame,
     g_malloc (frame_size + sizeof (struct fpi_frame));
 
   unsigned short lvl0, lvl1, lvl2, lvl3;
-  unsigned short *sorted = g_malloc (frame_size * sizeof (short));
+  const gint ranks[] = {
+    0, frame_size * 3 / 10, frame_size * 65 / 100, frame_size - 1
+  };
+  guint16 levels[G_N_ELEMENTS (ranks)];
 
-  memcpy (sorted, raw_frame, frame_size * sizeof (short));
-  qsort (sorted, frame_size, sizeof (short), cmp_short);
-  lvl0 = sorted[0];
-  lvl1 = sorted[frame_size * 3 / 10];
-  lvl2 = sorted[frame_size * 65 / 100];
-  lvl3 = sorted[frame_size - 1];
-  g_free (sorted);
+  fpi_percentiles_u16 (raw_frame, frame_size, ranks, levels, G_N_ELEMENTS (ranks));
+  lvl0 = levels[0];
+  lvl1 = levels[1];
+  lvl2 = levels[2];
+  lvl3 = levels[3];
 
   unsigned short px;
 
@@ -304,13 +294,45 @@ elan_process_frame_thirds (unsigned short *raw_frame,
   *frames = g_slist_prepend (*frames, frame);
 }
 
+static void
+elan_submit_image_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  FpImageDevice *dev = user_data;
+  FpiDeviceElan *self = FPI_DEVICE_ELAN (dev);
+  g_autoptr(GError) error = NULL;
+
+  G_DEBUG_HERE ();
+
+  if (!fpi_do_movement_estimation_finish (res, &error))
+    {
+      /* A cancelled capture is followed by a deactivation */
+      if (!self->deactivating)
+        fpi_image_device_session_error (dev, g_steal_pointer (&error));
+    }
+  else if (!self->deactivating)
+    {
+      FpImage *img;
+
+      img = fpi_assemble_frames (&assembling_ctx, self->img_frames);
+      img->flags |= FPI_IMAGE_PARTIAL;
+      fpi_image_device_image_captured (dev, img);
+    }
+
+  g_slist_free_full (g_steal_pointer (&self->img_frames), g_free);
+
+  elan_stop_capture (self);
+}
+
+/* Estimating the movement takes a while for the large frames of these
+ * sensors, so it is done in a worker thread. The capture is stopped once
+ * the image has been submitted from elan_submit_image_cb(). */
 static void
 elan_submit_image (FpImageDevice *dev)
 {
   FpiDeviceElan *self = FPI_DEVICE_ELAN (dev);
   GSList *raw_frames;
-  GSList *frames = NULL;
-  FpImage *img;
 
   G_DEBUG_HERE ();
 
@@ -319,14 +341,10 @@ elan_submit_image (FpImageDevice *dev)
   assembling_ctx.frame_width = self->frame_width;
   assembling_ctx.frame_height = self->frame_height;
   assembling_ctx.image_width = self->frame_width * 3 / 2;
-  g_slist_foreach (raw_frames, (GFunc) self->process_frame, &frames);
-  fpi_do_movement_estimation (&assembling_ctx, frames);
-  img = fpi_assemble_frames (&assembling_ctx, frames);
-  img->flags |= FPI_IMAGE_PARTIAL;
-
-  g_slist_free_full (frames, g_free);
-
-  fpi_image_device_image_captured (dev, img);
+  g_slist_foreach (raw_frames, (GFunc) self->process_frame, &self->img_frames);
+  fpi_do_movement_estimation_async (&assembling_ctx, self->img_frames,
+                                    fpi_device_get_cancellable (FP_DEVICE (dev)),
+                                    elan_submit_image_cb, dev);
 }
 
 static void
@@ -590,17 +608,18 @@ capture_complete (FpiSsm *ssm, FpDevice *_dev, GError *error)
       (g_error_matches (error, G_USB_DEVICE_ERROR, G_USB_DEVICE_ERROR_TIMED_OUT) &&
        fpi_ssm_get_cur_state (ssm) == CAPTURE_WAIT_FINGER))
     {
+      g_clear_error (&error);
+
       if (self->num_frames >= ELAN_MIN_FRAMES)
         {
+          /* Stops the capture once the image is submitted */
           elan_submit_image (dev);
+          return;
         }
-      else
-        {
-          fp_dbg ("swipe too short: want >= %d frames, got %d",
-                  ELAN_MIN_FRAMES, self->num_frames);
-          fpi_image_device_retry_scan (dev, FP_DEVICE_RETRY_TOO_SHORT);
-        }
-      g_clear_error (&error);
+
+      fp_dbg ("swipe too short: want >= %d frames, got %d",
+              ELAN_MIN_FRAMES, self->num_frames);
+      fpi_image_device_retry_scan (dev, FP_DEVICE_RETRY_TOO_SHORT);
     }
   else
     {
@@ -626,15 +645,13 @@ elan_capture (FpiDeviceElan *self)
   fpi_ssm_start (ssm, capture_complete);
 }
 
-/* this function needs to have elandev->background and elandev->last_read to be
- * the calibration mean */
+/* this function needs to have elandev->background and elandev->calib_mean */
 static int
 elan_need_calibration (FpiDeviceElan *elandev)
 {
   G_DEBUG_HERE ();
 
-  unsigned short calib_mean =
-    elandev->last_read[0] * 0xff + elandev->last_read[1];
+  unsigned short calib_mean = elandev->calib_mean;
   unsigned int bg_mean = 0, delta;
   unsigned int frame_size = elandev->frame_width * elandev->frame_height;
 
@@ -683,6 +700,37 @@ elan_supports_calibration (FpiDeviceElan *elandev)
   return elandev->fw_ver >= ELAN_MIN_CALIBRATION_FW;
 }
 
+/* The sensor keeps its calibration, so the mean it reported stays valid until
+ * it is recalibrated. elan_need_calibration() still compares it with a fresh
+ * background, which catches a sensor that lost its calibration. */
+static gboolean
+elan_load_calib_mean (FpiDeviceElan *elandev)
+{
+  g_autofree gchar *firmware = NULL;
+  g_autoptr(GBytes) data = NULL;
+
+  firmware = g_strdup_printf ("%04x:%04x", elandev->dev_type, elandev->fw_ver);
+  data = fpi_device_calibration_load (FP_DEVICE (elandev), firmware,
+                                      ELAN_CALIBRATION_CACHE_MAX_AGE_SECONDS);
+  if (!data || g_bytes_get_size (data) != sizeof (elandev->calib_mean))
+    return FALSE;
+
+  memcpy (&elandev->calib_mean, g_bytes_get_data (data, NULL),
+          sizeof (elandev->calib_mean));
+  return TRUE;
+}
+
+static void
+elan_save_calib_mean (FpiDeviceElan *elandev)
+{
+  g_autofree gchar *firmware = NULL;
+  g_autoptr(GBytes) data = NULL;
+
+  firmware = g_strdup_printf ("%04x:%04x", elandev->dev_type, elandev->fw_ver);
+  data = g_bytes_new (&elandev->calib_mean, sizeof (elandev->calib_mean));
+  fpi_device_calibration_save (FP_DEVICE (elandev), firmware, data);
+}
+
 static void
 calibrate_run_state (FpiSsm *ssm, FpDevice *dev)
 {
@@ -710,17 +758,27 @@ calibrate_run_state (FpiSsm *ssm, FpDevice *dev)
       break;
 
     case CALIBRATE_GET_MEAN:
-      elan_run_cmd (ssm, dev, &get_calib_mean_cmd, ELAN_CMD_TIMEOUT);
+      self->calib_mean_cached = elan_load_calib_mean (self);
+      if (self->calib_mean_cached)
+        fpi_ssm_next_state (ssm);
+      else
+        elan_run_cmd (ssm, dev, &get_calib_mean_cmd, ELAN_CMD_TIMEOUT);
       break;
 
     case CALIBRATE_CHECK_NEEDED:
+      if (!self->calib_mean_cached)
+        self->calib_mean = self->last_read[0] * 0xff + self->last_read[1];
+
       if (elan_need_calibration (self))
         {
+          fpi_device_calibration_clear (dev);
           self->calib_status = 0;
           fpi_ssm_next_state (ssm);
         }
       else
         {
+          if (!self->calib_mean_cached)
+            elan_save_calib_mean (self);
           fpi_ssm_mark_completed (ssm);
         }
       break;
@@ -46,6 +46,10 @@
  * generally prevents calibration from looping indefinitely */
 #define ELAN_CALIBRATION_ATTEMPTS 10
 
+/* how long the calibration mean reported by the sensor is reused before it
+ * is queried again */
+#define ELAN_CALIBRATION_CACHE_MAX_AGE_SECONDS (10 * 60)
+
 /* min and max frames in a capture */
 #define ELAN_MIN_FRAMES 7
 #define ELAN_MAX_FRAMES 30
@@ -230,6 +234,7 @@ static void elan_cmd_read (FpiSsm   *ssm,
 
 static void elan_calibrate (FpiDeviceElan *self);
 static void elan_capture (FpiDeviceElan *self);
+static void elan_stop_capture (FpiDeviceElan *self);
 
 static void dev_change_state (FpImageDevice      *dev,
                               FpiImageDeviceState state);
@@ -72,6 +72,7 @@ struct _FpiDeviceElanSpi
 
   /* background / calibration parameters */
   guint16 *bg_image;
+  GBytes  *calib_cache;
   guint16 *last_image;
   guint16 *prev_frame_image;
 
@@ -175,6 +176,9 @@ enum elanspi_calibrate_old_state {
   ELANSPI_CALIBOLD_DACFINE_CAPTURE,
   ELANSPI_CALIBOLD_DACFINE_WRITE_DAC1,
   ELANSPI_CALIBOLD_DACFINE_LOOP,
+  /* restore cached dac and gain */
+  ELANSPI_CALIBOLD_RESTORE_WRITE_DAC1,
+  ELANSPI_CALIBOLD_RESTORE_WRITE_GAIN,
   /* exit ok (cleanup by protecting) */
   ELANSPI_CALIBOLD_PROTECT,
   ELANSPI_CALIBOLD_NSTATES
@@ -216,7 +220,6 @@ enum elanspi_capture_hv_state {
 
 enum elanspi_write_regtable_state {
   ELANSPI_WRTABLE_WRITE,
-  ELANSPI_WRTABLE_ITERATE,
   ELANSPI_WRTABLE_NSTATES
 };
 
@@ -510,26 +513,28 @@ static void
 elanspi_send_regtable_handler (FpiSsm *ssm, FpDevice *dev)
 {
   FpiDeviceElanSpi *self  = FPI_DEVICE_ELANSPI (dev);
-  FpiSpiTransfer *xfer  = NULL;
   const struct elanspi_reg_entry *entry = fpi_ssm_get_data (ssm);
+  g_autoptr(GPtrArray) xfers = g_ptr_array_new ();
 
   switch (fpi_ssm_get_cur_state (ssm))
     {
     case ELANSPI_WRTABLE_WRITE:
-      xfer = elanspi_write_register (self, entry->addr, entry->value);
-      xfer->ssm = ssm;
-      fpi_spi_transfer_submit (xfer, fpi_device_get_cancellable (dev), fpi_ssm_spi_transfer_cb, NULL);
-      return;
+      /* send the whole table as one batch, so it gets merged into few ioctls */
+      for (; entry->addr != 0xff; entry += 1)
+        {
+          FpiSpiTransfer *xfer = elanspi_write_register (self, entry->addr, entry->value);
 
-    case ELANSPI_WRTABLE_ITERATE:
-      entry += 1;
-      if (entry->addr != 0xff)
+          xfer->ssm = ssm;
+          g_ptr_array_add (xfers, xfer);
+        }
+      if (xfers->len == 0)
         {
-          fpi_ssm_set_data (ssm, (gpointer) entry, NULL);
-          fpi_ssm_jump_to_state (ssm, ELANSPI_WRTABLE_WRITE);
+          fpi_ssm_mark_completed (ssm);
           return;
         }
-      fpi_ssm_mark_completed (ssm);
+      fpi_spi_transfer_submit_batch ((FpiSpiTransfer **) xfers->pdata, xfers->len,
+                                     fpi_device_get_cancellable (dev),
+                                     fpi_ssm_spi_transfer_cb, NULL);
       return;
     }
 }
@@ -560,6 +565,70 @@ elanspi_write_regtable (FpiDeviceElanSpi *self, const struct elanspi_regtable *
   return ssm;
 }
 
+/* cached calibration result, followed by the background image */
+struct elanspi_calibration
+{
+  guint8  sensor_width, sensor_height;
+  guint16 dac_value;
+  guint16 bg_image[];
+};
+
+static gchar *
+elanspi_calibration_firmware (FpiDeviceElanSpi *self)
+{
+  return g_strdup_printf ("%02x:%02x:%02x:%d", self->sensor_id,
+                          self->sensor_ic_version, self->sensor_raw_version,
+                          self->sensor_vcm_mode);
+}
+
+static const struct elanspi_calibration *
+elanspi_calibration_load (FpiDeviceElanSpi *self)
+{
+  g_autofree gchar *firmware = elanspi_calibration_firmware (self);
+  const struct elanspi_calibration *calib;
+  gsize size;
+
+  g_clear_pointer (&self->calib_cache, g_bytes_unref);
+  self->calib_cache = fpi_device_calibration_load (FP_DEVICE (self), firmware,
+                                                   ELANSPI_CALIBRATION_CACHE_MAX_AGE_SECONDS);
+  if (!self->calib_cache)
+    return NULL;
+
+  calib = g_bytes_get_data (self->calib_cache, &size);
+  if (size != sizeof (*calib) + self->sensor_width * self->sensor_height * 2 ||
+      calib->sensor_width != self->sensor_width ||
+      calib->sensor_height != self->sensor_height)
+    {
+      fp_warn ("<calibrate> ignoring mismatching cached calibration");
+      g_clear_pointer (&self->calib_cache, g_bytes_unref);
+      fpi_device_calibration_clear (FP_DEVICE (self));
+      return NULL;
+    }
+
+  return calib;
+}
+
+static void
+elanspi_calibration_save (FpiDeviceElanSpi *self)
+{
+  g_autofree gchar *firmware = elanspi_calibration_firmware (self);
+  g_autoptr(GBytes) data = NULL;
+  struct elanspi_calibration *calib;
+  gsize bg_size = self->sensor_width * self->sensor_height * 2;
+
+  calib = g_malloc (sizeof (*calib) + bg_size);
+  calib->sensor_width = self->sensor_width;
+  calib->sensor_height = self->sensor_height;
+  if (self->sensor_id == 0xe)
+    calib->dac_value = self->hv_data.gdac_value;
+  else
+    calib->dac_value = self->old_data.dac_value;
+  memcpy (calib->bg_image, self->bg_image, bg_size);
+
+  data = g_bytes_new_take (calib, sizeof (*calib) + bg_size);
+  fpi_device_calibration_save (FP_DEVICE (self), firmware, data);
+}
+
 static int
 elanspi_mean_image (FpiDeviceElanSpi *self, const guint16 *img)
 {
@@ -611,6 +680,12 @@ elanspi_calibrate_old_handler (FpiSsm *ssm, FpDevice *dev)
     case ELANSPI_CALIBOLD_DACBASE_CAPTURE:
     case ELANSPI_CALIBOLD_CHECKFIN_CAPTURE:
     case ELANSPI_CALIBOLD_DACFINE_CAPTURE:
+      /* restore the cached dac instead of searching for it */
+      if (self->calib_cache)
+        {
+          fpi_ssm_jump_to_state (ssm, ELANSPI_CALIBOLD_RESTORE_WRITE_DAC1);
+          return;
+        }
       chld = fpi_ssm_new (dev, elanspi_capture_old_handler, ELANSPI_CAPTOLD_NSTATES);
       fpi_ssm_silence_debug (chld);
       fpi_ssm_start_subsm (ssm, chld);
@@ -679,6 +754,20 @@ elanspi_calibrate_old_handler (FpiSsm *ssm, FpDevice *dev)
       fpi_ssm_jump_to_state (ssm, ELANSPI_CALIBOLD_DACFINE_CAPTURE);
       return;
 
+    case ELANSPI_CALIBOLD_RESTORE_WRITE_DAC1:
+      self->old_data.dac_value = ((const struct elanspi_calibration *) g_bytes_get_data (self->calib_cache, NULL))->dac_value;
+      fp_dbg ("<calibold> restoring dac 0x%02x", self->old_data.dac_value);
+      xfer = elanspi_write_register (self, 0x6, self->old_data.dac_value - 0x40);
+      xfer->ssm = ssm;
+      fpi_spi_transfer_submit (xfer, fpi_device_get_cancellable (dev), fpi_ssm_spi_transfer_cb, NULL);
+      return;
+
+    case ELANSPI_CALIBOLD_RESTORE_WRITE_GAIN:
+      xfer = elanspi_write_register (self, 0x5, 0x6f);
+      xfer->ssm = ssm;
+      fpi_spi_transfer_submit (xfer, fpi_device_get_cancellable (dev), fpi_ssm_spi_transfer_cb, NULL);
+      return;
+
     case ELANSPI_CALIBOLD_PROTECT:
       fp_dbg ("<calibold> calibration ok, saving bg image");
       xfer = elanspi_write_register (self, 0x00, 0x00);
@@ -851,6 +940,14 @@ elanspi_calibrate_hv_handler (FpiSsm *ssm, FpDevice *dev)
 
     case ELANSPI_CALIBHV_WRITE_GDAC_H:
     case ELANSPI_CALIBHV_WRITE_BEST_GDAC_H:
+      /* restore the cached gdac instead of searching for it */
+      if (fpi_ssm_get_cur_state (ssm) == ELANSPI_CALIBHV_WRITE_GDAC_H && self->calib_cache)
+        {
+          self->hv_data.best_gdac = ((const struct elanspi_calibration *) g_bytes_get_data (self->calib_cache, NULL))->dac_value;
+          fp_dbg ("<calibhv> restoring gdac %04x", self->hv_data.best_gdac);
+          fpi_ssm_jump_to_state (ssm, ELANSPI_CALIBHV_WRITE_BEST_GDAC_H);
+          return;
+        }
       if (fpi_ssm_get_cur_state (ssm) == ELANSPI_CALIBHV_WRITE_BEST_GDAC_H)
         self->hv_data.gdac_value = self->hv_data.best_gdac;
       xfer = elanspi_write_register (self, 0x06, (self->hv_data.gdac_value >> 2) & 0xff);
@@ -1117,7 +1214,10 @@ do_sw_reset:
       return;
 
     case ELANSPI_INIT_CALIBRATE:
-      fp_dbg ("<init/calibrate> starting calibrate");
+      if (elanspi_calibration_load (self))
+        fp_dbg ("<init/calibrate> restoring cached calibration");
+      else
+        fp_dbg ("<init/calibrate> starting calibrate");
       /* if sensor is hv */
       if (self->sensor_id == 0xe)
         chld = fpi_ssm_new_full (dev, elanspi_calibrate_hv_handler, ELANSPI_CALIBHV_NSTATES, ELANSPI_CALIBHV_PROTECT, "HV calibrate");
@@ -1137,7 +1237,28 @@ do_sw_reset:
       return;
 
     case ELANSPI_INIT_BG_SAVE:
-      memcpy (self->bg_image, self->last_image, self->sensor_height * self->sensor_width * 2);
+      if (self->calib_cache)
+        {
+          const struct elanspi_calibration *calib = g_bytes_get_data (self->calib_cache, NULL);
+          int mean_diff = abs (elanspi_mean_image (self, self->last_image) -
+                               elanspi_mean_image (self, calib->bg_image));
+
+          g_clear_pointer (&self->calib_cache, g_bytes_unref);
+          if (mean_diff > ELANSPI_MAX_CACHED_BG_MEAN_DIFF)
+            {
+              /* the sensor drifted (or a finger is present), calibrate properly */
+              fp_dbg ("<init/calibrate> cached calibration invalid (mdiff = %d)", mean_diff);
+              fpi_device_calibration_clear (dev);
+              fpi_ssm_jump_to_state (ssm, ELANSPI_INIT_CALIBRATE);
+              return;
+            }
+          memcpy (self->bg_image, self->last_image, self->sensor_height * self->sensor_width * 2);
+        }
+      else
+        {
+          memcpy (self->bg_image, self->last_image, self->sensor_height * self->sensor_width * 2);
+          elanspi_calibration_save (self);
+        }
       fpi_ssm_mark_completed (ssm);
       return;
     }
@@ -1153,19 +1274,15 @@ enum elanspi_guess_result {
 static gint
 elanspi_correct_with_bg (FpiDeviceElanSpi *self, guint16 *raw_image)
 {
+  const guint16 *bg_image = self->bg_image;
+  gint size = self->sensor_width * self->sensor_height;
   gint count = 0;
 
-  for (int i = 0; i < self->sensor_width * self->sensor_height; i += 1)
+  /* Branch-free saturating subtraction, which compilers can vectorize */
+  for (int i = 0; i < size; i += 1)
     {
-      if (raw_image[i] < self->bg_image[i])
-        {
-          count += 1;
-          raw_image[i] = 0;
-        }
-      else
-        {
-          raw_image[i] -= self->bg_image[i];
-        }
+      count += raw_image[i] < bg_image[i];
+      raw_image[i] = MAX (raw_image[i], bg_image[i]) - bg_image[i];
     }
 
   return count;
@@ -1269,85 +1386,102 @@ elanspi_check_waitupdown_done (FpiDeviceElanSpi *self, enum elanspi_guess_result
     }
 }
 
-static int
-cmp_u16 (const void *a, const void *b)
-{
-  return (int) (*(guint16 *) a - *(guint16 *) b);
-}
-
 static void
 elanspi_process_frame (FpiDeviceElanSpi *self, const guint16 *data_in, guint8 *data_out)
 {
   size_t frame_size = self->frame_width * self->frame_height;
-  guint16 data_in_sorted[frame_size];
+  guint16 data_in_rotated[frame_size];
+  const gint ranks[] = {
+    0, frame_size * 3 / 10, frame_size * 65 / 100, frame_size - 1
+  };
+  guint16 levels[G_N_ELEMENTS (ranks)];
 
   for (int i = 0, offset = 0; i < self->frame_height; i += 1)
     for (int j = 0; j < self->frame_width; j += 1)
-      data_in_sorted[offset++] = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
+      data_in_rotated[offset++] = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
 
-  qsort (data_in_sorted, frame_size, 2, cmp_u16);
-  guint16 lvl0 = data_in_sorted[0];
-  guint16 lvl1 = data_in_sorted[frame_size * 3 / 10];
-  guint16 lvl2 = data_in_sorted[frame_size * 65 / 100];
-  guint16 lvl3 = data_in_sorted[frame_size - 1];
+  fpi_percentiles_u16 (data_in_rotated, frame_size, ranks, levels, G_N_ELEMENTS (ranks));
+  guint16 lvl0 = levels[0];
+  guint16 lvl1 = levels[1];
+  guint16 lvl2 = levels[2];
+  guint16 lvl3 = levels[3];
 
   lvl1 = MAX (lvl1, lvl0 + 1);
   lvl2 = MAX (lvl2, lvl1 + 1);
   lvl3 = MAX (lvl3, lvl2 + 1);
 
-  for (int i = 0; i < self->frame_height; i += 1)
+  for (size_t i = 0; i < frame_size; i += 1)
     {
-      for (int j = 0; j < self->frame_width; j += 1)
+      guint16 px = data_in_rotated[i];
+      if (px < lvl0)
         {
-          guint16 px = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
-          if (px < lvl0)
-            {
-              px = 0;
-            }
-          else if (px > lvl3)
-            {
-              px = 255;
-            }
-          else
-            {
-              if (lvl0 <= px && px < lvl1)
-                px = (px - lvl0) * 99 / (lvl1 - lvl0);
-              else if (lvl1 <= px && px < lvl2)
-                px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
-              else /* (lvl2 <= px && px <= lvl3) */
-                px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
-            }
-          *data_out = px;
-          data_out += 1;
+          px = 0;
+        }
+      else if (px > lvl3)
+        {
+          px = 255;
+        }
+      else
+        {
+          if (lvl0 <= px && px < lvl1)
+            px = (px - lvl0) * 99 / (lvl1 - lvl0);
+          else if (lvl1 <= px && px < lvl2)
+            px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
+          else /* (lvl2 <= px && px <= lvl3) */
+            px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
         }
+      data_out[i] = px;
     }
 }
 
-static unsigned char
-elanspi_fp_assembling_get_pixel (struct fpi_frame_asmbl_ctx *ctx, struct fpi_frame *frame, unsigned int x, unsigned int y)
+static void
+elanspi_fp_frame_init_assembling_ctx (FpiDeviceElanSpi           *self,
+                                      struct fpi_frame_asmbl_ctx *assembling_ctx)
 {
-  return frame->data[y * ctx->frame_width + x];
+  *assembling_ctx = (struct fpi_frame_asmbl_ctx) {
+    .image_width = (self->frame_width * 3) / 2,
+
+    .frame_width = self->frame_width,
+    .frame_height = self->frame_height,
+
+    .format = FPI_FRAME_FORMAT_8BIT,
+  };
 }
 
 static void
-elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
+elanspi_fp_frame_stitch_cb (GObject      *source_object,
+                            GAsyncResult *res,
+                            gpointer      user_data)
 {
+  FpiSsm *ssm = user_data;
+  FpiDeviceElanSpi *self = FPI_DEVICE_ELANSPI (fpi_ssm_get_device (ssm));
   g_autoptr(FpImage) img = NULL;
   g_autoptr(FpImage) scaled = NULL;
-  struct fpi_frame_asmbl_ctx assembling_ctx = {
-    .image_width = (self->frame_width * 3) / 2,
+  g_autoptr(GError) error = NULL;
+  struct fpi_frame_asmbl_ctx assembling_ctx;
+  gboolean estimated;
 
-    .frame_width = self->frame_width,
-    .frame_height = self->frame_height,
+  estimated = fpi_do_movement_estimation_finish (res, &error);
+  if (self->deactivating)
+    {
+      /* The capture state completes the pending deactivation */
+      fp_dbg ("<fp_frame> got deactivate; dropping frames");
+      g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+      fpi_ssm_jump_to_state (ssm, ELANSPI_FPCAPT_WAITUP_CAPTURE);
+      return;
+    }
 
-    .get_pixel = elanspi_fp_assembling_get_pixel,
-  };
+  if (!estimated)
+    {
+      g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+      fpi_ssm_mark_failed (ssm, g_steal_pointer (&error));
+      return;
+    }
 
   /* stitch image */
-  GSList *frame_start = g_slist_nth (self->fp_frame_list, ELANSPI_SWIPE_FRAMES_DISCARD);
-
-  fpi_do_movement_estimation (&assembling_ctx, frame_start);
-  img = fpi_assemble_frames (&assembling_ctx, frame_start);
+  elanspi_fp_frame_init_assembling_ctx (self, &assembling_ctx);
+  img = fpi_assemble_frames (&assembling_ctx,
+                             g_slist_nth (self->fp_frame_list, ELANSPI_SWIPE_FRAMES_DISCARD));
   scaled = fpi_image_resize (img, 2, 2);
 
   scaled->flags |= FPI_IMAGE_PARTIAL | FPI_IMAGE_COLORS_INVERTED;
@@ -1357,6 +1491,25 @@ elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
 
   /* clean out frame data */
   g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+
+  /* prepare for wait up */
+  self->finger_wait_debounce = 0;
+  fpi_ssm_jump_to_state (ssm, ELANSPI_FPCAPT_WAITUP_CAPTURE);
+}
+
+/* Estimating the movement is expensive, so it is done in a worker thread
+ * and the capture continues from elanspi_fp_frame_stitch_cb(). The frame
+ * list is left alone until then. */
+static void
+elanspi_fp_frame_stitch_and_submit (FpiSsm *ssm, FpiDeviceElanSpi *self)
+{
+  struct fpi_frame_asmbl_ctx assembling_ctx;
+
+  elanspi_fp_frame_init_assembling_ctx (self, &assembling_ctx);
+  fpi_do_movement_estimation_async (&assembling_ctx,
+                                    g_slist_nth (self->fp_frame_list, ELANSPI_SWIPE_FRAMES_DISCARD),
+                                    fpi_device_get_cancellable (FP_DEVICE (self)),
+                                    elanspi_fp_frame_stitch_cb, ssm);
 }
 
 static gint64
@@ -1402,7 +1555,8 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
           if (g_slist_length (self->fp_frame_list) >= ELANSPI_MIN_FRAMES_SWIPE)
             {
               fp_dbg ("<fp_frame> have enough frames, submitting");
-              elanspi_fp_frame_stitch_and_submit (self);
+              elanspi_fp_frame_stitch_and_submit (ssm, self);
+              return;
             }
           else
             {
@@ -1432,8 +1586,8 @@ elanspi_fp_frame_handler (FpiSsm *ssm, FpiDeviceElanSpi *self)
       if (g_slist_length (self->fp_frame_list) > ELANSPI_MAX_FRAMES_SWIPE)
         {
           fp_dbg ("<fp_frame> have enough frames, exiting now");
-          elanspi_fp_frame_stitch_and_submit (self);
-          goto finish_capture;
+          elanspi_fp_frame_stitch_and_submit (ssm, self);
+          return;
         }
 
       /* append image */
@@ -1681,6 +1835,7 @@ fpi_device_elanspi_finalize (GObject *this)
   FpiDeviceElanSpi *self = FPI_DEVICE_ELANSPI (this);
 
   g_clear_pointer (&self->bg_image, g_free);
+  g_clear_pointer (&self->calib_cache, g_bytes_unref);
   g_clear_pointer (&self->last_image, g_free);
   g_clear_pointer (&self->prev_frame_image, g_free);
   g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
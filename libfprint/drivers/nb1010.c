@@ -40,7 +40,6 @@
 #define NB1010_N_PARTIAL (FRAME_HEIGHT / NB1010_LINE_PER_PARTIAL)
 
 #define NB1010_DEFAULT_TIMEOUT 500
-#define NB1010_TRANSITION_DELAY 50
 
 /* Loop ssm states */
 enum {
@@ -310,7 +309,7 @@ submit_image (FpiSsm        *ssm,
   FpiDeviceNb1010 *self = FPI_DEVICE_NB1010 (dev);
   FpImage *img;
 
-  img = fp_image_new (FRAME_WIDTH, FRAME_HEIGHT);
+  img = fpi_image_device_new_image (dev, FRAME_WIDTH, FRAME_HEIGHT);
   if (img == NULL)
     return 0;
 
@@ -353,7 +352,7 @@ m_loop_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case M_WAIT_PRINT:
       /* Wait fingerprint scanning */
-      fpi_ssm_next_state_delayed (ssm, NB1010_TRANSITION_DELAY);
+      fpi_ssm_next_state_polled (ssm);
       break;
 
     case M_REQUEST_PRINT:
@@ -431,6 +430,8 @@ fpi_device_nb1010_class_init (FpiDeviceNb1010Class *klass)
   dev_class->type = FP_DEVICE_TYPE_USB;
   dev_class->id_table = id_table;
   dev_class->scan_type = FP_SCAN_TYPE_PRESS;
+  dev_class->poll_min_ms = 20;
+  dev_class->poll_max_ms = 50;
 
   img_class->img_height = FRAME_HEIGHT;
   img_class->img_width = FRAME_WIDTH;
@@ -78,8 +78,7 @@ struct _FpiDeviceUpeksonly
   GPtrArray     *img_transfers;
   int            num_flying;
 
-  GSList        *rows;
-  unsigned       num_rows;
+  FpiFrameStore *rows;
   unsigned char *rowbuf;
   int            rowbuf_offset;
 
@@ -103,35 +102,27 @@ G_DEFINE_TYPE (FpiDeviceUpeksonly, fpi_device_upeksonly, FP_TYPE_IMAGE_DEVICE);
 /* Calculate squared standard deviation of sum of two lines */
 static int
 upeksonly_get_deviation2 (struct fpi_line_asmbl_ctx *ctx,
-                          GSList *line1, GSList *line2)
+                          gconstpointer line1, gconstpointer line2)
 {
-  unsigned char *buf1 = line1->data, *buf2 = line2->data;
-  int res = 0, mean = 0, i;
-
   g_assert (ctx->line_width > 0);
 
-  for (i = 0; i < ctx->line_width; i += 2)
-    mean += (int) buf1[i + 1] + (int) buf2[i];
-
-  mean /= (ctx->line_width / 2);
-
-  for (i = 0; i < ctx->line_width; i += 2)
-    {
-      int dev = (int) buf1[i + 1] + (int) buf2[i] - mean;
-      res += dev * dev;
-    }
-
-  return res / (ctx->line_width / 2);
+  /* The odd pixels of the first line are paired with the even pixels of
+   * the second one */
+  return fpi_line_sum_std_sq_dev ((const guint8 *) line1 + 1, line2,
+                                  ctx->line_width / 2, 2);
 }
 
 
 static unsigned char
 upeksonly_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                     GSList                    *row,
+                     gconstpointer              row,
                      unsigned                   x)
 {
-  unsigned char *buf;
+  FpiDeviceUpeksonly *self = ctx->user_data;
+  const unsigned char *buf = row;
+  const unsigned char *first_row;
   unsigned offset;
+  guint index;
 
   /* The scans from this device are rolled right by two columns */
   if (x < ctx->line_width - 2)
@@ -140,11 +131,12 @@ upeksonly_get_pixel (struct fpi_line_asmbl_ctx *ctx,
     offset = x - (ctx->line_width - 2);
   else
     return 0;
-  /* Each 2nd pixel is shifted 2 pixels down */
-  if ((!(x & 1)) && g_slist_next (row) && g_slist_next (g_slist_next (row)))
-    buf = g_slist_next (g_slist_next (row))->data;
-  else
-    buf = row->data;
+  /* Each 2nd pixel is shifted 2 pixels down, the rows are stored one
+   * after another */
+  first_row = fpi_frame_store_get (self->rows, 0);
+  index = (buf - first_row) / ctx->line_width;
+  if ((!(x & 1)) && index + 2 < fpi_frame_store_get_n_items (self->rows))
+    buf += 2 * ctx->line_width;
 
   return buf[offset];
 }
@@ -196,7 +188,7 @@ cancel_img_transfers (FpImageDevice *dev)
 static gboolean
 is_capturing (FpiDeviceUpeksonly *sdev)
 {
-  return sdev->num_rows < MAX_ROWS && (sdev->finger_state != FINGER_REMOVED);
+  return fpi_frame_store_get_n_items (sdev->rows) < MAX_ROWS && (sdev->finger_state != FINGER_REMOVED);
 }
 
 static void
@@ -205,21 +197,16 @@ handoff_img (FpImageDevice *dev)
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   FpImage *img;
 
-  GSList *elem = self->rows;
-
-  if (!elem)
+  if (fpi_frame_store_get_n_items (self->rows) == 0)
     {
       fp_err ("no rows?");
       return;
     }
 
-  self->rows = g_slist_reverse (self->rows);
-
-  fp_dbg ("%u rows", self->num_rows);
-  img = fpi_assemble_lines (&self->assembling_ctx, self->rows, self->num_rows);
+  fp_dbg ("%u rows", fpi_frame_store_get_n_items (self->rows));
+  img = fpi_assemble_lines_store (&self->assembling_ctx, self->rows);
 
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+  fpi_frame_store_clear (self->rows);
 
   fpi_image_device_image_captured (dev, img);
   fpi_image_device_report_finger_status (dev, FALSE);
@@ -233,12 +220,13 @@ static void
 row_complete (FpImageDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
+  guint num_rows = fpi_frame_store_get_n_items (self->rows);
 
   self->rowbuf_offset = -1;
 
-  if (self->num_rows > 0)
+  if (num_rows > 0)
     {
-      unsigned char *lastrow = self->rows->data;
+      unsigned char *lastrow = fpi_frame_store_get (self->rows, num_rows - 1);
       int std_sq_dev, mean_sq_diff;
 
       std_sq_dev = fpi_std_sq_dev (self->rowbuf, self->img_width);
@@ -296,7 +284,7 @@ row_complete (FpImageDevice *dev)
             {
               self->finger_state = FINGER_REMOVED;
               fp_dbg ("detected finger removal. Blank rows: %d, Full rows: %u",
-                      self->num_blank, self->num_rows);
+                      self->num_blank, num_rows);
               handoff_img (dev);
               return;
             }
@@ -310,10 +298,9 @@ row_complete (FpImageDevice *dev)
   switch (self->finger_state)
     {
     case AWAIT_FINGER:
-      if (!self->num_rows)
+      if (!num_rows)
         {
-          self->rows = g_slist_prepend (self->rows, self->rowbuf);
-          self->num_rows++;
+          memcpy (fpi_frame_store_append (self->rows), self->rowbuf, self->img_width);
         }
       else
         {
@@ -323,13 +310,11 @@ row_complete (FpImageDevice *dev)
 
     case FINGER_DETECTED:
     case FINGER_REMOVED:
-      self->rows = g_slist_prepend (self->rows, self->rowbuf);
-      self->num_rows++;
+      memcpy (fpi_frame_store_append (self->rows), self->rowbuf, self->img_width);
       break;
     }
-  self->rowbuf = NULL;
 
-  if (self->num_rows >= MAX_ROWS)
+  if (fpi_frame_store_get_n_items (self->rows) >= MAX_ROWS)
     {
       fp_dbg ("row limit met");
       handoff_img (dev);
@@ -402,14 +387,16 @@ handle_packet (FpImageDevice *dev, unsigned char *data)
           /* Minimize distortions for readers that lose a lot of packets */
           for (i = 1; i < missing_data; i++)
             {
+              guint num_rows = fpi_frame_store_get_n_items (self->rows);
+
               abs_base_addr = (self->last_seqnum + 1) * 62;
 
               /* If possible take the replacement data from last row */
-              if (self->num_rows > 1)
+              if (num_rows > 1)
                 {
                   int row_left = self->img_width - self->rowbuf_offset;
-                  unsigned char *last_row = g_slist_nth_data (self->rows,
-                                                              0);
+                  unsigned char *last_row = fpi_frame_store_get (self->rows,
+                                                                 num_rows - 1);
 
                   if (row_left >= 62)
                     {
@@ -565,91 +552,42 @@ img_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
 
 /***** STATE MACHINE HELPERS *****/
 
-struct write_regs_data
-{
-  FpDevice                    *dev;
-  FpiSsm                      *ssm;
-  FpiUsbTransfer              *transfer;
-  const struct sonly_regwrite *regs;
-  size_t                       num_regs;
-  size_t                       regs_written;
-};
-
-static void
-write_regs_finished (struct write_regs_data *wrdata, GError *error)
-{
-  if (!error)
-    fpi_ssm_next_state (wrdata->ssm);
-  else
-    fpi_ssm_mark_failed (wrdata->ssm, error);
-
-  g_free (wrdata);
-}
-
-static void write_regs_iterate (struct write_regs_data *wrdata);
-
-static void
-write_regs_cb (FpiUsbTransfer *transfer, FpDevice *device,
-               gpointer user_data, GError *error)
-{
-  struct write_regs_data *wrdata = user_data;
-
-  if (error)
-    {
-      write_regs_finished (wrdata, error);
-      return;
-    }
-
-  wrdata->regs_written++;
-  write_regs_iterate (wrdata);
-}
-
-static void
-write_regs_iterate (struct write_regs_data *wrdata)
+/* The device takes one register per control transfer, but several of them
+ * can be queued. */
+static guint
+sonly_pack_reg (FpiUsbTransfer *transfer, const FpiRegmapWrite *writes,
+                guint n_writes)
 {
-  FpiUsbTransfer *transfer;
-  const struct sonly_regwrite *regwrite;
-
-  if (wrdata->regs_written >= wrdata->num_regs)
-    {
-      write_regs_finished (wrdata, NULL);
-      return;
-    }
+  fp_dbg ("set %02x=%02x", writes[0].reg, writes[0].value);
 
-  regwrite = &wrdata->regs[wrdata->regs_written];
-  fp_dbg ("set %02x=%02x", regwrite->reg, regwrite->value);
-
-  transfer = fpi_usb_transfer_new (wrdata->dev);
   fpi_usb_transfer_fill_control (transfer,
                                  G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE,
                                  G_USB_DEVICE_REQUEST_TYPE_VENDOR,
                                  G_USB_DEVICE_RECIPIENT_DEVICE,
                                  0x0c,
                                  0,
-                                 regwrite->reg,
+                                 writes[0].reg,
                                  1);
   transfer->short_is_error = TRUE;
-  transfer->ssm = wrdata->ssm;
-  transfer->buffer[0] = regwrite->value;
+  transfer->buffer[0] = writes[0].value;
 
-  fpi_usb_transfer_submit (transfer, CTRL_TIMEOUT, NULL, write_regs_cb, wrdata);
+  return 1;
 }
 
+/* Writes are sent one at a time, like the recorded traffic of the device */
+static const FpiRegmapProtocol sonly_protocol = {
+  .pack = sonly_pack_reg,
+  .timeout_ms = CTRL_TIMEOUT,
+  .max_in_flight = 1,
+};
+
 static void
-sm_write_regs (FpiSsm                      *ssm,
-               FpDevice                    *dev,
-               const struct sonly_regwrite *regs,
-               size_t                       num_regs)
+sm_write_regs (FpiSsm               *ssm,
+               FpDevice             *dev,
+               const FpiRegmapWrite *regs,
+               size_t                num_regs)
 {
-  struct write_regs_data *wrdata = g_malloc (sizeof (*wrdata));
-
-  wrdata->ssm = ssm;
-  wrdata->regs = regs;
-  wrdata->num_regs = num_regs;
-  wrdata->regs_written = 0;
-  wrdata->dev = dev;
-
-  write_regs_iterate (wrdata);
+  fpi_regmap_write (ssm, dev, &sonly_protocol, regs, num_regs, NULL);
 }
 
 static void
@@ -921,7 +859,7 @@ capsm_2016_run_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case CAPSM_2016_INIT:
       self->rowbuf_offset = -1;
-      self->num_rows = 0;
+      fpi_frame_store_clear (self->rows);
       self->wraparounds = -1;
       self->num_blank = 0;
       self->num_nonblank = 0;
@@ -958,7 +896,7 @@ capsm_1000_run_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case CAPSM_1000_INIT:
       self->rowbuf_offset = -1;
-      self->num_rows = 0;
+      fpi_frame_store_clear (self->rows);
       self->wraparounds = -1;
       self->num_blank = 0;
       self->num_nonblank = 0;
@@ -987,7 +925,7 @@ capsm_1001_run_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case CAPSM_1001_INIT:
       self->rowbuf_offset = -1;
-      self->num_rows = 0;
+      fpi_frame_store_clear (self->rows);
       self->wraparounds = -1;
       self->num_blank = 0;
       self->num_nonblank = 0;
@@ -1329,8 +1267,7 @@ deactivate_done (FpImageDevice *dev, GError *error)
   g_free (self->rowbuf);
   self->rowbuf = NULL;
 
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+  fpi_frame_store_clear (self->rows);
 
   fpi_image_device_deactivate_complete (dev, error);
 }
@@ -1441,8 +1378,11 @@ static void dev_init (FpImageDevice *dev);
 static void
 dev_deinit (FpImageDevice *dev)
 {
+  FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   GError *error = NULL;
 
+  g_clear_pointer (&self->rows, fpi_frame_store_free);
+
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
   fpi_image_device_close_complete (dev, error);
@@ -1525,6 +1465,7 @@ dev_init (FpImageDevice *dev)
   self->assembling_ctx.max_search_offset = 30;
   self->assembling_ctx.get_deviation = upeksonly_get_deviation2;
   self->assembling_ctx.get_pixel = upeksonly_get_pixel;
+  self->assembling_ctx.user_data = self;
 
   self = FPI_DEVICE_UPEKSONLY (dev);
   self->dev_model = (int) fpi_device_get_driver_data (FP_DEVICE (dev));
@@ -1551,5 +1492,7 @@ dev_init (FpImageDevice *dev)
     default:
       g_assert_not_reached ();
     }
+  self->rows = fpi_frame_store_new (self->img_width, MAX_ROWS);
+
   fpi_image_device_open_complete (dev, NULL);
 }
@@ -270,7 +270,7 @@ capture_read_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
       return;
     }
 
-  img = fp_image_new (IMAGE_WIDTH, IMAGE_HEIGHT);
+  img = fpi_image_device_new_image (dev, IMAGE_WIDTH, IMAGE_HEIGHT);
   memcpy (img->data, transfer->buffer, IMAGE_SIZE);
   fpi_image_device_image_captured (dev, img);
   fpi_image_device_report_finger_status (dev, FALSE);
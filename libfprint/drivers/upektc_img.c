@@ -334,7 +334,8 @@ capture_read_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
           BUG_ON (self->image_size != self->expected_image_size);
           fp_dbg ("Image size is %lu",
                   (gulong) self->image_size);
-          img = fp_image_new (img_class->img_width, img_class->img_height);
+          img = fpi_image_device_new_image (dev, img_class->img_width,
+                                            img_class->img_height);
           img->flags |= FPI_IMAGE_PARTIAL;
           memcpy (img->data, self->image_bits,
                   self->image_size);
@@ -0,0 +1,157 @@
+/*
+ * Digital Persona U.are.U 4000/4000B/4500 image decryption
+ * Copyright (C) 2007-2008 Daniel Drake <dsd@gentoo.org>
+ * Copyright (C) 2012 Timo Teräs <timo.teras@iki.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "uru4000_crypt.h"
+
+static uint32_t
+update_key (uint32_t key)
+{
+  /* linear feedback shift register
+   * taps at bit positions 1 3 4 7 11 13 20 23 26 29 32 */
+  uint32_t bit = key & 0x9248144d;
+
+  bit ^= bit << 16;
+  bit ^= bit << 8;
+  bit ^= bit << 4;
+  bit ^= bit << 2;
+  bit ^= bit << 1;
+  return (bit & 0x80000000) | (key >> 1);
+}
+
+static uint8_t
+key_stream_byte (uint32_t key)
+{
+  uint8_t xorbyte;
+
+  xorbyte  = ((key >>  4) & 1) << 0;
+  xorbyte |= ((key >>  8) & 1) << 1;
+  xorbyte |= ((key >> 11) & 1) << 2;
+  xorbyte |= ((key >> 14) & 1) << 3;
+  xorbyte |= ((key >> 18) & 1) << 4;
+  xorbyte |= ((key >> 21) & 1) << 5;
+  xorbyte |= ((key >> 24) & 1) << 6;
+  xorbyte |= ((key >> 29) & 1) << 7;
+
+  return xorbyte;
+}
+
+/* The key stream is a linear function of the key, and so is the key after
+ * any number of updates. The next KEY_BLOCK_SIZE bytes of key stream and
+ * the key following them are therefore precomputed for every value of each
+ * byte of the key, and combined using XOR. The key stream is stored in
+ * memory order, so that it can be applied to a whole block at once. */
+#define KEY_BLOCK_SIZE 8
+
+static struct
+{
+  uint64_t stream;
+  uint32_t key;
+} key_blocks[4][256];
+
+/* Must be called once before decoding any image */
+void
+uru4k_key_blocks_init (void)
+{
+  int i, v, n;
+
+  for (i = 0; i < 4; i++)
+    {
+      for (v = 0; v < 256; v++)
+        {
+          uint8_t stream[KEY_BLOCK_SIZE];
+          uint32_t key = (uint32_t) v << (8 * i);
+
+          for (n = 0; n < KEY_BLOCK_SIZE; n++)
+            {
+              stream[n] = key_stream_byte (key);
+              key = update_key (key);
+            }
+
+          memcpy (&key_blocks[i][v].stream, stream, sizeof (stream));
+          key_blocks[i][v].key = key;
+        }
+    }
+}
+
+static inline uint32_t
+next_key_block (uint32_t key, uint64_t *stream)
+{
+  *stream = key_blocks[0][key & 0xff].stream ^
+            key_blocks[1][(key >> 8) & 0xff].stream ^
+            key_blocks[2][(key >> 16) & 0xff].stream ^
+            key_blocks[3][key >> 24].stream;
+
+  return key_blocks[0][key & 0xff].key ^
+         key_blocks[1][(key >> 8) & 0xff].key ^
+         key_blocks[2][(key >> 16) & 0xff].key ^
+         key_blocks[3][key >> 24].key;
+}
+
+/* Advances the key past @num_bytes unencrypted bytes */
+uint32_t
+uru4k_skip_key (uint32_t key, int num_bytes)
+{
+  uint64_t stream;
+  int i;
+
+  for (i = 0; i + KEY_BLOCK_SIZE <= num_bytes; i += KEY_BLOCK_SIZE)
+    key = next_key_block (key, &stream);
+
+  for (; i < num_bytes; i++)
+    key = update_key (key);
+
+  return key;
+}
+
+/* Decrypts @num_bytes of @data in place and returns the key for the
+ * following data */
+uint32_t
+uru4k_decode (uint8_t *data, int num_bytes, uint32_t key)
+{
+  uint64_t stream, block;
+  int i;
+
+  /* Decrypt whole blocks, each byte is taken from the following one */
+  for (i = 0; i + KEY_BLOCK_SIZE < num_bytes; i += KEY_BLOCK_SIZE)
+    {
+      key = next_key_block (key, &stream);
+
+      memcpy (&block, data + i + 1, sizeof (block));
+      block ^= stream;
+      memcpy (data + i, &block, sizeof (block));
+    }
+
+  for (; i < num_bytes - 1; i++)
+    {
+      /* calculate xor byte and update key */
+      uint8_t xorbyte = key_stream_byte (key);
+
+      key = update_key (key);
+
+      /* decrypt data */
+      data[i] = data[i + 1] ^ xorbyte;
+    }
+
+  /* the final byte is implicitly zero */
+  data[i] = 0;
+  return update_key (key);
+}
@@ -216,7 +216,9 @@ sm_do_capture (FpiSsm   *ssm,
   FpImageDeviceClass *cls = FP_IMAGE_DEVICE_GET_CLASS (dev);
 
   G_DEBUG_HERE ();
-  self->capture_img = fp_image_new (cls->img_width, cls->img_height);
+  self->capture_img = fpi_image_device_new_image (FP_IMAGE_DEVICE (dev),
+                                                  cls->img_width,
+                                                  cls->img_height);
   self->capture_iteration = 0;
   capture_iterate (ssm, dev);
 }
@@ -166,21 +166,13 @@ async_abort (FpDevice *dev, FpiSsm *ssm, int ep)
 
 /* Image processing functions */
 
-/* Pixel getter for fpi_assemble_lines */
-static unsigned char
-vfs0050_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                   GSList * line, unsigned int x)
-{
-  return ((struct vfs_line *) line->data)->data[x];
-}
-
 /* Deviation getter for fpi_assemble_lines */
 static int
 vfs0050_get_difference (struct fpi_line_asmbl_ctx *ctx,
-                        GSList * line_list_1, GSList * line_list_2)
+                        gconstpointer line_1, gconstpointer line_2)
 {
-  struct vfs_line *line1 = line_list_1->data;
-  struct vfs_line *line2 = line_list_2->data;
+  const struct vfs_line *line1 = line_1;
+  const struct vfs_line *line2 = line_2;
   const int shift = (VFS_IMAGE_WIDTH - VFS_NEXT_LINE_WIDTH) / 2 - 1;
   int res = 0;
 
@@ -217,7 +209,8 @@ static struct fpi_line_asmbl_ctx assembling_ctx = {
   .median_filter_size = 25,
   .max_search_offset = 100,
   .get_deviation = vfs0050_get_difference,
-  .get_pixel = vfs0050_get_pixel,
+  .format = FPI_FRAME_FORMAT_8BIT,
+  .offset = G_STRUCT_OFFSET (struct vfs_line, data),
 };
 
 /* Processes image before submitting */
@@ -785,7 +785,7 @@ m_loop_state (FpiSsm *ssm, FpDevice *_dev)
 
     case M_LOOP_0_SLEEP:
       /* Wait fingerprint scanning */
-      fpi_ssm_next_state_delayed (ssm, 50);
+      fpi_ssm_next_state_polled (ssm);
       break;
 
     case M_LOOP_0_GET_STATE:
@@ -1357,6 +1357,8 @@ fpi_device_vfs101_class_init (FpDeviceVfs101Class *klass)
   dev_class->type = FP_DEVICE_TYPE_USB;
   dev_class->id_table = id_table;
   dev_class->scan_type = FP_SCAN_TYPE_SWIPE;
+  dev_class->poll_min_ms = 10;
+  dev_class->poll_max_ms = 50;
 
   img_class->img_open = dev_open;
   img_class->img_close = dev_close;
@@ -97,7 +97,7 @@ m_loop_state (FpiSsm *ssm, FpDevice *_dev)
 
     case M_WAIT_PRINT:
       /* Wait fingerprint scanning */
-      fpi_ssm_next_state_delayed (ssm, 200);
+      fpi_ssm_next_state_polled (ssm);
       break;
 
     case M_CHECK_PRINT:
@@ -257,6 +257,8 @@ fpi_device_vfs301_class_init (FpDeviceVfs301Class *klass)
   dev_class->type = FP_DEVICE_TYPE_USB;
   dev_class->id_table = id_table;
   dev_class->scan_type = FP_SCAN_TYPE_SWIPE;
+  dev_class->poll_min_ms = 50;
+  dev_class->poll_max_ms = 200;
 
   img_class->img_open = dev_open;
   img_class->img_close = dev_close;
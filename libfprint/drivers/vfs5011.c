@@ -207,37 +207,11 @@ usb_exchange_async (FpiSsm                  *ssm,
 
 /* Calculade squared standand deviation of sum of two lines */
 static int
-vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx, GSList *row1, GSList *row2)
+vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx, gconstpointer row1, gconstpointer row2)
 {
-  unsigned char *buf1, *buf2;
-  int res = 0, mean = 0, i;
-  const int size = 64;
-
-  buf1 = (unsigned char *) row1->data + 56;
-  buf2 = (unsigned char *) row2->data + 168;
-
-  for (i = 0; i < size; i++)
-    mean += (int) buf1[i] + (int) buf2[i];
-
-  mean /= size;
-
-  for (i = 0; i < size; i++)
-    {
-      int dev = (int) buf1[i] + (int) buf2[i] - mean;
-      res += dev * dev;
-    }
-
-  return res / size;
-}
-
-static unsigned char
-vfs5011_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                   GSList                    *row,
-                   unsigned                   x)
-{
-  unsigned char *data = (unsigned char *) row->data + 8;
-
-  return data[x];
+  return fpi_line_sum_std_sq_dev ((const guint8 *) row1 + 56,
+                                  (const guint8 *) row2 + 168,
+                                  64, 1);
 }
 
 /* ====================== main stuff ======================= */
@@ -255,7 +229,8 @@ static struct fpi_line_asmbl_ctx assembling_ctx = {
   .median_filter_size = 25,
   .max_search_offset = 30,
   .get_deviation = vfs5011_get_deviation2,
-  .get_pixel = vfs5011_get_pixel,
+  .format = FPI_FRAME_FORMAT_8BIT,
+  .offset = 8,
 };
 
 struct _FpDeviceVfs5011
@@ -266,7 +241,7 @@ struct _FpDeviceVfs5011
   unsigned char          *capture_buffer;
   unsigned char          *row_buffer;
   unsigned char          *lastline;
-  GSList                 *rows;
+  FpiFrameStore          *rows;
   int                     lines_captured, lines_recorded, empty_lines;
   int                     max_lines_captured, max_lines_recorded;
   int                     lines_total, lines_total_allocated;
@@ -299,6 +274,7 @@ capture_init (FpDeviceVfs5011 *self, int max_captured,
 {
   fp_dbg ("capture_init");
   self->lastline = NULL;
+  fpi_frame_store_clear (self->rows);
   self->lines_captured = 0;
   self->lines_recorded = 0;
   self->empty_lines = 0;
@@ -320,15 +296,19 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
 
   fp_dbg ("process_chunk: got %d bytes", transferred);
   int lines_captured = transferred / VFS5011_LINE_SIZE;
+  int line_dev[CAPTURE_LINES];
   int i;
 
+  g_assert (lines_captured <= CAPTURE_LINES);
+  fpi_std_sq_dev_batch (self->capture_buffer + 8, VFS5011_IMAGE_WIDTH,
+                        VFS5011_LINE_SIZE, lines_captured, line_dev);
+
   for (i = 0; i < lines_captured; i++)
     {
       unsigned char *linebuf = self->capture_buffer
                                + i * VFS5011_LINE_SIZE;
 
-      if (fpi_std_sq_dev (linebuf + 8, VFS5011_IMAGE_WIDTH)
-          < DEVIATION_THRESHOLD)
+      if (line_dev[i] < DEVIATION_THRESHOLD)
         {
           if (self->lines_captured == 0)
             continue;
@@ -359,9 +339,7 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
                                   linebuf + 8,
                                   VFS5011_IMAGE_WIDTH) >= DIFFERENCE_THRESHOLD))
         {
-          self->lastline = g_malloc (VFS5011_LINE_SIZE);
-          self->rows = g_slist_prepend (self->rows,
-                                        self->lastline);
+          self->lastline = fpi_frame_store_append (self->rows);
           memmove (self->lastline, linebuf, VFS5011_LINE_SIZE);
           self->lines_recorded++;
           if (self->lines_recorded >= self->max_lines_recorded)
@@ -388,15 +366,12 @@ submit_image (FpiSsm          *ssm,
       return;
     }
 
-  g_assert (self->rows != NULL);
-
-  self->rows = g_slist_reverse (self->rows);
+  g_assert (fpi_frame_store_get_n_items (self->rows) == (guint) self->lines_recorded);
 
-  img = fpi_assemble_lines (&assembling_ctx, self->rows,
-                            self->lines_recorded);
+  img = fpi_assemble_lines_store (&assembling_ctx, self->rows);
 
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+  fpi_frame_store_clear (self->rows);
+  self->lastline = NULL;
 
   fp_dbg ("Image captured, committing");
 
@@ -799,6 +774,7 @@ dev_open (FpImageDevice *dev)
 
   self = FPI_DEVICE_VFS5011 (dev);
   self->capture_buffer = g_new0 (unsigned char, CAPTURE_LINES * VFS5011_LINE_SIZE);
+  self->rows = fpi_frame_store_new (VFS5011_LINE_SIZE, MAXLINES);
 
   if (!g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error))
     {
@@ -820,7 +796,7 @@ dev_close (FpImageDevice *dev)
                                   0, 0, &error);
 
   g_free (self->capture_buffer);
-  g_slist_free_full (g_steal_pointer (&self->rows), g_free);
+  g_clear_pointer (&self->rows, fpi_frame_store_free);
 
   fpi_image_device_close_complete (dev, error);
 }
@@ -772,8 +772,8 @@ capture_complete (FpiSsm *ssm, FpDevice *_dev, GError *error)
   if (!self->deactivating && !error)
     {
       FpImage *img;
-      img = fp_image_new (2 * VFS7552_IMAGE_WIDTH,
-                          2 * VFS7552_IMAGE_HEIGHT);
+      img = fpi_image_device_new_image (dev, 2 * VFS7552_IMAGE_WIDTH,
+                                        2 * VFS7552_IMAGE_HEIGHT);
       // Scale the image
       for (int j = 0; j < VFS7552_IMAGE_HEIGHT; j++)
         {
@@ -77,8 +77,8 @@ struct _FpDeviceVirtualDevice
 
   GHashTable               *prints_storage;
 
-  guint                     wait_command_id;
-  guint                     sleep_timeout_id;
+  GSource                  *wait_command_timeout;
+  GSource                  *sleep_timeout;
   guint                     enroll_stages_passed;
   gboolean                  match_reported;
   gboolean                  supports_cancellation;
@@ -28,6 +28,7 @@
 #include "fpi-image.h"
 #include "fpi-log.h"
 #include "fpi-print.h"
+#include "fpi-regmap.h"
 #include "fpi-usb-transfer.h"
 #include "fpi-spi-transfer.h"
 #include "fpi-ssm.h"
@@ -43,6 +43,17 @@
  * that may be hotplugged at runtime.
  */
 
+/* Number of devices that are probed at the same time */
+#define MAX_PARALLEL_PROBES 4
+
+#define USB_ID_KEY(vid, pid) GUINT_TO_POINTER (((guint) (vid) << 16) | (pid))
+
+typedef struct
+{
+  GType            driver;
+  const FpIdEntry *entry;
+} FpContextDriverEntry;
+
 typedef struct
 {
   GUsbContext  *usb_ctx;
@@ -52,8 +63,16 @@ typedef struct
 
   gint          pending_devices;
   gboolean      enumerated;
+  gint64        enumerate_start;
+  gint64        enumerate_time;
+
+  GQueue       *probe_queue;
+  guint         probes_running;
 
   GArray       *drivers;
+  GHashTable   *usb_entries;
+  GArray       *virtual_entries;
+  GArray       *udev_entries;
   GPtrArray    *devices;
 } FpContextPrivate;
 
@@ -166,22 +185,37 @@ device_removed_cb (FpContext *context, FpDevice *device)
     }
 }
 
+typedef struct
+{
+  FpContext *context;
+  gint64     start;
+} ProbeData;
+
+static void probe_next_devices (FpContext *context);
+
 static void
 async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
   g_autoptr(GError) error = NULL;
-  FpDevice *device;
+  g_autoptr(FpDevice) device = FP_DEVICE (source_object);
+  g_autofree ProbeData *data = user_data;
   FpContext *context;
   FpContextPrivate *priv;
 
-  device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (source_object),
-                                                   res, &error));
+  g_async_initable_init_finish (G_ASYNC_INITABLE (source_object), res, &error);
   if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     return;
 
-  context = FP_CONTEXT (user_data);
+  context = data->context;
   priv = fp_context_get_instance_private (context);
   priv->pending_devices--;
+  priv->probes_running--;
+
+  g_debug ("Probing %s took %" G_GINT64_FORMAT " ms",
+           fp_device_get_driver (device),
+           (g_get_monotonic_time () - data->start) / 1000);
+
+  probe_next_devices (context);
 
   if (error)
     {
@@ -189,7 +223,7 @@ async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer u
       return;
     }
 
-  g_ptr_array_add (priv->devices, device);
+  g_ptr_array_add (priv->devices, g_object_ref (device));
 
   g_signal_connect_object (device, "removed",
                            (GCallback) device_removed_cb,
@@ -199,64 +233,91 @@ async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer u
   g_signal_emit (context, signals[DEVICE_ADDED_SIGNAL], 0, device);
 }
 
+static void
+probe_next_devices (FpContext *context)
+{
+  FpContextPrivate *priv = fp_context_get_instance_private (context);
+
+  while (priv->probes_running < MAX_PARALLEL_PROBES &&
+         !g_queue_is_empty (priv->probe_queue))
+    {
+      FpDevice *device = g_queue_pop_head (priv->probe_queue);
+      ProbeData *data;
+
+      data = g_new0 (ProbeData, 1);
+      data->context = context;
+      data->start = g_get_monotonic_time ();
+
+      priv->probes_running++;
+      g_async_initable_init_async (G_ASYNC_INITABLE (device),
+                                   G_PRIORITY_LOW,
+                                   priv->cancellable,
+                                   async_device_init_done_cb,
+                                   data);
+    }
+}
+
+/* Queues the device for probing, at most MAX_PARALLEL_PROBES devices are
+ * initialized at the same time. Takes ownership of @device. */
+static void
+probe_device (FpContext *context,
+              FpDevice  *device)
+{
+  FpContextPrivate *priv = fp_context_get_instance_private (context);
+
+  priv->pending_devices++;
+  g_queue_push_tail (priv->probe_queue, device);
+  probe_next_devices (context);
+}
+
 static void
 usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
 {
   FpContextPrivate *priv = fp_context_get_instance_private (self);
-  GType found_driver = G_TYPE_NONE;
-  const FpIdEntry *found_entry = NULL;
+  const FpContextDriverEntry *found = NULL;
+  GArray *entries;
   gint found_score = 0;
-  gint i;
+  guint i;
   guint16 pid, vid;
 
   pid = g_usb_device_get_pid (device);
   vid = g_usb_device_get_vid (device);
 
-  /* Find the best driver to handle this USB device. */
-  for (i = 0; i < priv->drivers->len; i++)
+  entries = g_hash_table_lookup (priv->usb_entries, USB_ID_KEY (vid, pid));
+  if (!entries)
     {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-      const FpIdEntry *entry;
-
-      if (cls->type != FP_DEVICE_TYPE_USB)
-        continue;
-
-      for (entry = cls->id_table; entry->pid; entry++)
-        {
-          gint driver_score = 50;
+      g_debug ("No driver found for USB device %04X:%04X", vid, pid);
+      return;
+    }
 
-          if (entry->pid != pid || entry->vid != vid)
-            continue;
+  /* Find the best driver to handle this USB device. */
+  for (i = 0; i < entries->len; i++)
+    {
+      const FpContextDriverEntry *candidate = &g_array_index (entries, FpContextDriverEntry, i);
+      g_autoptr(FpDeviceClass) cls = g_type_class_ref (candidate->driver);
+      gint driver_score = 50;
 
-          if (cls->usb_discover)
-            driver_score = cls->usb_discover (device);
+      if (cls->usb_discover)
+        driver_score = cls->usb_discover (device);
 
-          /* Is this driver better than the one we had? */
-          if (driver_score <= found_score)
-            continue;
+      /* Is this driver better than the one we had? */
+      if (driver_score <= found_score)
+        continue;
 
-          found_score = driver_score;
-          found_driver = driver;
-          found_entry = entry;
-        }
+      found_score = driver_score;
+      found = candidate;
     }
 
-  if (found_driver == G_TYPE_NONE)
+  if (!found)
     {
       g_debug ("No driver found for USB device %04X:%04X", vid, pid);
       return;
     }
 
-  priv->pending_devices++;
-  g_async_initable_new_async (found_driver,
-                              G_PRIORITY_LOW,
-                              priv->cancellable,
-                              async_device_init_done_cb,
-                              self,
-                              "fpi-usb-device", device,
-                              "fpi-driver-data", found_entry->driver_data,
-                              NULL);
+  probe_device (self, g_object_new (found->driver,
+                                    "fpi-usb-device", device,
+                                    "fpi-driver-data", found->entry->driver_data,
+                                    NULL));
 }
 
 static void
@@ -288,6 +349,10 @@ fp_context_finalize (GObject *object)
   g_cancellable_cancel (priv->cancellable);
   g_clear_object (&priv->cancellable);
   g_clear_pointer (&priv->drivers, g_array_unref);
+  g_clear_pointer (&priv->usb_entries, g_hash_table_unref);
+  g_clear_pointer (&priv->virtual_entries, g_array_unref);
+  g_clear_pointer (&priv->udev_entries, g_array_unref);
+  g_queue_free_full (g_steal_pointer (&priv->probe_queue), g_object_unref);
   g_clear_pointer (&priv->devices, g_ptr_array_unref);
 
   g_slist_free_full (g_steal_pointer (&priv->sources), (GDestroyNotify) g_source_destroy);
@@ -347,32 +412,88 @@ fp_context_class_init (FpContextClass *klass)
                                                  FP_TYPE_DEVICE);
 }
 
+/* Sort the generated id table by device type once, so that a USB device can
+ * be matched by looking up its VID/PID. Driver classes are only initialized
+ * once a device matches one of their entries. */
 static void
-fp_context_init (FpContext *self)
+build_driver_index (FpContext *self)
 {
-  g_autoptr(GError) error = NULL;
   FpContextPrivate *priv = fp_context_get_instance_private (self);
-  guint i;
+  const FpiDriverIdEntry *item;
+  const gchar *last_driver = NULL;
+  gboolean allowed = FALSE;
 
-  g_debug ("Initializing FpContext (libfprint version " LIBFPRINT_VERSION ")");
-
-  priv->drivers = fpi_get_driver_types ();
+  priv->usb_entries = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify) g_array_unref);
+  priv->virtual_entries = g_array_new (FALSE, FALSE, sizeof (FpContextDriverEntry));
+  priv->udev_entries = g_array_new (FALSE, FALSE, sizeof (FpContextDriverEntry));
 
-  if (get_drivers_allowlist_env ())
+  for (item = fpi_driver_id_table; item->driver; item++)
     {
-      for (i = 0; i < priv->drivers->len;)
+      FpContextDriverEntry entry;
+      GArray *entries;
+
+      /* Entries of a driver are next to each other */
+      if (g_strcmp0 (item->driver, last_driver) != 0)
         {
-          GType driver = g_array_index (priv->drivers, GType, i);
-          g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
+          last_driver = item->driver;
+          allowed = is_driver_allowed (item->driver);
+        }
+
+      if (!allowed)
+        continue;
 
-          if (!is_driver_allowed (cls->id))
-            g_array_remove_index (priv->drivers, i);
-          else
-            ++i;
+      g_assert (item->driver_index < priv->drivers->len);
+      entry.driver = g_array_index (priv->drivers, GType, item->driver_index);
+      entry.entry = &item->entry;
+
+      switch (item->type)
+        {
+        case FP_DEVICE_TYPE_USB:
+          entries = g_hash_table_lookup (priv->usb_entries,
+                                         USB_ID_KEY (item->entry.vid, item->entry.pid));
+          if (!entries)
+            {
+              entries = g_array_new (FALSE, FALSE, sizeof (FpContextDriverEntry));
+              g_hash_table_insert (priv->usb_entries,
+                                   USB_ID_KEY (item->entry.vid, item->entry.pid),
+                                   entries);
+            }
+          g_array_append_val (entries, entry);
+          break;
+
+        case FP_DEVICE_TYPE_VIRTUAL:
+          g_array_append_val (priv->virtual_entries, entry);
+          break;
+
+        case FP_DEVICE_TYPE_UDEV:
+          g_array_append_val (priv->udev_entries, entry);
+          break;
+
+        default:
+          g_assert_not_reached ();
         }
     }
 
+  g_debug ("Indexed %u USB IDs of %u drivers",
+           g_hash_table_size (priv->usb_entries), priv->drivers->len);
+}
+
+static void
+fp_context_init (FpContext *self)
+{
+  g_autoptr(GError) error = NULL;
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+
+  g_debug ("Initializing FpContext (libfprint version " LIBFPRINT_VERSION ")");
+
+  /* This only registers the types, the classes are initialized lazily */
+  priv->drivers = fpi_get_driver_types ();
+  build_driver_index (self);
+
   priv->devices = g_ptr_array_new_with_free_func (g_object_unref);
+  priv->probe_queue = g_queue_new ();
+  priv->enumerate_time = -1;
 
   priv->cancellable = g_cancellable_new ();
   priv->usb_ctx = g_usb_context_new (&error);
@@ -430,44 +551,29 @@ fp_context_enumerate (FpContext *context)
     return;
 
   priv->enumerated = TRUE;
+  priv->enumerate_start = g_get_monotonic_time ();
 
   /* USB devices are handled from callbacks */
   if (priv->usb_ctx)
     g_usb_context_enumerate (priv->usb_ctx);
 
   /* Handle Virtual devices based on environment variables */
-  for (i = 0; i < priv->drivers->len; i++)
+  for (i = 0; i < priv->virtual_entries->len; i++)
     {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-      const FpIdEntry *entry;
+      const FpContextDriverEntry *item = &g_array_index (priv->virtual_entries, FpContextDriverEntry, i);
+      const gchar *val;
 
-      if (cls->type != FP_DEVICE_TYPE_VIRTUAL)
+      val = g_getenv (item->entry->virtual_envvar);
+      if (!val || val[0] == '\0')
         continue;
 
-      for (entry = cls->id_table; entry->pid; entry++)
-        {
-          const gchar *val;
-
-          val = g_getenv (entry->virtual_envvar);
-          if (!val || val[0] == '\0')
-            continue;
-
-          g_debug ("Found virtual environment device: %s, %s", entry->virtual_envvar, val);
-          priv->pending_devices++;
-          g_async_initable_new_async (driver,
-                                      G_PRIORITY_LOW,
-                                      priv->cancellable,
-                                      async_device_init_done_cb,
-                                      context,
-                                      "fpi-environ", val,
-                                      "fpi-driver-data", entry->driver_data,
-                                      NULL);
-          g_debug ("created");
-        }
+      g_debug ("Found virtual environment device: %s, %s", item->entry->virtual_envvar, val);
+      probe_device (context, g_object_new (item->driver,
+                                           "fpi-environ", val,
+                                           "fpi-driver-data", item->entry->driver_data,
+                                           NULL));
     }
 
-
 #ifdef HAVE_UDEV
   {
     g_autoptr(GUdevClient) udev_client = g_udev_client_new (NULL);
@@ -481,76 +587,63 @@ fp_context_enumerate (FpContext *context)
     g_autoptr(GList) hidraw_devices = g_udev_client_query_by_subsystem (udev_client, "hidraw");
 
     /* for each potential driver, try to match all requested resources. */
-    for (i = 0; i < priv->drivers->len; i++)
+    for (i = 0; i < priv->udev_entries->len; i++)
       {
-        GType driver = g_array_index (priv->drivers, GType, i);
-        g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-        const FpIdEntry *entry;
-
-        if (cls->type != FP_DEVICE_TYPE_UDEV)
-          continue;
+        const FpContextDriverEntry *item = &g_array_index (priv->udev_entries, FpContextDriverEntry, i);
+        const FpIdEntry *entry = item->entry;
+        GList *matched_spidev = NULL, *matched_hidraw = NULL;
 
-        for (entry = cls->id_table; entry->udev_types; entry++)
+        if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV)
           {
-            GList *matched_spidev = NULL, *matched_hidraw = NULL;
-
-            if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV)
+            for (matched_spidev = spidev_devices; matched_spidev; matched_spidev = matched_spidev->next)
               {
-                for (matched_spidev = spidev_devices; matched_spidev; matched_spidev = matched_spidev->next)
-                  {
-                    const gchar * sysfs = g_udev_device_get_sysfs_path (matched_spidev->data);
-                    if (!sysfs)
-                      continue;
-                    if (strstr (sysfs, entry->spi_acpi_id))
-                      break;
-                  }
-                /* If match was not found exit */
-                if (matched_spidev == NULL)
+                const gchar * sysfs = g_udev_device_get_sysfs_path (matched_spidev->data);
+                if (!sysfs)
                   continue;
+                if (strstr (sysfs, entry->spi_acpi_id))
+                  break;
               }
-            if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
+            /* If match was not found exit */
+            if (matched_spidev == NULL)
+              continue;
+          }
+        if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
+          {
+            for (matched_hidraw = hidraw_devices; matched_hidraw; matched_hidraw = matched_hidraw->next)
               {
-                for (matched_hidraw = hidraw_devices; matched_hidraw; matched_hidraw = matched_hidraw->next)
-                  {
-                    /* Find the parent HID node, and check the vid/pid from its HID_ID property */
-                    g_autoptr(GUdevDevice) parent = g_udev_device_get_parent_with_subsystem (matched_hidraw->data, "hid", NULL);
-                    const gchar * hid_id = g_udev_device_get_property (parent, "HID_ID");
-                    guint32 vendor, product;
-
-                    if (!parent || !hid_id)
-                      continue;
-
-                    if (sscanf (hid_id, "%*X:%X:%X", &vendor, &product) != 2)
-                      continue;
-
-                    if (vendor == entry->hid_id.vid && product == entry->hid_id.pid)
-                      break;
-                  }
-                /* If match was not found exit */
-                if (matched_hidraw == NULL)
+                /* Find the parent HID node, and check the vid/pid from its HID_ID property */
+                g_autoptr(GUdevDevice) parent = g_udev_device_get_parent_with_subsystem (matched_hidraw->data, "hid", NULL);
+                const gchar * hid_id = g_udev_device_get_property (parent, "HID_ID");
+                guint32 vendor, product;
+
+                if (!parent || !hid_id)
                   continue;
+
+                if (sscanf (hid_id, "%*X:%X:%X", &vendor, &product) != 2)
+                  continue;
+
+                if (vendor == entry->hid_id.vid && product == entry->hid_id.pid)
+                  break;
               }
-            priv->pending_devices++;
-            g_async_initable_new_async (driver,
-                                        G_PRIORITY_LOW,
-                                        priv->cancellable,
-                                        async_device_init_done_cb,
-                                        context,
-                                        "fpi-driver-data", entry->driver_data,
-                                        "fpi-udev-data-spidev", (matched_spidev ? g_udev_device_get_device_file (matched_spidev->data) : NULL),
-                                        "fpi-udev-data-hidraw", (matched_hidraw ? g_udev_device_get_device_file (matched_hidraw->data) : NULL),
-                                        NULL);
-            /* remove entries from list to avoid conflicts */
-            if (matched_spidev)
-              {
-                g_object_unref (matched_spidev->data);
-                spidev_devices = g_list_delete_link (spidev_devices, matched_spidev);
-              }
-            if (matched_hidraw)
-              {
-                g_object_unref (matched_hidraw->data);
-                hidraw_devices = g_list_delete_link (hidraw_devices, matched_hidraw);
-              }
+            /* If match was not found exit */
+            if (matched_hidraw == NULL)
+              continue;
+          }
+        probe_device (context, g_object_new (item->driver,
+                                             "fpi-driver-data", entry->driver_data,
+                                             "fpi-udev-data-spidev", (matched_spidev ? g_udev_device_get_device_file (matched_spidev->data) : NULL),
+                                             "fpi-udev-data-hidraw", (matched_hidraw ? g_udev_device_get_device_file (matched_hidraw->data) : NULL),
+                                             NULL));
+        /* remove entries from list to avoid conflicts */
+        if (matched_spidev)
+          {
+            g_object_unref (matched_spidev->data);
+            spidev_devices = g_list_delete_link (spidev_devices, matched_spidev);
+          }
+        if (matched_hidraw)
+          {
+            g_object_unref (matched_hidraw->data);
+            hidraw_devices = g_list_delete_link (hidraw_devices, matched_hidraw);
           }
       }
 
@@ -573,6 +666,29 @@ fp_context_enumerate (FpContext *context)
   dispatched = TRUE;
   while (priv->pending_devices || dispatched)
     dispatched = g_main_context_iteration (NULL, !!priv->pending_devices);
+
+  priv->enumerate_time = g_get_monotonic_time () - priv->enumerate_start;
+  g_debug ("Enumerated %u devices in %" G_GINT64_FORMAT " ms",
+           priv->devices->len, priv->enumerate_time / 1000);
+}
+
+/**
+ * fp_context_get_enumerate_time:
+ * @context: a #FpContext
+ *
+ * Get the time fp_context_enumerate() took until all devices it found were
+ * probed and ready to be used.
+ *
+ * Returns: The time in microseconds, or -1 if no enumeration happened yet
+ */
+gint64
+fp_context_get_enumerate_time (FpContext *context)
+{
+  FpContextPrivate *priv = fp_context_get_instance_private (context);
+
+  g_return_val_if_fail (FP_IS_CONTEXT (context), -1);
+
+  return priv->enumerate_time;
 }
 
 /**
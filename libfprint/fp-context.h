@@ -49,4 +49,6 @@ void fp_context_enumerate (FpContext *context);
 
 GPtrArray *fp_context_get_devices (FpContext *context);
 
+gint64 fp_context_get_enumerate_time (FpContext *context);
+
 G_END_DECLS
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "fpi-device.h"
+#include "fpi-usb-transfer.h"
 
 /* Chosen so that if we turn on after WARM -> COLD, it takes exactly one time
  * constant to go from COLD -> HOT.
@@ -39,12 +40,21 @@
 #define DEFAULT_TEMP_HOT_SECONDS (3 * 60)
 #define DEFAULT_TEMP_COLD_SECONDS (9 * 60)
 
+/* Finger polling starts out at the minimum interval and stays there for about
+ * a second after activation or a touch. Afterwards it backs off exponentially
+ * up to the maximum interval.
+ */
+#define DEFAULT_POLL_MIN_MS 10
+#define DEFAULT_POLL_MAX_MS 250
+#define POLL_FAST_MS 1000
+
 typedef struct
 {
   FpDeviceType type;
 
-  GUsbDevice  *usb_device;
-  gchar       *virtual_env;
+  GUsbDevice         *usb_device;
+  FpiUsbTransferPool *usb_transfer_pool;
+  gchar              *virtual_env;
   struct
   {
     gchar *spidev_path;
@@ -63,7 +73,17 @@ typedef struct
   guint64         driver_data;
 
   gint            nr_enroll_stages;
-  GSList         *sources;
+
+  /* Protects all fields that are shared between the thread of the API user
+   * and the worker thread (see fp_device_set_worker_thread()) or cancellable
+   * handlers, which may run on any thread: sources, current_action,
+   * current_cancellable, current_cancellation_reason, the idle sources of
+   * the current task, finger_status, the print list cache, temp_current and
+   * the finger polling state.
+   * The other task fields are set before the driver is dispatched and only
+   * cleared once it completed the action. */
+  GMutex  lock;
+  GSList *sources;
 
   /* We always make sure that only one task is run at a time. */
   FpiDeviceAction     current_action;
@@ -80,6 +100,12 @@ typedef struct
   gboolean            wait_for_finger;
   FpFingerStatusFlags finger_status;
 
+  /* Cached result of the last list action */
+  gboolean   print_list_cache_enabled;
+  GPtrArray *print_list_cache;
+  guint      print_list_cache_hits;
+  guint      print_list_cache_misses;
+
   /* Driver critical sections */
   guint    critical_section;
   GSource *critical_section_flush_source;
@@ -99,6 +125,24 @@ typedef struct
   gint64        temp_last_update;
   gboolean      temp_last_active;
   gdouble       temp_current_ratio;
+
+  /* Optional worker thread that runs all driver code */
+  GThread      *worker_thread;
+  GMainLoop    *worker_loop;
+  GMainContext *worker_context;
+  GMainContext *worker_caller_context;
+
+  /* Finger polling scheduler state and statistics */
+  guint    poll_min_ms;
+  guint    poll_max_ms;
+  guint    poll_interval_ms;
+  guint    poll_fast_left;
+  gint64   poll_last_idle;
+  GSource *poll_pending;
+  guint    poll_count;
+  guint    poll_captures;
+  gint64   poll_delay_total;
+  gint64   poll_delay_max;
 } FpDevicePrivate;
 
 
@@ -127,6 +171,12 @@ typedef struct
 } FpMatchData;
 
 
+typedef void (*FpDeviceDispatchFunc) (FpDevice *device);
+
+GMainContext *fpi_device_get_context (FpDevice *device);
+void fpi_device_dispatch (FpDevice            *device,
+                          FpDeviceDispatchFunc func);
+
 void fpi_device_suspend (FpDevice *device);
 void fpi_device_resume (FpDevice *device);
 
@@ -134,3 +184,10 @@ void fpi_device_configure_wakeup (FpDevice *device,
                                   gboolean  enabled);
 void fpi_device_update_temp (FpDevice *device,
                              gboolean  is_active);
+
+GPtrArray *fpi_device_copy_print_list (GPtrArray *prints);
+void fpi_device_invalidate_print_list_cache (FpDevice *device);
+
+guint fpi_device_poll_next_interval (FpDevice *device);
+void fpi_device_poll_set_pending (FpDevice *device,
+                                  GSource  *source);
@@ -23,6 +23,8 @@
 
 #include "fp-device-private.h"
 
+#define USB_TRANSFER_POOL_MAX_CACHED (256 * 1024)
+
 /**
  * SECTION: fp-device
  * @title: FpDevice
@@ -92,7 +94,9 @@ fp_device_cancel_in_idle_cb (gpointer user_data)
 
   g_debug ("Idle cancelling on ongoing operation!");
 
+  g_mutex_lock (&priv->lock);
   priv->current_idle_cancel_source = NULL;
+  g_mutex_unlock (&priv->lock);
 
   if (priv->critical_section)
     priv->cancel_queued = TRUE;
@@ -112,14 +116,18 @@ fp_device_cancelled_cb (GCancellable *cancellable, FpDevice *self)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (self);
 
+  /* This may run on any thread, hold the lock so that the idle cannot be
+   * dispatched before it is stored. */
+  g_mutex_lock (&priv->lock);
   priv->current_idle_cancel_source = g_idle_source_new ();
   g_source_set_callback (priv->current_idle_cancel_source,
                          fp_device_cancel_in_idle_cb,
                          self,
                          NULL);
   g_source_attach (priv->current_idle_cancel_source,
-                   g_task_get_context (priv->current_task));
+                   fpi_device_get_context (self));
   g_source_unref (priv->current_idle_cancel_source);
+  g_mutex_unlock (&priv->lock);
 }
 
 /* Forward the external task cancellable to the internal one. */
@@ -132,13 +140,23 @@ fp_device_task_cancelled_cb (GCancellable *cancellable, FpDevice *self)
 }
 
 static void
-setup_task_cancellable (FpDevice *device)
+setup_task (FpDevice       *device,
+            FpiDeviceAction action,
+            GTask          *task)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
-  /* Create an internal cancellable and hook it up. */
+  /* Create an internal cancellable, the worker may still query the action
+   * of the previous task. */
+  g_mutex_lock (&priv->lock);
+  priv->current_action = action;
+  priv->current_task = task;
   priv->current_cancellable = g_cancellable_new ();
+  g_mutex_unlock (&priv->lock);
+
+  /* Hook it up outside of the lock, the handlers run right away if the
+   * task is already cancelled. */
   if (cls->cancel)
     {
       priv->current_cancellable_id = g_cancellable_connect (priv->current_cancellable,
@@ -158,6 +176,132 @@ setup_task_cancellable (FpDevice *device)
     }
 }
 
+static gpointer
+fp_device_worker_thread_func (gpointer user_data)
+{
+  g_autoptr(GMainLoop) loop = user_data;
+  GMainContext *context = g_main_loop_get_context (loop);
+
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (loop);
+  g_main_context_pop_thread_default (context);
+
+  return NULL;
+}
+
+static void
+fp_device_worker_start (FpDevice *self)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  g_assert (priv->worker_thread == NULL);
+
+  priv->worker_caller_context = g_main_context_ref_thread_default ();
+  priv->worker_context = g_main_context_new ();
+  priv->worker_loop = g_main_loop_new (priv->worker_context, FALSE);
+  priv->worker_thread = g_thread_new ("fprint-device",
+                                      fp_device_worker_thread_func,
+                                      g_main_loop_ref (priv->worker_loop));
+}
+
+static gboolean
+fp_device_worker_quit_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+fp_device_worker_stop (FpDevice *self)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  if (!priv->worker_thread)
+    return;
+
+  /* Quit from within the loop, so that it cannot race with the thread
+   * starting up. */
+  g_main_context_invoke_full (priv->worker_context,
+                              G_PRIORITY_DEFAULT,
+                              fp_device_worker_quit_cb,
+                              g_main_loop_ref (priv->worker_loop),
+                              (GDestroyNotify) g_main_loop_unref);
+
+  /* The last reference may be dropped by driver code on the worker. */
+  if (g_thread_self () == priv->worker_thread)
+    g_thread_unref (priv->worker_thread);
+  else
+    g_thread_join (priv->worker_thread);
+  priv->worker_thread = NULL;
+
+  g_clear_pointer (&priv->worker_loop, g_main_loop_unref);
+  g_clear_pointer (&priv->worker_context, g_main_context_unref);
+  g_clear_pointer (&priv->worker_caller_context, g_main_context_unref);
+}
+
+typedef struct
+{
+  GObject     *object;
+  guint        n_pspecs;
+  GParamSpec **pspecs;
+} FpDeviceNotifyData;
+
+static void
+fp_device_notify_data_free (FpDeviceNotifyData *data)
+{
+  for (guint i = 0; i < data->n_pspecs; i++)
+    g_param_spec_unref (data->pspecs[i]);
+  g_free (data->pspecs);
+  g_object_unref (data->object);
+  g_free (data);
+}
+
+static gboolean
+fp_device_dispatch_notify_cb (gpointer user_data)
+{
+  FpDeviceNotifyData *data = user_data;
+
+  G_OBJECT_CLASS (fp_device_parent_class)->dispatch_properties_changed (data->object,
+                                                                         data->n_pspecs,
+                                                                         data->pspecs);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Property changes made by driver code on the worker thread are emitted on
+ * the context that enabled the worker, like all other results. */
+static void
+fp_device_dispatch_properties_changed (GObject     *object,
+                                       guint        n_pspecs,
+                                       GParamSpec **pspecs)
+{
+  FpDevice *self = (FpDevice *) object;
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+  FpDeviceNotifyData *data;
+
+  if (!priv->worker_context || !g_main_context_is_owner (priv->worker_context))
+    {
+      G_OBJECT_CLASS (fp_device_parent_class)->dispatch_properties_changed (object,
+                                                                             n_pspecs,
+                                                                             pspecs);
+      return;
+    }
+
+  data = g_new0 (FpDeviceNotifyData, 1);
+  data->object = g_object_ref (object);
+  data->n_pspecs = n_pspecs;
+  data->pspecs = g_new (GParamSpec *, n_pspecs);
+  for (guint i = 0; i < n_pspecs; i++)
+    data->pspecs[i] = g_param_spec_ref (pspecs[i]);
+
+  g_main_context_invoke_full (priv->worker_caller_context,
+                              G_PRIORITY_DEFAULT,
+                              fp_device_dispatch_notify_cb,
+                              data,
+                              (GDestroyNotify) fp_device_notify_data_free);
+}
+
 static void
 fp_device_constructed (GObject *object)
 {
@@ -193,6 +337,11 @@ fp_device_constructed (GObject *object)
       priv->temp_cold_seconds = -1;
     }
 
+  priv->poll_min_ms = cls->poll_min_ms ? cls->poll_min_ms : DEFAULT_POLL_MIN_MS;
+  priv->poll_max_ms = cls->poll_max_ms ? cls->poll_max_ms : DEFAULT_POLL_MAX_MS;
+  priv->poll_max_ms = MAX (priv->poll_max_ms, priv->poll_min_ms);
+  fpi_device_poll_reset (self);
+
   /* Start out at not completely cold (i.e. assume we are only at the upper
    * bound of COLD).
    * To be fair, the warm-up from 0 to WARM should be really short either way.
@@ -220,6 +369,8 @@ fp_device_finalize (GObject *object)
     g_warning ("User destroyed open device! Not cleaning up properly!");
 
   g_clear_pointer (&priv->temp_timeout, g_source_destroy);
+  g_clear_pointer (&priv->poll_pending, g_source_unref);
+  g_clear_pointer (&priv->print_list_cache, g_ptr_array_unref);
 
   g_slist_free_full (priv->sources, (GDestroyNotify) g_source_destroy);
 
@@ -227,14 +378,19 @@ fp_device_finalize (GObject *object)
   g_clear_pointer (&priv->current_task_idle_return_source, g_source_destroy);
   g_clear_pointer (&priv->critical_section_flush_source, g_source_destroy);
 
+  fp_device_worker_stop (self);
+
   g_clear_pointer (&priv->device_id, g_free);
   g_clear_pointer (&priv->device_name, g_free);
 
   g_clear_object (&priv->usb_device);
+  g_clear_pointer (&priv->usb_transfer_pool, fpi_usb_transfer_pool_unref);
   g_clear_pointer (&priv->virtual_env, g_free);
   g_clear_pointer (&priv->udev_data.spidev_path, g_free);
   g_clear_pointer (&priv->udev_data.hidraw_path, g_free);
 
+  g_mutex_clear (&priv->lock);
+
   G_OBJECT_CLASS (fp_device_parent_class)->finalize (object);
 }
 
@@ -259,11 +415,11 @@ fp_device_get_property (GObject    *object,
       break;
 
     case PROP_FINGER_STATUS:
-      g_value_set_flags (value, priv->finger_status);
+      g_value_set_flags (value, fp_device_get_finger_status (self));
       break;
 
     case PROP_TEMPERATURE:
-      g_value_set_enum (value, priv->temp_current);
+      g_value_set_enum (value, fp_device_get_temperature (self));
       break;
 
     case PROP_DRIVER:
@@ -396,9 +552,7 @@ fp_device_async_initable_init_async (GAsyncInitable     *initable,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  priv->current_action = FPI_DEVICE_ACTION_PROBE;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (self);
+  setup_task (self, FPI_DEVICE_ACTION_PROBE, g_steal_pointer (&task));
 
   /* We push this into an idle handler for compatibility with libgusb
    * 0.3.7 and before.
@@ -432,6 +586,7 @@ fp_device_class_init (FpDeviceClass *klass)
   object_class->finalize = fp_device_finalize;
   object_class->get_property = fp_device_get_property;
   object_class->set_property = fp_device_set_property;
+  object_class->dispatch_properties_changed = fp_device_dispatch_properties_changed;
 
   properties[PROP_NR_ENROLL_STAGES] =
     g_param_spec_uint ("nr-enroll-stages",
@@ -600,6 +755,10 @@ fp_device_class_init (FpDeviceClass *klass)
 static void
 fp_device_init (FpDevice *self)
 {
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  priv->usb_transfer_pool = fpi_usb_transfer_pool_new (USB_TRANSFER_POOL_MAX_CACHED);
+  g_mutex_init (&priv->lock);
 }
 
 /**
@@ -696,10 +855,15 @@ FpFingerStatusFlags
 fp_device_get_finger_status (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpFingerStatusFlags finger_status;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), FP_FINGER_STATUS_NONE);
 
-  return priv->finger_status;
+  g_mutex_lock (&priv->lock);
+  finger_status = priv->finger_status;
+  g_mutex_unlock (&priv->lock);
+
+  return finger_status;
 }
 
 /**
@@ -733,10 +897,15 @@ FpTemperature
 fp_device_get_temperature (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpTemperature temperature;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), -1);
 
-  return priv->temp_current;
+  g_mutex_lock (&priv->lock);
+  temperature = priv->temp_current;
+  g_mutex_unlock (&priv->lock);
+
+  return temperature;
 }
 
 /**
@@ -858,12 +1027,10 @@ fp_device_open (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_OPEN;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_OPEN, g_steal_pointer (&task));
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
 
-  FP_DEVICE_GET_CLASS (device)->open (device);
+  fpi_device_dispatch (device, FP_DEVICE_GET_CLASS (device)->open);
 }
 
 /**
@@ -923,11 +1090,9 @@ fp_device_close (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CLOSE;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_CLOSE, g_steal_pointer (&task));
 
-  FP_DEVICE_GET_CLASS (device)->close (device);
+  fpi_device_dispatch (device, FP_DEVICE_GET_CLASS (device)->close);
 }
 
 /**
@@ -999,7 +1164,7 @@ fp_device_suspend (FpDevice           *device,
 
   priv->suspend_resume_task = g_steal_pointer (&task);
 
-  fpi_device_suspend (device);
+  fpi_device_dispatch (device, fpi_device_suspend);
 }
 
 /**
@@ -1064,7 +1229,7 @@ fp_device_resume (FpDevice           *device,
 
   priv->suspend_resume_task = g_steal_pointer (&task);
 
-  fpi_device_resume (device);
+  fpi_device_dispatch (device, fpi_device_resume);
 }
 
 /**
@@ -1182,16 +1347,14 @@ fp_device_enroll (FpDevice           *device,
     }
 
   fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  if (fp_device_get_temperature (device) == FP_TEMPERATURE_HOT)
     {
       g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
       fpi_device_update_temp (device, FALSE);
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_ENROLL;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_ENROLL, g_steal_pointer (&task));
 
   data = g_new0 (FpEnrollData, 1);
   data->print = g_object_ref_sink (template_print);
@@ -1202,7 +1365,7 @@ fp_device_enroll (FpDevice           *device,
   // Attach the progress data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) enroll_data_free);
 
-  FP_DEVICE_GET_CLASS (device)->enroll (device);
+  fpi_device_dispatch (device, FP_DEVICE_GET_CLASS (device)->enroll);
 }
 
 /**
@@ -1300,16 +1463,14 @@ fp_device_verify (FpDevice           *device,
     }
 
   fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  if (fp_device_get_temperature (device) == FP_TEMPERATURE_HOT)
     {
       g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
       fpi_device_update_temp (device, FALSE);
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_VERIFY;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_VERIFY, g_steal_pointer (&task));
 
   data = g_new0 (FpMatchData, 1);
   data->enrolled_print = g_object_ref (enrolled_print);
@@ -1320,7 +1481,7 @@ fp_device_verify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->verify (device);
+  fpi_device_dispatch (device, cls->verify);
 }
 
 /**
@@ -1435,16 +1596,14 @@ fp_device_identify (FpDevice           *device,
     }
 
   fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  if (fp_device_get_temperature (device) == FP_TEMPERATURE_HOT)
     {
       g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
       fpi_device_update_temp (device, FALSE);
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_IDENTIFY;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_IDENTIFY, g_steal_pointer (&task));
 
   data = g_new0 (FpMatchData, 1);
   /* We cannot store the gallery directly, because the ptr array may not own
@@ -1461,7 +1620,7 @@ fp_device_identify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->identify (device);
+  fpi_device_dispatch (device, cls->identify);
 }
 
 /**
@@ -1560,20 +1719,18 @@ fp_device_capture (FpDevice           *device,
     }
 
   fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  if (fp_device_get_temperature (device) == FP_TEMPERATURE_HOT)
     {
       g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
       fpi_device_update_temp (device, FALSE);
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CAPTURE;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_CAPTURE, g_steal_pointer (&task));
 
   priv->wait_for_finger = wait_for_finger;
 
-  cls->capture (device);
+  fpi_device_dispatch (device, cls->capture);
 }
 
 /**
@@ -1649,15 +1806,13 @@ fp_device_delete_print (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_DELETE;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_DELETE, g_steal_pointer (&task));
 
   g_task_set_task_data (priv->current_task,
                         g_object_ref (enrolled_print),
                         g_object_unref);
 
-  cls->delete (device);
+  fpi_device_dispatch (device, cls->delete);
 }
 
 /**
@@ -1728,11 +1883,30 @@ fp_device_list_prints (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_LIST;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  g_mutex_lock (&priv->lock);
+  if (priv->print_list_cache_enabled)
+    {
+      if (priv->print_list_cache)
+        {
+          g_autoptr(GPtrArray) prints = fpi_device_copy_print_list (priv->print_list_cache);
+
+          priv->print_list_cache_hits += 1;
+          g_mutex_unlock (&priv->lock);
+
+          g_debug ("Returning cached list of %u prints", prints->len);
+          g_task_return_pointer (task,
+                                 g_steal_pointer (&prints),
+                                 (GDestroyNotify) g_ptr_array_unref);
+          return;
+        }
+
+      priv->print_list_cache_misses += 1;
+    }
+  g_mutex_unlock (&priv->lock);
+
+  setup_task (device, FPI_DEVICE_ACTION_LIST, g_steal_pointer (&task));
 
-  cls->list (device);
+  fpi_device_dispatch (device, cls->list);
 }
 
 /**
@@ -1813,11 +1987,9 @@ fp_device_clear_storage (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CLEAR_STORAGE;
-  priv->current_task = g_steal_pointer (&task);
-  setup_task_cancellable (device);
+  setup_task (device, FPI_DEVICE_ACTION_CLEAR_STORAGE, g_steal_pointer (&task));
 
-  cls->clear_storage (device);
+  fpi_device_dispatch (device, cls->clear_storage);
 
   return;
 }
@@ -2208,6 +2380,95 @@ fp_device_get_features (FpDevice *device)
   return priv->features;
 }
 
+/**
+ * fp_device_set_print_list_cache:
+ * @device: a #FpDevice
+ * @enabled: Whether to cache the list of stored prints
+ *
+ * Allow fp_device_list_prints() to return the result of an earlier call
+ * instead of querying the device again. The cached list is dropped when the
+ * device is opened or closed and when prints are enrolled or deleted through
+ * @device, so only enable this if nothing else modifies the storage of the
+ * device while it is open.
+ */
+void
+fp_device_set_print_list_cache (FpDevice *device,
+                                gboolean  enabled)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  g_mutex_lock (&priv->lock);
+  priv->print_list_cache_enabled = enabled;
+  g_mutex_unlock (&priv->lock);
+
+  if (!enabled)
+    fpi_device_invalidate_print_list_cache (device);
+}
+
+/**
+ * fp_device_get_print_list_cache_stats:
+ * @device: a #FpDevice
+ * @hits: (out) (optional): Number of lists returned from the cache
+ * @misses: (out) (optional): Number of lists that had to be queried
+ *
+ * Get statistics about the cache enabled with
+ * fp_device_set_print_list_cache().
+ */
+void
+fp_device_get_print_list_cache_stats (FpDevice *device,
+                                      guint    *hits,
+                                      guint    *misses)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  g_mutex_lock (&priv->lock);
+  if (hits)
+    *hits = priv->print_list_cache_hits;
+  if (misses)
+    *misses = priv->print_list_cache_misses;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * fp_device_set_worker_thread:
+ * @device: a #FpDevice
+ * @enabled: Whether to run the driver on a separate thread
+ *
+ * Run all driver code of @device, including its USB transfers and timeouts,
+ * on a dedicated thread with its own #GMainContext. This keeps the timing
+ * of the device independent of any work done on the main loop of the
+ * application, e.g. when serving multiple readers from one process.
+ *
+ * The API is still used from the thread-default main context that was
+ * active when enabling the worker: results, progress and match callbacks
+ * and property notifications are all delivered there.
+ *
+ * This can only be changed while the device is closed.
+ */
+void
+fp_device_set_worker_thread (FpDevice *device,
+                             gboolean  enabled)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (!priv->is_open);
+  g_return_if_fail (priv->current_task == NULL);
+  g_return_if_fail (priv->suspend_resume_task == NULL);
+
+  if (enabled == (priv->worker_thread != NULL))
+    return;
+
+  if (enabled)
+    fp_device_worker_start (device);
+  else
+    fp_device_worker_stop (device);
+}
+
 /**
  * fp_device_has_feature:
  * @device: a #FpDevice
@@ -230,6 +230,14 @@ FpDeviceFeature     fp_device_get_features (FpDevice *device);
 gboolean            fp_device_has_feature (FpDevice       *device,
                                            FpDeviceFeature feature);
 
+void fp_device_set_print_list_cache (FpDevice *device,
+                                     gboolean  enabled);
+void fp_device_get_print_list_cache_stats (FpDevice *device,
+                                           guint    *hits,
+                                           guint    *misses);
+void fp_device_set_worker_thread (FpDevice *device,
+                                  gboolean  enabled);
+
 /* Opening the device */
 void fp_device_open (FpDevice           *device,
                      GCancellable       *cancellable,
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include "fpi-image.h"
 #include "fpi-image-device.h"
 
 #define IMG_ENROLL_STAGES 5
@@ -37,6 +38,8 @@ typedef struct
   FpImage            *capture_image;
 
   gint                bz3_threshold;
+
+  FpiImagePool       *image_pool;
 } FpImageDevicePrivate;
 
 
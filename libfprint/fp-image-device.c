@@ -23,6 +23,7 @@
 #include "fp-image-device-private.h"
 
 #define BOZORTH3_DEFAULT_THRESHOLD 40
+#define IMAGE_POOL_MAX_CACHED (4 * 1024 * 1024)
 
 /**
  * SECTION: fp-image-device
@@ -151,6 +152,8 @@ fp_image_device_finalize (GObject *object)
 
   g_assert (priv->active == FALSE);
 
+  g_clear_pointer (&priv->image_pool, fpi_image_pool_unref);
+
   G_OBJECT_CLASS (fp_image_device_parent_class)->finalize (object);
 }
 
@@ -268,4 +271,7 @@ fp_image_device_class_init (FpImageDeviceClass *klass)
 static void
 fp_image_device_init (FpImageDevice *self)
 {
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  priv->image_pool = fpi_image_pool_new (IMAGE_POOL_MAX_CACHED);
 }
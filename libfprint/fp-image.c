@@ -61,9 +61,12 @@ fp_image_finalize (GObject *object)
 {
   FpImage *self = (FpImage *) object;
 
-  g_clear_pointer (&self->data, g_free);
-  g_clear_pointer (&self->binarized, g_free);
+  fpi_image_pool_release (self->pool, g_steal_pointer (&self->data),
+                          self->data_size);
+  fpi_image_pool_release (self->pool, g_steal_pointer (&self->binarized),
+                          self->binarized_size);
   g_clear_pointer (&self->minutiae, g_ptr_array_unref);
+  g_clear_pointer (&self->pool, fpi_image_pool_unref);
 
   G_OBJECT_CLASS (fp_image_parent_class)->finalize (object);
 }
@@ -162,9 +165,7 @@ typedef struct
 {
   struct fp_minutiae *minutiae;
   guchar             *binarized;
-  FpiImageFlags       flags;
-  unsigned char      *image;
-  gboolean            image_changed;
+  gsize               binarized_size;
 } DetectMinutiaeNbisData;
 
 static void
@@ -172,10 +173,6 @@ fp_image_detect_minutiae_free (DetectMinutiaeNbisData *data)
 {
   g_clear_pointer (&data->minutiae, free_minutiae);
   g_clear_pointer (&data->binarized, g_free);
-
-  if (data->image_changed)
-    g_clear_pointer (&data->image, g_free);
-
   g_free (data);
 }
 
@@ -193,16 +190,10 @@ fp_image_detect_minutiae_nbis_finish (FpImage *self,
 
   if (data != NULL)
     {
-      self->flags = data->flags;
-
-      if (data->image_changed)
-        {
-          g_clear_pointer (&self->data, g_free);
-          self->data = g_steal_pointer (&data->image);
-        }
-
-      g_clear_pointer (&self->binarized, g_free);
+      fpi_image_pool_release (self->pool, g_steal_pointer (&self->binarized),
+                              self->binarized_size);
       self->binarized = g_steal_pointer (&data->binarized);
+      self->binarized_size = data->binarized_size;
 
       g_clear_pointer (&self->minutiae, g_ptr_array_unref);
       self->minutiae = g_ptr_array_new_full (data->minutiae->num,
@@ -221,53 +212,95 @@ fp_image_detect_minutiae_nbis_finish (FpImage *self,
   return FALSE;
 }
 
-static void
-vflip (guint8 *data, gint width, gint height)
+static inline void
+normalize_row_pair (guint8  *top,
+                    guint8  *bottom,
+                    gint     width,
+                    gboolean hflip,
+                    guint8   xor_mask)
 {
-  int data_len = width * height;
-  unsigned char rowbuf[width];
-  int i;
+  gint j;
 
-  for (i = 0; i < height / 2; i++)
+  /* Rows are distinct, so every byte is read exactly once before it is
+   * overwritten. */
+  if (hflip)
     {
-      int offset = i * width;
-      int swap_offset = data_len - (width * (i + 1));
-
-      /* copy top row into buffer */
-      memcpy (rowbuf, data + offset, width);
+      for (j = 0; j < width; j++)
+        {
+          guint8 tmp = top[j];
 
-      /* copy lower row over upper row */
-      memcpy (data + offset, data + swap_offset, width);
+          top[j] = bottom[width - j - 1] ^ xor_mask;
+          bottom[width - j - 1] = tmp ^ xor_mask;
+        }
+    }
+  else
+    {
+      for (j = 0; j < width; j++)
+        {
+          guint8 tmp = top[j];
 
-      /* copy buffer over lower row */
-      memcpy (data + swap_offset, rowbuf, width);
+          top[j] = bottom[j] ^ xor_mask;
+          bottom[j] = tmp ^ xor_mask;
+        }
     }
 }
 
-static void
-hflip (guint8 *data, gint width, gint height)
+static inline void
+normalize_row (guint8  *row,
+               gint     width,
+               gboolean hflip,
+               guint8   xor_mask)
 {
-  unsigned char rowbuf[width];
-  int i, j;
+  gint j;
 
-  for (i = 0; i < height; i++)
+  if (hflip)
     {
-      int offset = i * width;
+      for (j = 0; j < width / 2; j++)
+        {
+          guint8 tmp = row[j];
 
-      memcpy (rowbuf, data + offset, width);
+          row[j] = row[width - j - 1] ^ xor_mask;
+          row[width - j - 1] = tmp ^ xor_mask;
+        }
+
+      if (width % 2)
+        row[width / 2] ^= xor_mask;
+    }
+  else if (xor_mask)
+    {
       for (j = 0; j < width; j++)
-        data[offset + j] = rowbuf[width - j - 1];
+        row[j] ^= xor_mask;
     }
 }
 
+/* Applies flipping and color inversion in a single in-place pass, so that
+ * no temporary row buffer or copy of the image is needed. Inverting is
+ * done with a XOR, as 0xff - x == 0xff ^ x for bytes. */
 static void
-invert_colors (guint8 *data, gint width, gint height)
+normalize_image (guint8       *data,
+                 gint          width,
+                 gint          height,
+                 FpiImageFlags flags)
 {
-  int data_len = width * height;
-  int i;
+  gboolean hflip = !!(flags & FPI_IMAGE_H_FLIPPED);
+  guint8 xor_mask = (flags & FPI_IMAGE_COLORS_INVERTED) ? 0xff : 0x00;
+  gint i;
 
-  for (i = 0; i < data_len; i++)
-    data[i] = 0xff - data[i];
+  if (flags & FPI_IMAGE_V_FLIPPED)
+    {
+      for (i = 0; i < height / 2; i++)
+        normalize_row_pair (data + i * width,
+                            data + (height - i - 1) * width,
+                            width, hflip, xor_mask);
+
+      if (height % 2)
+        normalize_row (data + (height / 2) * width, width, hflip, xor_mask);
+    }
+  else
+    {
+      for (i = 0; i < height; i++)
+        normalize_row (data + i * width, width, hflip, xor_mask);
+    }
 }
 
 static void
@@ -286,43 +319,22 @@ fp_image_detect_minutiae_nbis_thread_func (GTask        *task,
   g_autofree gint *quality_map = NULL;
   g_autofree LFSPARMS *lfsparms = NULL;
   FpImage *self = source_object;
-  FpiImageFlags minutiae_flags;
-  unsigned char *image;
   gint map_w, map_h;
   gint bw, bh, bd;
   gint r;
 
-  image = self->data;
-  minutiae_flags = self->flags & ~(FPI_IMAGE_H_FLIPPED |
-                                   FPI_IMAGE_V_FLIPPED |
-                                   FPI_IMAGE_COLORS_INVERTED);
-
-  if (minutiae_flags != FPI_IMAGE_NONE)
-    image = g_memdup2 (self->data, self->width * self->height);
-
   ret_data = g_new0 (DetectMinutiaeNbisData, 1);
-  ret_data->flags = minutiae_flags;
-  ret_data->image = image;
-  ret_data->image_changed = image != self->data;
-
-  /* Normalize the image first */
-  if (self->flags & FPI_IMAGE_H_FLIPPED)
-    hflip (image, self->width, self->height);
-
-  if (self->flags & FPI_IMAGE_V_FLIPPED)
-    vflip (image, self->width, self->height);
-
-  if (self->flags & FPI_IMAGE_COLORS_INVERTED)
-    invert_colors (image, self->width, self->height);
 
+  /* The image has already been normalized in place before the thread was
+   * started, so it is only read from here on. */
   lfsparms = g_memdup2 (&g_lfsparms_V2, sizeof (LFSPARMS));
-  lfsparms->remove_perimeter_pts = minutiae_flags & FPI_IMAGE_PARTIAL ? TRUE : FALSE;
+  lfsparms->remove_perimeter_pts = self->flags & FPI_IMAGE_PARTIAL ? TRUE : FALSE;
 
   timer = g_timer_new ();
   r = get_minutiae (&ret_data->minutiae, &quality_map, &direction_map,
                     &low_contrast_map, &low_flow_map, &high_curve_map,
                     &map_w, &map_h, &ret_data->binarized, &bw, &bh, &bd,
-                    image, self->width, self->height, 8,
+                    self->data, self->width, self->height, 8,
                     self->ppmm, lfsparms);
   g_timer_stop (timer);
   fp_dbg ("Minutiae scan completed in %f secs", g_timer_elapsed (timer, NULL));
@@ -339,6 +351,8 @@ fp_image_detect_minutiae_nbis_thread_func (GTask        *task,
       return;
     }
 
+  ret_data->binarized_size = (gsize) bw * bh;
+
   if (!ret_data->minutiae || ret_data->minutiae->num == 0)
     {
       g_task_return_new_error (thread_task, G_IO_ERROR, G_IO_ERROR_FAILED,
@@ -480,6 +494,17 @@ fp_image_detect_minutiae (FpImage            *self,
       return;
     }
 
+  /* Normalize the image first, this is a single cheap in-place pass */
+  if (self->flags & (FPI_IMAGE_H_FLIPPED |
+                     FPI_IMAGE_V_FLIPPED |
+                     FPI_IMAGE_COLORS_INVERTED))
+    {
+      normalize_image (self->data, self->width, self->height, self->flags);
+      self->flags &= ~(FPI_IMAGE_H_FLIPPED |
+                       FPI_IMAGE_V_FLIPPED |
+                       FPI_IMAGE_COLORS_INVERTED);
+    }
+
   g_task_run_in_thread (g_steal_pointer (&task),
                         fp_image_detect_minutiae_nbis_thread_func);
 }
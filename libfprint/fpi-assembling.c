@@ -25,6 +25,9 @@
 #include "fpi-image.h"
 
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "fpi-assembling.h"
 
@@ -39,15 +42,241 @@
  * data in small stripes.
  */
 
+struct _FpiFrameStore
+{
+  guint8 *data;
+  gsize   item_size;
+  guint   n_items;
+  guint   n_allocated;
+};
+
+/**
+ * fpi_frame_store_new:
+ * @item_size: The size of each item in bytes
+ * @n_reserved: The number of items to allocate memory for right away
+ *
+ * Creates a new #FpiFrameStore. The store keeps all items in one block of
+ * memory, so that adding an item does not need a separate allocation and
+ * adjacent items are adjacent in memory. Drivers should reserve space for
+ * the maximum number of frames or lines of a capture, the store grows if
+ * more items are appended.
+ *
+ * Returns: (transfer full): A new #FpiFrameStore
+ */
+FpiFrameStore *
+fpi_frame_store_new (gsize item_size,
+                     guint n_reserved)
+{
+  FpiFrameStore *self;
+
+  g_return_val_if_fail (item_size > 0, NULL);
+
+  self = g_new0 (FpiFrameStore, 1);
+  self->item_size = item_size;
+  self->n_allocated = MAX (n_reserved, 1);
+  self->data = g_malloc_n (self->n_allocated, item_size);
+
+  return self;
+}
+
+/**
+ * fpi_frame_store_free:
+ * @self: A #FpiFrameStore
+ *
+ * Frees the store including all items.
+ */
+void
+fpi_frame_store_free (FpiFrameStore *self)
+{
+  if (!self)
+    return;
+
+  g_free (self->data);
+  g_free (self);
+}
+
+/**
+ * fpi_frame_store_clear:
+ * @self: A #FpiFrameStore
+ *
+ * Removes all items from the store. The memory is kept for reuse.
+ */
+void
+fpi_frame_store_clear (FpiFrameStore *self)
+{
+  g_return_if_fail (self != NULL);
+
+  self->n_items = 0;
+}
+
+/**
+ * fpi_frame_store_append:
+ * @self: A #FpiFrameStore
+ *
+ * Appends a new item to the end of the store. The memory of the item is
+ * zero-filled, so for #fpi_frame items @delta_x and @delta_y are 0.
+ *
+ * Note that pointers to items returned earlier become invalid if the
+ * store needs to grow.
+ *
+ * Returns: (transfer none): The new item
+ */
+gpointer
+fpi_frame_store_append (FpiFrameStore *self)
+{
+  guint8 *item;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (self->n_items == self->n_allocated)
+    {
+      self->n_allocated *= 2;
+      self->data = g_realloc_n (self->data, self->n_allocated, self->item_size);
+    }
+
+  item = self->data + self->n_items * self->item_size;
+  memset (item, 0, self->item_size);
+  self->n_items++;
+
+  return item;
+}
+
+/**
+ * fpi_frame_store_get:
+ * @self: A #FpiFrameStore
+ * @index: The index of the item
+ *
+ * Returns: (transfer none): The item at @index
+ */
+gpointer
+fpi_frame_store_get (FpiFrameStore *self,
+                     guint          index)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (index < self->n_items, NULL);
+
+  return self->data + index * self->item_size;
+}
+
+/**
+ * fpi_frame_store_get_n_items:
+ * @self: A #FpiFrameStore
+ *
+ * Returns: The number of items in the store
+ */
+guint
+fpi_frame_store_get_n_items (FpiFrameStore *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->n_items;
+}
+
+/* Returns the frame @data of any format but %FPI_FRAME_FORMAT_CALLBACK as
+ * tightly packed 8 bit pixels, either @data itself or @buf after unpacking
+ * it into it. */
+static const guint8 *
+unpack_pixels (struct fpi_frame_asmbl_ctx *ctx,
+               const guint8               *data,
+               guint8                     *buf)
+{
+  unsigned int width = ctx->frame_width;
+  unsigned int height = ctx->frame_height;
+  unsigned int x, y, stride;
+
+  switch (ctx->format)
+    {
+    case FPI_FRAME_FORMAT_8BIT:
+      if (ctx->stride == 0 || ctx->stride == width)
+        return data;
+
+      for (y = 0; y < height; y++)
+        memcpy (buf + y * width, data + y * ctx->stride, width);
+      break;
+
+    case FPI_FRAME_FORMAT_4BIT_PACKED:
+      stride = ctx->stride ? ctx->stride : (height + 1) / 2;
+      for (x = 0; x < width; x++)
+        {
+          const guint8 *column = data + x * stride;
+
+          for (y = 0; y < height; y++)
+            {
+              guint8 v = column[y >> 1];
+
+              buf[y * width + x] = (y % 2 ? v >> 4 : v & 0xf) * 17;
+            }
+        }
+      break;
+
+    case FPI_FRAME_FORMAT_16BIT:
+      stride = ctx->stride ? ctx->stride : width * 2;
+      for (y = 0; y < height; y++)
+        {
+          const guint8 *row = data + y * stride;
+
+          for (x = 0; x < width; x++)
+            {
+              guint16 v;
+
+              memcpy (&v, row + x * 2, sizeof (v));
+              buf[y * width + x] = v >> 8;
+            }
+        }
+      break;
+
+    case FPI_FRAME_FORMAT_CALLBACK:
+    default:
+      g_assert_not_reached ();
+    }
+
+  return buf;
+}
+
+/* Returns the frame as tightly packed 8 bit pixels, either the frame data
+ * itself or @buf after unpacking the frame into it. Unpacking each frame
+ * once is much cheaper than fetching every pixel through get_pixel for
+ * every candidate offset, and the kernels below only need to deal with
+ * plain byte arrays. */
+static const guint8 *
+frame_pixels (struct fpi_frame_asmbl_ctx *ctx,
+              struct fpi_frame           *frame,
+              guint8                     *buf)
+{
+  unsigned int width = ctx->frame_width;
+  unsigned int height = ctx->frame_height;
+  unsigned int x, y;
+
+  if (ctx->format != FPI_FRAME_FORMAT_CALLBACK)
+    return unpack_pixels (ctx, frame->data, buf);
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      buf[y * width + x] = ctx->get_pixel (ctx, frame, x, y);
+
+  return buf;
+}
+
+/* Only every COARSE_ROW_STEP-th row is compared in the coarse search */
+#define COARSE_ROW_STEP 4
+
+/* Returns the normalized error, comparing only every @row_step-th row.
+ * The sum is aborted early and G_MAXUINT returned as soon as the error is
+ * known to be larger than @limit. */
 static unsigned int
 calc_error (struct fpi_frame_asmbl_ctx *ctx,
-            struct fpi_frame           *first_frame,
-            struct fpi_frame           *second_frame,
+            const guint8               *first_frame,
+            const guint8               *second_frame,
             int                         dx,
-            int                         dy)
+            int                         dy,
+            unsigned int                row_step,
+            unsigned int                limit)
 {
-  unsigned int width, height;
-  unsigned int x1, y1, x2, y2, err, i, j;
+  unsigned int width, height, rows;
+  unsigned int err, i, j;
+  const guint8 *row1, *row2;
+  guint64 frame_size = ctx->frame_height * ctx->frame_width;
+  unsigned int err_limit = G_MAXUINT;
 
   width = ctx->frame_width - (dx > 0 ? dx : -dx);
   height = ctx->frame_height - dy;
@@ -55,346 +284,1149 @@ calc_error (struct fpi_frame_asmbl_ctx *ctx,
   if (height == 0 || width == 0)
     return INT_MAX;
 
-  y1 = 0;
-  y2 = dy;
-  i = 0;
-  err = 0;
-  do
-    {
-      x1 = dx < 0 ? 0 : dx;
-      x2 = dx < 0 ? -dx : 0;
-      j = 0;
+  rows = (height + row_step - 1) / row_step;
+
+  /* The normalized error is err * frame_size / (rows * width), so it
+   * exceeds the limit once err * frame_size reaches (limit + 1) * rows *
+   * width, i.e. once err reaches err_limit. */
+  if (limit != G_MAXUINT)
+    err_limit = ((guint64) (limit + 1) * rows * width + frame_size - 1) / frame_size;
+
+  row1 = first_frame + (dx < 0 ? 0 : dx);
+  row2 = second_frame + dy * ctx->frame_width + (dx < 0 ? -dx : 0);
+  err = 0;
+
+  for (i = 0; i < height; i += row_step)
+    {
+      for (j = 0; j < width; j++)
+        err += row1[j] > row2[j] ? row1[j] - row2[j] : row2[j] - row1[j];
+
+      if (err >= err_limit)
+        return G_MAXUINT;
+
+      row1 += row_step * ctx->frame_width;
+      row2 += row_step * ctx->frame_width;
+    }
+
+  /* Normalize error, err * frame_size does not fit into 32 bit for the
+   * larger sensors. It used to wrap around there, turning a large error
+   * into an arbitrary, possibly small one. */
+  return err * frame_size / (rows * width);
+}
+
+/* This function is rather CPU-intensive. It's better to use hardware
+ * to detect movement direction when possible.
+ *
+ * The result is the same as comparing every candidate offset in full, but
+ * the search first compares a subset of the rows for every other offset
+ * to find a good candidate. The full error around that candidate serves as
+ * the initial limit for the exhaustive search, which then stops summing up
+ * the error of an offset as soon as it cannot be the best one anymore.
+ */
+static void
+find_overlap (struct fpi_frame_asmbl_ctx *ctx,
+              const guint8               *first_frame,
+              const guint8               *second_frame,
+              int                        *dx_out,
+              int                        *dy_out,
+              unsigned int               *min_error)
+{
+  int dx, dy;
+  int coarse_dx = 0, coarse_dy = 2;
+  unsigned int err, limit = G_MAXUINT;
+  unsigned int coarse_error = G_MAXUINT;
+
+  *min_error = 255 * ctx->frame_height * ctx->frame_width;
+
+  /* Coarse search on a subset of the rows and offsets */
+  for (dy = 2; dy < ctx->frame_height; dy += 2)
+    {
+      for (dx = -8; dx < 8; dx += 2)
+        {
+          err = calc_error (ctx, first_frame, second_frame,
+                            dx, dy, COARSE_ROW_STEP, G_MAXUINT);
+          if (err < coarse_error)
+            {
+              coarse_error = err;
+              coarse_dx = dx;
+              coarse_dy = dy;
+            }
+        }
+    }
+
+  /* The full error in the neighbourhood of the best coarse match is
+   * an upper bound for the minimal error */
+  for (dy = MAX (coarse_dy - 1, 2); dy <= MIN (coarse_dy + 1, (int) ctx->frame_height - 1); dy++)
+    for (dx = MAX (coarse_dx - 1, -8); dx <= MIN (coarse_dx + 1, 7); dx++)
+      limit = MIN (limit, calc_error (ctx, first_frame, second_frame,
+                                      dx, dy, 1, G_MAXUINT));
+
+  /* Seeking in horizontal and vertical dimensions,
+   * for horizontal dimension we'll check only 8 pixels
+   * in both directions. For vertical direction diff is
+   * rarely less than 2, so start with it.
+   */
+  for (dy = 2; dy < ctx->frame_height; dy++)
+    {
+      for (dx = -8; dx < 8; dx++)
+        {
+          err = calc_error (ctx, first_frame, second_frame,
+                            dx, dy, 1, MIN (limit, *min_error));
+          if (err < *min_error)
+            {
+              *min_error = err;
+              *dx_out = -dx;
+              *dy_out = dy;
+            }
+        }
+    }
+}
+
+/* Estimates the movement between two adjacent frames for both swipe
+ * directions. @deltas receives delta_x and delta_y of a forward swipe,
+ * followed by the ones of a reverse swipe. */
+static void
+estimate_frame_pair (struct fpi_frame_asmbl_ctx *ctx,
+                     const guint8               *prev_pixels,
+                     const guint8               *cur_pixels,
+                     int                        *deltas,
+                     unsigned long long         *total_error,
+                     unsigned long long         *total_rev_error)
+{
+  unsigned int min_error;
+  int dx = 0, dy = 0;
+
+  find_overlap (ctx, cur_pixels, prev_pixels,
+                &deltas[0], &deltas[1], &min_error);
+  *total_error += min_error;
+
+  find_overlap (ctx, prev_pixels, cur_pixels, &dx, &dy, &min_error);
+  deltas[2] = -dx;
+  deltas[3] = -dy;
+  *total_rev_error += min_error;
+}
+
+static gboolean
+is_forward_swipe (unsigned long long total_error,
+                  unsigned long long total_rev_error,
+                  guint              num_frames)
+{
+  int err = total_error / num_frames;
+  int rev_err = total_rev_error / num_frames;
+
+  fp_dbg ("errors: %d rev: %d", err, rev_err);
+
+  return err < rev_err;
+}
+
+/* Collects the frames of a list or store into an array, so that the
+ * routines below do not need to care where the frames come from. */
+static struct fpi_frame **
+frames_from_list (GSList *stripes,
+                  guint  *n_frames)
+{
+  struct fpi_frame **frames;
+  GSList *l;
+  guint i;
+
+  *n_frames = g_slist_length (stripes);
+  frames = g_new (struct fpi_frame *, *n_frames);
+  for (l = stripes, i = 0; l != NULL; l = l->next, i++)
+    frames[i] = l->data;
+
+  return frames;
+}
+
+static struct fpi_frame **
+frames_from_store (FpiFrameStore *stripes,
+                   guint         *n_frames)
+{
+  struct fpi_frame **frames;
+  guint i;
+
+  *n_frames = stripes->n_items;
+  frames = g_new (struct fpi_frame *, *n_frames);
+  for (i = 0; i < *n_frames; i++)
+    frames[i] = (struct fpi_frame *) (stripes->data + i * stripes->item_size);
+
+  return frames;
+}
+
+/* Frame pairs are only split across threads if each thread gets at least
+ * this many of them, for fewer pairs the overhead is not worth it. */
+#define MIN_PAIRS_PER_CHUNK 4
+
+typedef struct
+{
+  GMutex mutex;
+  GCond  cond;
+  guint  pending;
+} EstimationJob;
+
+/* A range of frame pairs, the pair (@first - 1, @first) up to and
+ * excluding (@last - 1, @last), estimated by one thread. */
+typedef struct
+{
+  EstimationJob              *job;
+  struct fpi_frame_asmbl_ctx *ctx;
+  struct fpi_frame          **frames;
+  int                        *deltas;
+  guint                       first;
+  guint                       last;
+  unsigned long long          total_error;
+  unsigned long long          total_rev_error;
+} EstimationChunk;
+
+static void
+estimate_chunk (EstimationChunk *chunk)
+{
+  struct fpi_frame_asmbl_ctx *ctx = chunk->ctx;
+  gsize frame_size = ctx->frame_width * ctx->frame_height;
+  g_autofree guint8 *buf = g_malloc (2 * frame_size);
+  guint8 *prev_buf = buf, *cur_buf = buf + frame_size;
+  const guint8 *prev_pixels;
+  guint i;
+
+  prev_pixels = frame_pixels (ctx, chunk->frames[chunk->first - 1], prev_buf);
+
+  for (i = chunk->first; i < chunk->last; i++)
+    {
+      const guint8 *cur_pixels = frame_pixels (ctx, chunk->frames[i], cur_buf);
+      guint8 *tmp;
+
+      estimate_frame_pair (ctx, prev_pixels, cur_pixels,
+                           &chunk->deltas[4 * i],
+                           &chunk->total_error, &chunk->total_rev_error);
+
+      prev_pixels = cur_pixels;
+      tmp = prev_buf;
+      prev_buf = cur_buf;
+      cur_buf = tmp;
+    }
+}
+
+static void
+estimation_worker (gpointer data,
+                   gpointer user_data)
+{
+  EstimationChunk *chunk = data;
+  EstimationJob *job = chunk->job;
+
+  estimate_chunk (chunk);
+
+  g_mutex_lock (&job->mutex);
+  if (--job->pending == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->mutex);
+}
+
+/* The pool is shared by all devices, its threads are only kept around
+ * for a short while after the last estimation. */
+static GThreadPool *
+estimation_pool (void)
+{
+  static gsize pool = 0;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *p = g_thread_pool_new (estimation_worker, NULL,
+                                          g_get_num_processors (),
+                                          FALSE, NULL);
+
+      g_once_init_leave (&pool, (gsize) p);
+    }
+
+  return (GThreadPool *) pool;
+}
+
+static void
+do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
+                        struct fpi_frame          **frames,
+                        guint                       n_frames)
+{
+  GTimer *timer;
+  EstimationJob job;
+  g_autofree EstimationChunk *chunks = NULL;
+  g_autofree int *deltas = NULL;
+  guint num_frames, n_pairs, n_chunks, i;
+  gboolean forward;
+  /* Max error is width * height * 255, for AES2501 which has the largest
+   * sensor its 192*16*255 = 783360. So for 32bit value it's ~5482 frame before
+   * we might get int overflow. Use 64bit value here to prevent integer overflow
+   */
+  unsigned long long total_error = 0, total_rev_error = 0;
+
+  timer = g_timer_new ();
+
+  /* Both swipe directions are estimated in the same pass over the frames,
+   * the deltas of the winning direction are applied at the end. */
+  deltas = g_new0 (int, 4 * n_frames);
+
+  /* Every pair of adjacent frames is independent of all the others, so
+   * the pairs are split into ranges which are estimated in parallel. The
+   * calling thread takes care of the first range itself. As the errors
+   * are integers, the sums do not depend on the order of the ranges. */
+  n_pairs = n_frames - 1;
+  n_chunks = CLAMP (n_pairs / MIN_PAIRS_PER_CHUNK, 1, g_get_num_processors ());
+  chunks = g_new0 (EstimationChunk, n_chunks);
+
+  g_mutex_init (&job.mutex);
+  g_cond_init (&job.cond);
+  job.pending = n_chunks - 1;
+
+  for (i = 0; i < n_chunks; i++)
+    {
+      chunks[i].job = &job;
+      chunks[i].ctx = ctx;
+      chunks[i].frames = frames;
+      chunks[i].deltas = deltas;
+      /* Skip the first frame */
+      chunks[i].first = 1 + (guint64) n_pairs * i / n_chunks;
+      chunks[i].last = 1 + (guint64) n_pairs * (i + 1) / n_chunks;
+
+      if (i > 0)
+        g_thread_pool_push (estimation_pool (), &chunks[i], NULL);
+    }
+
+  if (n_pairs > 0)
+    estimate_chunk (&chunks[0]);
+
+  g_mutex_lock (&job.mutex);
+  while (job.pending > 0)
+    g_cond_wait (&job.cond, &job.mutex);
+  g_mutex_unlock (&job.mutex);
+
+  g_mutex_clear (&job.mutex);
+  g_cond_clear (&job.cond);
+
+  for (i = 0; i < n_chunks; i++)
+    {
+      total_error += chunks[i].total_error;
+      total_rev_error += chunks[i].total_rev_error;
+    }
+
+  g_timer_stop (timer);
+  fp_dbg ("calc delta completed in %f secs using %u threads",
+          g_timer_elapsed (timer, NULL), n_chunks);
+  g_timer_destroy (timer);
+
+  forward = is_forward_swipe (total_error, total_rev_error, n_frames);
+
+  for (num_frames = 1; num_frames < n_frames; num_frames++)
+    {
+      struct fpi_frame *cur_stripe = frames[num_frames];
+      int *d = &deltas[4 * num_frames + (forward ? 0 : 2)];
+
+      cur_stripe->delta_x = d[0];
+      cur_stripe->delta_y = d[1];
+    }
+}
+
+/**
+ * fpi_do_movement_estimation:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @stripes: a singly-linked list of #fpi_frame
+ *
+ * fpi_do_movement_estimation() estimates the movement between adjacent
+ * frames, populating @delta_x and @delta_y values for each #fpi_frame.
+ *
+ * This function is used for devices that don't do movement estimation
+ * in hardware. If hardware movement estimation is supported, the driver
+ * should populate @delta_x and @delta_y instead.
+ */
+void
+fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
+                            GSList                     *stripes)
+{
+  g_autofree struct fpi_frame **frames = NULL;
+  guint n_frames;
+
+  g_return_if_fail (stripes != NULL);
+
+  frames = frames_from_list (stripes, &n_frames);
+  do_movement_estimation (ctx, frames, n_frames);
+}
+
+/**
+ * fpi_do_movement_estimation_store:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @stripes: a #FpiFrameStore of #fpi_frame
+ *
+ * Same as fpi_do_movement_estimation(), but for frames held in a
+ * #FpiFrameStore.
+ */
+void
+fpi_do_movement_estimation_store (struct fpi_frame_asmbl_ctx *ctx,
+                                  FpiFrameStore              *stripes)
+{
+  g_autofree struct fpi_frame **frames = NULL;
+  guint n_frames;
+
+  g_return_if_fail (stripes != NULL && stripes->n_items > 0);
+
+  frames = frames_from_store (stripes, &n_frames);
+  do_movement_estimation (ctx, frames, n_frames);
+}
+
+typedef struct
+{
+  struct fpi_frame_asmbl_ctx ctx;
+  struct fpi_frame         **frames;
+  guint                      n_frames;
+} EstimationData;
+
+static void
+estimation_data_free (EstimationData *data)
+{
+  g_free (data->frames);
+  g_free (data);
+}
+
+static void
+movement_estimation_thread_func (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
+{
+  EstimationData *data = task_data;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  do_movement_estimation (&data->ctx, data->frames, data->n_frames);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * fpi_do_movement_estimation_async:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @stripes: a singly-linked list of #fpi_frame
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: the function to call once the estimation is done
+ * @user_data: the data to pass to @callback
+ *
+ * Same as fpi_do_movement_estimation(), but the estimation is done in a
+ * separate thread, so that the main context is not blocked while comparing
+ * the frames. @callback is invoked in the thread-default main context of
+ * the caller, drivers will usually pass their #FpiSsm as @user_data and
+ * continue the state machine from there after calling
+ * fpi_do_movement_estimation_finish().
+ *
+ * @ctx is copied, but neither @stripes nor its frames may be modified or
+ * freed before @callback has been called. If @ctx uses the get_pixel
+ * accessor, it will be called from other threads.
+ */
+void
+fpi_do_movement_estimation_async (struct fpi_frame_asmbl_ctx *ctx,
+                                  GSList                     *stripes,
+                                  GCancellable               *cancellable,
+                                  GAsyncReadyCallback         callback,
+                                  gpointer                    user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  EstimationData *data;
+
+  g_return_if_fail (stripes != NULL);
+  g_return_if_fail (callback != NULL);
+
+  data = g_new0 (EstimationData, 1);
+  data->ctx = *ctx;
+  data->frames = frames_from_list (stripes, &data->n_frames);
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, fpi_do_movement_estimation_async);
+  g_task_set_task_data (task, data, (GDestroyNotify) estimation_data_free);
+
+  g_task_run_in_thread (task, movement_estimation_thread_func);
+}
+
+/**
+ * fpi_do_movement_estimation_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Finishes an estimation started with fpi_do_movement_estimation_async().
+ * On success, @delta_x and @delta_y of all frames have been populated.
+ *
+ * Returns: %TRUE on success, %FALSE if the estimation was cancelled
+ */
+gboolean
+fpi_do_movement_estimation_finish (GAsyncResult *result,
+                                   GError      **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) ==
+                        fpi_do_movement_estimation_async, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static inline void
+aes_blit_stripe (struct fpi_frame_asmbl_ctx *ctx,
+                 FpImage *img,
+                 const guint8 *pixels,
+                 int x, int y)
+{
+  unsigned int ix1, iy1;
+  unsigned int fx1, fy1;
+  unsigned int fy, iy, len;
+
+  /* Select starting point inside image and frame */
+  if (x < 0)
+    {
+      ix1 = 0;
+      fx1 = -x;
+    }
+  else
+    {
+      ix1 = x;
+      fx1 = 0;
+    }
+
+  if (y < 0)
+    {
+      iy1 = 0;
+      fy1 = -y;
+    }
+  else
+    {
+      iy1 = y;
+      fy1 = 0;
+    }
+
+  if (fx1 >= ctx->frame_width || ix1 >= img->width)
+    return;
+
+  len = MIN (ctx->frame_width - fx1, img->width - ix1);
+
+  for (fy = fy1, iy = iy1; fy < ctx->frame_height && iy < img->height; fy++, iy++)
+    memcpy (img->data + ix1 + iy * img->width,
+            pixels + fx1 + fy * ctx->frame_width,
+            len);
+}
+
+/* Creates the image for frames that moved by @height in total and returns
+ * the position of the first frame in it */
+static FpImage *
+create_assembled_image (struct fpi_frame_asmbl_ctx *ctx,
+                        int                         height,
+                        int                        *x,
+                        int                        *y)
+{
+  FpImage *img;
+  gboolean reverse = FALSE;
+
+  fp_dbg ("height is %d", height);
+
+  if (height < 0)
+    {
+      reverse = TRUE;
+      height = -height;
+    }
+
+  /* For last frame */
+  height += ctx->frame_height;
+
+  /* Create buffer big enough for max image */
+  img = fp_image_new (ctx->image_width, height);
+  img->flags = FPI_IMAGE_COLORS_INVERTED;
+  img->flags |= reverse ? 0 :  FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED;
+
+  *y = reverse ? (height - ctx->frame_height) : 0;
+  *x = ((int) ctx->image_width - (int) ctx->frame_width) / 2;
+
+  return img;
+}
+
+static FpImage *
+assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
+                 struct fpi_frame          **frames,
+                 guint                       n_frames)
+{
+  FpImage *img;
+  int height = 0;
+  int y, x;
+  guint i;
+  g_autofree guint8 *buf = NULL;
+
+  /* No offset for 1st image */
+  frames[0]->delta_x = 0;
+  frames[0]->delta_y = 0;
+  for (i = 0; i < n_frames; i++)
+    height += frames[i]->delta_y;
+
+  img = create_assembled_image (ctx, height, &x, &y);
+  buf = g_malloc (ctx->frame_width * ctx->frame_height);
+
+  /* Assemble stripes */
+  for (i = 0; i < n_frames; i++)
+    {
+      y += frames[i]->delta_y;
+      x += frames[i]->delta_x;
+
+      aes_blit_stripe (ctx, img, frame_pixels (ctx, frames[i], buf), x, y);
+    }
+
+  return img;
+}
+
+/**
+ * fpi_assemble_frames:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @stripes: linked list of #fpi_frame
+ *
+ * fpi_assemble_frames() assembles individual frames into a single image.
+ * It expects @delta_x and @delta_y of #fpi_frame to be populated.
+ *
+ * Returns: a newly allocated #fp_img.
+ */
+FpImage *
+fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
+                     GSList                     *stripes)
+{
+  g_autofree struct fpi_frame **frames = NULL;
+  guint n_frames;
+
+  g_return_val_if_fail (stripes != NULL, NULL);
+
+  frames = frames_from_list (stripes, &n_frames);
+  return assemble_frames (ctx, frames, n_frames);
+}
+
+/**
+ * fpi_assemble_frames_store:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @stripes: a #FpiFrameStore of #fpi_frame
+ *
+ * Same as fpi_assemble_frames(), but for frames held in a #FpiFrameStore.
+ *
+ * Returns: a newly allocated #fp_img.
+ */
+FpImage *
+fpi_assemble_frames_store (struct fpi_frame_asmbl_ctx *ctx,
+                           FpiFrameStore              *stripes)
+{
+  g_autofree struct fpi_frame **frames = NULL;
+  guint n_frames;
+
+  g_return_val_if_fail (stripes != NULL && stripes->n_items > 0, NULL);
+
+  frames = frames_from_store (stripes, &n_frames);
+  return assemble_frames (ctx, frames, n_frames);
+}
+
+struct _FpiFrameAssembler
+{
+  struct fpi_frame_asmbl_ctx ctx;
+  gboolean                   estimate_movement;
+
+  /* The frames as tightly packed 8 bit pixels */
+  FpiFrameStore             *pixels;
+  /* Four deltas per frame, see estimate_frame_pair() */
+  GArray                    *deltas;
+  guint                      n_frames;
+  unsigned long long         total_error;
+  unsigned long long         total_rev_error;
+};
+
+/**
+ * fpi_frame_assembler_new:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @estimate_movement: Whether to estimate the movement between frames
+ *
+ * Creates a new #FpiFrameAssembler that assembles frames while they are
+ * being captured. @ctx is copied, so it may be changed or freed afterwards.
+ *
+ * If @estimate_movement is %FALSE, the @delta_x and @delta_y values of the
+ * added frames are used, as with fpi_assemble_frames(). Otherwise the
+ * movement is estimated as with fpi_do_movement_estimation(), but for each
+ * frame as soon as it is added.
+ *
+ * Returns: (transfer full): A new #FpiFrameAssembler
+ */
+FpiFrameAssembler *
+fpi_frame_assembler_new (const struct fpi_frame_asmbl_ctx *ctx,
+                         gboolean                          estimate_movement)
+{
+  FpiFrameAssembler *self;
+
+  g_return_val_if_fail (ctx != NULL, NULL);
+  g_return_val_if_fail (ctx->frame_width > 0 && ctx->frame_height > 0, NULL);
+
+  self = g_new0 (FpiFrameAssembler, 1);
+  self->ctx = *ctx;
+  self->estimate_movement = estimate_movement;
+  self->pixels = fpi_frame_store_new (ctx->frame_width * ctx->frame_height, 64);
+  self->deltas = g_array_new (FALSE, TRUE, sizeof (int));
+
+  return self;
+}
+
+/**
+ * fpi_frame_assembler_free:
+ * @self: A #FpiFrameAssembler
+ *
+ * Frees the assembler including all frames it holds.
+ */
+void
+fpi_frame_assembler_free (FpiFrameAssembler *self)
+{
+  if (!self)
+    return;
+
+  fpi_frame_store_free (self->pixels);
+  g_array_unref (self->deltas);
+  g_free (self);
+}
+
+/**
+ * fpi_frame_assembler_reset:
+ * @self: A #FpiFrameAssembler
+ *
+ * Drops all frames added so far, e.g. when a capture is aborted.
+ */
+void
+fpi_frame_assembler_reset (FpiFrameAssembler *self)
+{
+  g_return_if_fail (self != NULL);
+
+  fpi_frame_store_clear (self->pixels);
+  g_array_set_size (self->deltas, 0);
+  self->n_frames = 0;
+  self->total_error = 0;
+  self->total_rev_error = 0;
+}
+
+/* Records the deltas of the frame just appended to the pixel store, or
+ * estimates them from its pixels */
+static void
+frame_added (FpiFrameAssembler *self,
+             const guint8      *cur_pixels,
+             int                delta_x,
+             int                delta_y)
+{
+  gsize frame_size = self->ctx.frame_width * self->ctx.frame_height;
+  int *deltas;
+
+  g_array_set_size (self->deltas, 4 * (self->n_frames + 1));
+  deltas = &g_array_index (self->deltas, int, 4 * self->n_frames);
+
+  if (!self->estimate_movement)
+    {
+      deltas[0] = delta_x;
+      deltas[1] = delta_y;
+    }
+  else if (self->n_frames > 0)
+    {
+      estimate_frame_pair (&self->ctx, cur_pixels - frame_size, cur_pixels,
+                           deltas, &self->total_error, &self->total_rev_error);
+    }
+
+  self->n_frames++;
+}
+
+/**
+ * fpi_frame_assembler_add_frame:
+ * @self: A #FpiFrameAssembler
+ * @frame: The next #fpi_frame of the swipe
+ *
+ * Adds the next frame of a swipe. The frame data is copied, so the caller
+ * keeps ownership of @frame and may reuse it right away. If the assembler
+ * estimates the movement, this is done for the new frame right away.
+ */
+void
+fpi_frame_assembler_add_frame (FpiFrameAssembler *self,
+                               struct fpi_frame  *frame)
+{
+  const guint8 *pixels;
+  guint8 *cur_pixels;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (frame != NULL);
+
+  cur_pixels = fpi_frame_store_append (self->pixels);
+  pixels = frame_pixels (&self->ctx, frame, cur_pixels);
+  if (pixels != cur_pixels)
+    memcpy (cur_pixels, pixels, self->ctx.frame_width * self->ctx.frame_height);
+
+  frame_added (self, cur_pixels, frame->delta_x, frame->delta_y);
+}
 
-      do
-        {
-          unsigned char v1, v2;
+/**
+ * fpi_frame_assembler_add_frame_data:
+ * @self: A #FpiFrameAssembler
+ * @data: The pixel data of the next frame of the swipe
+ * @delta_x: X offset of the frame
+ * @delta_y: Y offset of the frame
+ *
+ * Same as fpi_frame_assembler_add_frame(), but takes the pixel data
+ * directly, e.g. from the transfer buffer. This avoids allocating and
+ * filling a #fpi_frame for every frame. The format of @data is given by the
+ * @format of the assembling context, which must not be
+ * %FPI_FRAME_FORMAT_CALLBACK.
+ */
+void
+fpi_frame_assembler_add_frame_data (FpiFrameAssembler *self,
+                                    const guint8      *data,
+                                    int                delta_x,
+                                    int                delta_y)
+{
+  const guint8 *pixels;
+  guint8 *cur_pixels;
 
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (self->ctx.format != FPI_FRAME_FORMAT_CALLBACK);
 
-          v1 = ctx->get_pixel (ctx, first_frame, x1, y1);
-          v2 = ctx->get_pixel (ctx, second_frame, x2, y2);
-          err += v1 > v2 ? v1 - v2 : v2 - v1;
-          j++;
-          x1++;
-          x2++;
+  cur_pixels = fpi_frame_store_append (self->pixels);
+  pixels = unpack_pixels (&self->ctx, data, cur_pixels);
+  if (pixels != cur_pixels)
+    memcpy (cur_pixels, pixels, self->ctx.frame_width * self->ctx.frame_height);
 
-        }
-      while (j < width);
-      i++;
-      y1++;
-      y2++;
-    }
-  while (i < height);
+  frame_added (self, cur_pixels, delta_x, delta_y);
+}
 
-  /* Normalize error */
-  err *= (ctx->frame_height * ctx->frame_width);
-  err /= (height * width);
+/**
+ * fpi_frame_assembler_get_n_frames:
+ * @self: A #FpiFrameAssembler
+ *
+ * Returns: The number of frames added since the last reset
+ */
+guint
+fpi_frame_assembler_get_n_frames (FpiFrameAssembler *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
 
-  return err;
+  return self->n_frames;
 }
 
-/* This function is rather CPU-intensive. It's better to use hardware
- * to detect movement direction when possible.
+/**
+ * fpi_frame_assembler_finish:
+ * @self: A #FpiFrameAssembler
+ *
+ * Assembles the frames added so far into an image and resets the
+ * assembler for the next swipe. The result is the same as the one of
+ * fpi_do_movement_estimation() (if enabled) followed by
+ * fpi_assemble_frames() on all frames. As the movement has already been
+ * estimated, only the frames need to be copied into the image.
+ *
+ * Returns: (transfer full): a newly allocated #FpImage
  */
-static void
-find_overlap (struct fpi_frame_asmbl_ctx *ctx,
-              struct fpi_frame           *first_frame,
-              struct fpi_frame           *second_frame,
-              int                        *dx_out,
-              int                        *dy_out,
-              unsigned int               *min_error)
+FpImage *
+fpi_frame_assembler_finish (FpiFrameAssembler *self)
 {
-  int dx, dy;
-  unsigned int err;
+  struct fpi_frame_asmbl_ctx *ctx;
+  FpImage *img;
+  gboolean forward = TRUE;
+  int height = 0;
+  int x, y;
+  guint i;
 
-  *min_error = 255 * ctx->frame_height * ctx->frame_width;
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->n_frames > 0, NULL);
 
-  /* Seeking in horizontal and vertical dimensions,
-   * for horizontal dimension we'll check only 8 pixels
-   * in both directions. For vertical direction diff is
-   * rarely less than 2, so start with it.
-   */
-  for (dy = 2; dy < ctx->frame_height; dy++)
+  ctx = &self->ctx;
+
+  if (self->estimate_movement)
+    forward = is_forward_swipe (self->total_error, self->total_rev_error,
+                                self->n_frames);
+
+  /* No offset for 1st image */
+  for (i = 1; i < self->n_frames; i++)
+    height += g_array_index (self->deltas, int, 4 * i + (forward ? 1 : 3));
+
+  img = create_assembled_image (ctx, height, &x, &y);
+
+  for (i = 0; i < self->n_frames; i++)
     {
-      for (dx = -8; dx < 8; dx++)
+      if (i > 0)
         {
-          err = calc_error (ctx, first_frame, second_frame,
-                            dx, dy);
-          if (err < *min_error)
-            {
-              *min_error = err;
-              *dx_out = -dx;
-              *dy_out = dy;
-            }
+          int *deltas = &g_array_index (self->deltas, int, 4 * i + (forward ? 0 : 2));
+
+          x += deltas[0];
+          y += deltas[1];
         }
+
+      aes_blit_stripe (ctx, img, fpi_frame_store_get (self->pixels, i), x, y);
     }
+
+  fpi_frame_assembler_reset (self);
+
+  return img;
 }
 
-static unsigned int
-do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
-                        GSList *stripes, gboolean reverse)
+/* Replaces every value by the median of the @filtersize values around it,
+ * with the window cut off at the borders and the upper median taken for
+ * even window sizes. The values are offsets between lines, i.e. small
+ * integers, so the window is kept as a histogram that is updated while it
+ * slides along instead of sorting every window. */
+static void
+median_filter (int *data, int size, int filtersize)
 {
-  GSList *l;
-  GTimer *timer;
-  guint num_frames = 1;
-  struct fpi_frame *prev_stripe;
-  unsigned int min_error;
-  /* Max error is width * height * 255, for AES2501 which has the largest
-   * sensor its 192*16*255 = 783360. So for 32bit value it's ~5482 frame before
-   * we might get int overflow. Use 64bit value here to prevent integer overflow
-   */
-  unsigned long long total_error = 0;
+  int half = (filtersize - 1) / 2;
+  g_autofree guint *hist = NULL;
+  g_autofree int *pending = NULL;
+  int min, max;
+  int median = 0;
+  int below = 0;
+  int i;
 
-  timer = g_timer_new ();
+  if (size <= 0)
+    return;
+
+  min = max = data[0];
+  for (i = 1; i < size; i++)
+    {
+      min = MIN (min, data[i]);
+      max = MAX (max, data[i]);
+    }
 
-  /* Skip the first frame */
-  prev_stripe = stripes->data;
+  hist = g_new0 (guint, max - min + 1);
+  /* Results are written back once the value is out of the window */
+  pending = g_new (int, half + 1);
 
-  for (l = stripes->next; l != NULL; l = l->next, num_frames++)
+  for (i = 0; i <= half && i < size; i++)
+    hist[data[i] - min]++;
+
+  for (i = 0; i < size; i++)
     {
-      struct fpi_frame *cur_stripe = l->data;
+      int i1 = MAX (i - half, 0);
+      int i2 = MIN (i + half, size - 1);
+      int k = (i2 - i1 + 1) / 2;
 
-      if (reverse)
+      /* below is the number of values in the window smaller than median */
+      while (below > k)
+        {
+          median--;
+          below -= hist[median];
+        }
+      while (below + (int) hist[median] <= k)
         {
-          find_overlap (ctx, prev_stripe, cur_stripe,
-                        &cur_stripe->delta_x, &cur_stripe->delta_y,
-                        &min_error);
-          cur_stripe->delta_y = -cur_stripe->delta_y;
-          cur_stripe->delta_x = -cur_stripe->delta_x;
+          below += hist[median];
+          median++;
         }
-      else
+      pending[i % (half + 1)] = median + min;
+
+      /* Slide the window */
+      if (i - half >= 0)
         {
-          find_overlap (ctx, cur_stripe, prev_stripe,
-                        &cur_stripe->delta_x, &cur_stripe->delta_y,
-                        &min_error);
+          int v = data[i - half] - min;
+
+          hist[v]--;
+          if (v < median)
+            below--;
+          data[i - half] = pending[(i - half) % (half + 1)];
         }
-      total_error += min_error;
+      if (i + half + 1 < size)
+        {
+          int v = data[i + half + 1] - min;
 
-      prev_stripe = cur_stripe;
+          hist[v]++;
+          if (v < median)
+            below++;
+        }
     }
 
-  g_timer_stop (timer);
-  fp_dbg ("calc delta completed in %f secs", g_timer_elapsed (timer, NULL));
-  g_timer_destroy (timer);
+  for (i = MAX (size - half, 0); i < size; i++)
+    data[i] = pending[i % (half + 1)];
+}
+
+/* Sums line1[i * step] + line2[i * step] and its square, starting at
+ * pixel @start. Each value is at most 510, so 32 bit accumulators do not
+ * overflow for any sensible line width. */
+static inline void
+line_sum_sq_sum (const guint8 *line1,
+                 const guint8 *line2,
+                 unsigned int  start,
+                 unsigned int  size,
+                 unsigned int  step,
+                 guint32      *sum,
+                 guint32      *sq_sum)
+{
+  unsigned int i;
+
+  for (i = start; i < size; i++)
+    {
+      guint32 v = (guint32) line1[i * step] + (guint32) line2[i * step];
 
-  return total_error / num_frames;
+      *sum += v;
+      *sq_sum += v * v;
+    }
 }
 
-/**
- * fpi_do_movement_estimation:
- * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
- * @stripes: a singly-linked list of #fpi_frame
- *
- * fpi_do_movement_estimation() estimates the movement between adjacent
- * frames, populating @delta_x and @delta_y values for each #fpi_frame.
- *
- * This function is used for devices that don't do movement estimation
- * in hardware. If hardware movement estimation is supported, the driver
- * should populate @delta_x and @delta_y instead.
- */
-void
-fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
-                            GSList                     *stripes)
+#ifdef __SSE2__
+static inline guint32
+hsum_epi32 (__m128i v)
 {
-  int err, rev_err;
+  v = _mm_add_epi32 (v, _mm_shuffle_epi32 (v, _MM_SHUFFLE (1, 0, 3, 2)));
+  v = _mm_add_epi32 (v, _mm_shuffle_epi32 (v, _MM_SHUFFLE (2, 3, 0, 1)));
 
-  err = do_movement_estimation (ctx, stripes, FALSE);
-  rev_err = do_movement_estimation (ctx, stripes, TRUE);
-  fp_dbg ("errors: %d rev: %d", err, rev_err);
-  if (err < rev_err)
-    do_movement_estimation (ctx, stripes, FALSE);
+  return _mm_cvtsi128_si32 (v);
 }
 
-static inline void
-aes_blit_stripe (struct fpi_frame_asmbl_ctx *ctx,
-                 FpImage *img,
-                 struct fpi_frame *stripe,
-                 int x, int y)
+/* The sums of two pixels are kept in 16 bit lanes, pmaddwd squares them
+ * and adds neighbouring lanes into 32 bit. Returns the number of pixels
+ * that were handled. */
+static unsigned int
+line_sum_sq_sum_sse2 (const guint8 *line1,
+                      const guint8 *line2,
+                      unsigned int  size,
+                      unsigned int  step,
+                      guint32      *sum,
+                      guint32      *sq_sum)
 {
-  unsigned int ix1, iy1;
-  unsigned int fx1, fy1;
-  unsigned int fx, fy, ix, iy;
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i ones = _mm_set1_epi16 (1);
+  const __m128i low_bytes = _mm_set1_epi16 (0xff);
+  __m128i acc = zero, sq_acc = zero;
+  unsigned int i = 0;
 
-  /* Select starting point inside image and frame */
-  if (x < 0)
-    {
-      ix1 = 0;
-      fx1 = -x;
-    }
-  else
+  if (step == 1)
     {
-      ix1 = x;
-      fx1 = 0;
-    }
+      for (; i + 16 <= size; i += 16)
+        {
+          __m128i a = _mm_loadu_si128 ((const __m128i *) (line1 + i));
+          __m128i b = _mm_loadu_si128 ((const __m128i *) (line2 + i));
+          __m128i lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero),
+                                      _mm_unpacklo_epi8 (b, zero));
+          __m128i hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero),
+                                      _mm_unpackhi_epi8 (b, zero));
 
-  if (y < 0)
-    {
-      iy1 = 0;
-      fy1 = -y;
+          acc = _mm_add_epi32 (acc, _mm_madd_epi16 (_mm_add_epi16 (lo, hi), ones));
+          sq_acc = _mm_add_epi32 (sq_acc, _mm_madd_epi16 (lo, lo));
+          sq_acc = _mm_add_epi32 (sq_acc, _mm_madd_epi16 (hi, hi));
+        }
     }
-  else
+  else if (step == 2)
     {
-      iy1 = y;
-      fy1 = 0;
+      /* 16 bytes hold 8 pixels, the last byte is only read if there is
+       * a pixel after the block as it may be beyond the end of the line */
+      for (; i + 8 < size; i += 8)
+        {
+          __m128i a = _mm_loadu_si128 ((const __m128i *) (line1 + 2 * i));
+          __m128i b = _mm_loadu_si128 ((const __m128i *) (line2 + 2 * i));
+          __m128i v = _mm_add_epi16 (_mm_and_si128 (a, low_bytes),
+                                     _mm_and_si128 (b, low_bytes));
+
+          acc = _mm_add_epi32 (acc, _mm_madd_epi16 (v, ones));
+          sq_acc = _mm_add_epi32 (sq_acc, _mm_madd_epi16 (v, v));
+        }
     }
 
-  for (fy = fy1, iy = iy1; fy < ctx->frame_height && iy < img->height; fy++, iy++)
-    for (fx = fx1, ix = ix1; fx < ctx->frame_width && ix < img->width; fx++, ix++)
-      img->data[ix + (iy * img->width)] = ctx->get_pixel (ctx, stripe, fx, fy);
+  *sum += hsum_epi32 (acc);
+  *sq_sum += hsum_epi32 (sq_acc);
+
+  return i;
 }
+#endif
 
 /**
- * fpi_assemble_frames:
- * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
- * @stripes: linked list of #fpi_frame
+ * fpi_line_sum_std_sq_dev:
+ * @line1: first line
+ * @line2: second line
+ * @size: number of pixels to use from each line
+ * @step: distance in bytes between two used pixels of a line
  *
- * fpi_assemble_frames() assembles individual frames into a single image.
- * It expects @delta_x and @delta_y of #fpi_frame to be populated.
+ * Calculates the squared standard deviation of the sum of two lines, as
+ * per the following formula:
+ * |[<!-- -->
+ *    sum[i] = line1[i * step] + line2[i * step]
+ *    mean = sum (sum[0..size]) / size
+ *    sq_dev = sum ((sum[0..size] - mean) ^ 2) / size
+ * ]|
+ * Drivers can use this to implement @get_deviation of #fpi_line_asmbl_ctx,
+ * a lower value means that the lines match better.
  *
- * Returns: a newly allocated #fp_img.
+ * Returns: the squared standard deviation of the sum of @line1 and @line2
  */
-FpImage *
-fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
-                     GSList                     *stripes)
+int
+fpi_line_sum_std_sq_dev (const guint8 *line1,
+                         const guint8 *line2,
+                         unsigned int  size,
+                         unsigned int  step)
 {
-  GSList *l;
-  FpImage *img;
-  int height = 0;
-  int y, x;
-  gboolean reverse = FALSE;
-  struct fpi_frame *fpi_frame;
-
-  //FIXME g_return_if_fail
-  g_return_val_if_fail (stripes != NULL, NULL);
+  guint32 sum = 0, sq_sum = 0;
+  unsigned int done = 0;
+  guint64 mean;
 
-  /* No offset for 1st image */
-  fpi_frame = stripes->data;
-  fpi_frame->delta_x = 0;
-  fpi_frame->delta_y = 0;
-  for (l = stripes; l != NULL; l = l->next)
-    {
-      fpi_frame = l->data;
-
-      height += fpi_frame->delta_y;
-    }
+  g_return_val_if_fail (size > 0, 0);
 
-  fp_dbg ("height is %d", height);
-
-  if (height < 0)
-    {
-      reverse = TRUE;
-      height = -height;
-    }
+#ifdef __SSE2__
+  done = line_sum_sq_sum_sse2 (line1, line2, size, step, &sum, &sq_sum);
+#endif
+  line_sum_sq_sum (line1, line2, done, size, step, &sum, &sq_sum);
 
-  /* For last frame */
-  height += ctx->frame_height;
+  /* Same result as the two pass calculation with the integer mean, see
+   * fpi_std_sq_dev() */
+  mean = sum / size;
 
-  /* Create buffer big enough for max image */
-  img = fp_image_new (ctx->image_width, height);
-  img->flags = FPI_IMAGE_COLORS_INVERTED;
-  img->flags |= reverse ? 0 :  FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED;
-  img->width = ctx->image_width;
-  img->height = height;
+  return (sq_sum + size * mean * mean - 2 * mean * sum) / size;
+}
 
-  /* Assemble stripes */
-  y = reverse ? (height - ctx->frame_height) : 0;
-  x = ((int) ctx->image_width - (int) ctx->frame_width) / 2;
+/* Like frame_pixels(), returns the line as 8 bit pixels */
+static const guint8 *
+line_pixels (struct fpi_line_asmbl_ctx *ctx,
+             gconstpointer              line,
+             guint8                    *buf)
+{
+  const guint8 *data = (const guint8 *) line + ctx->offset;
+  unsigned int x;
 
-  for (l = stripes; l != NULL; l = l->next)
+  switch (ctx->format)
     {
-      fpi_frame = l->data;
-
-      y += fpi_frame->delta_y;
-      x += fpi_frame->delta_x;
-
-      aes_blit_stripe (ctx, img, fpi_frame, x, y);
-    }
-
-  return img;
-}
+    case FPI_FRAME_FORMAT_8BIT:
+      return data;
 
-static int
-cmpint (const void *p1, const void *p2, gpointer data)
-{
-  int a = *((int *) p1);
-  int b = *((int *) p2);
+    case FPI_FRAME_FORMAT_4BIT_PACKED:
+      for (x = 0; x < ctx->line_width; x++)
+        buf[x] = (x % 2 ? data[x >> 1] >> 4 : data[x >> 1] & 0xf) * 17;
+      break;
 
-  if (a < b)
-    return -1;
-  else if (a == b)
-    return 0;
-  else
-    return 1;
-}
+    case FPI_FRAME_FORMAT_16BIT:
+      for (x = 0; x < ctx->line_width; x++)
+        {
+          guint16 v;
 
-static void
-median_filter (int *data, int size, int filtersize)
-{
-  int i;
-  int *result = (int *) g_malloc0 (size * sizeof (int));
-  int *sortbuf = (int *) g_malloc0 (filtersize * sizeof (int));
+          memcpy (&v, data + x * 2, sizeof (v));
+          buf[x] = v >> 8;
+        }
+      break;
 
-  for (i = 0; i < size; i++)
-    {
-      int i1 = i - (filtersize - 1) / 2;
-      int i2 = i + (filtersize - 1) / 2;
-      if (i1 < 0)
-        i1 = 0;
-      if (i2 >= size)
-        i2 = size - 1;
-      memmove (sortbuf, data + i1, (i2 - i1 + 1) * sizeof (int));
-      g_qsort_with_data (sortbuf, i2 - i1 + 1, sizeof (int), cmpint, NULL);
-      result[i] = sortbuf[(i2 - i1 + 1) / 2];
+    case FPI_FRAME_FORMAT_CALLBACK:
+    default:
+      for (x = 0; x < ctx->line_width; x++)
+        buf[x] = ctx->get_pixel (ctx, line, x);
+      break;
     }
-  memmove (data, result, size * sizeof (int));
-  g_free (result);
-  g_free (sortbuf);
+
+  return buf;
 }
 
 static void
-interpolate_lines (struct fpi_line_asmbl_ctx *ctx,
-                   GSList *line1, gint32 y1_f,
-                   GSList *line2, gint32 y2_f,
+interpolate_lines (const guint8 *line1, gint32 y1_f,
+                   const guint8 *line2, gint32 y2_f,
                    unsigned char *output, gint32 yi_f,
                    int size)
 {
   int i;
-  unsigned char p1, p2;
-
-  if (!line1 || !line2)
-    return;
 
   for (i = 0; i < size; i++)
     {
       gint unscaled;
-      p1 = ctx->get_pixel (ctx, line1, i);
-      p2 = ctx->get_pixel (ctx, line2, i);
 
-      unscaled = (yi_f - y1_f) * p2 + (y2_f - yi_f) * p1;
+      unscaled = (yi_f - y1_f) * line2[i] + (y2_f - yi_f) * line1[i];
       output[i] = (unscaled) / (y2_f - y1_f);
     }
 }
 
-/**
- * fpi_assemble_lines:
- * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
- * @lines: linked list of lines
- * @num_lines: number of items in @lines to process
- *
- * #fpi_assemble_lines assembles individual lines into a single image.
- * It also rescales image to account variable swiping speed.
- *
- * Note that @num_lines might be shorter than the length of the list,
- * if some lines should be skipped.
- *
- * Returns: a newly allocated #fp_img.
- */
-FpImage *
-fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
-                    GSList *lines, size_t num_lines)
+static FpImage *
+assemble_lines (struct fpi_line_asmbl_ctx *ctx,
+                gconstpointer             *lines,
+                size_t                     num_lines)
 {
   /* Number of output lines per distance between two scanners */
   int i;
-  GSList *row1, *row2;
   /* The y coordinate is tracked as a 16.16 fixed point number. All
    * variables postfixed with _f follow this format here and in
    * interpolate_lines.
@@ -405,15 +1437,12 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
   int line_ind = 0;
   int *offsets = g_new0 (int, num_lines / 2);
   unsigned char *output = g_malloc0 (ctx->line_width * ctx->max_height);
+  g_autofree guint8 *buf = g_malloc (2 * ctx->line_width);
   FpImage *img;
 
-  g_return_val_if_fail (lines != NULL, NULL);
-  g_return_val_if_fail (num_lines >= 2, NULL);
-
   fp_dbg ("%"G_GINT64_FORMAT, g_get_real_time ());
 
-  row1 = lines;
-  for (i = 0; (i < num_lines - 1) && row1; i += 2)
+  for (i = 0; i < num_lines - 1; i += 2)
     {
       int bestmatch = i;
       int bestdiff = 0;
@@ -422,24 +1451,19 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
       firstrow = i + 1;
       lastrow = MIN (i + ctx->max_search_offset, num_lines - 1);
 
-      row2 = g_slist_next (row1);
       for (j = firstrow; j <= lastrow; j++)
         {
           int diff = ctx->get_deviation (ctx,
-                                         row1,
-                                         row2);
+                                         lines[i],
+                                         lines[j]);
           if ((j == firstrow) || (diff < bestdiff))
             {
               bestdiff = diff;
               bestmatch = j;
             }
-          row2 = g_slist_next (row2);
         }
       offsets[i / 2] = bestmatch - i;
       fp_dbg ("%d", offsets[i / 2]);
-      row1 = g_slist_next (row1);
-      if (row1)
-        row1 = g_slist_next (row1);
     }
 
   median_filter (offsets, (num_lines / 2) - 1, ctx->median_filter_size);
@@ -447,21 +1471,26 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
   fp_dbg ("offsets_filtered: %"G_GINT64_FORMAT, g_get_real_time ());
   for (i = 0; i <= (num_lines / 2) - 1; i++)
     fp_dbg ("%d", offsets[i]);
-  row1 = lines;
-  for (i = 0; i < num_lines - 1; i++, row1 = g_slist_next (row1))
+  for (i = 0; i < num_lines - 1; i++)
     {
       int offset = offsets[i / 2];
       if (offset > 0)
         {
           gint32 ynext_f = y_f + (ctx->resolution << 16) / offset;
+          const guint8 *pixels1 = NULL, *pixels2 = NULL;
+
+          if ((line_ind << 16) < ynext_f)
+            {
+              pixels1 = line_pixels (ctx, lines[i], buf);
+              pixels2 = line_pixels (ctx, lines[i + 1], buf + ctx->line_width);
+            }
+
           while ((line_ind << 16) < ynext_f)
             {
               if (line_ind > ctx->max_height - 1)
                 goto out;
-              interpolate_lines (ctx,
-                                 row1, y_f,
-                                 g_slist_next (row1),
-                                 ynext_f,
+              interpolate_lines (pixels1, y_f,
+                                 pixels2, ynext_f,
                                  output + line_ind * ctx->line_width,
                                  line_ind << 16,
                                  ctx->line_width);
@@ -480,3 +1509,61 @@ out:
   g_free (output);
   return img;
 }
+
+/**
+ * fpi_assemble_lines:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @lines: linked list of lines
+ * @num_lines: number of items in @lines to process
+ *
+ * #fpi_assemble_lines assembles individual lines into a single image.
+ * It also rescales image to account variable swiping speed.
+ *
+ * Note that @num_lines might be shorter than the length of the list,
+ * if some lines should be skipped.
+ *
+ * Returns: a newly allocated #fp_img.
+ */
+FpImage *
+fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
+                    GSList *lines, size_t num_lines)
+{
+  g_autofree gconstpointer *rows = NULL;
+  GSList *l;
+  size_t i;
+
+  g_return_val_if_fail (lines != NULL, NULL);
+  g_return_val_if_fail (num_lines >= 2, NULL);
+
+  rows = g_new (gconstpointer, num_lines);
+  for (l = lines, i = 0; l != NULL && i < num_lines; l = l->next, i++)
+    rows[i] = l->data;
+
+  return assemble_lines (ctx, rows, i);
+}
+
+/**
+ * fpi_assemble_lines_store:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @lines: a #FpiFrameStore of lines
+ *
+ * Same as fpi_assemble_lines(), but for all lines held in a #FpiFrameStore.
+ *
+ * Returns: a newly allocated #fp_img.
+ */
+FpImage *
+fpi_assemble_lines_store (struct fpi_line_asmbl_ctx *ctx,
+                          FpiFrameStore             *lines)
+{
+  g_autofree gconstpointer *rows = NULL;
+  guint i;
+
+  g_return_val_if_fail (lines != NULL, NULL);
+  g_return_val_if_fail (lines->n_items >= 2, NULL);
+
+  rows = g_new (gconstpointer, lines->n_items);
+  for (i = 0; i < lines->n_items; i++)
+    rows[i] = lines->data + i * lines->item_size;
+
+  return assemble_lines (ctx, rows, lines->n_items);
+}
@@ -21,6 +21,28 @@
 
 #include "fp-image.h"
 
+/**
+ * FpiFrameFormat:
+ * @FPI_FRAME_FORMAT_CALLBACK: The pixel data is only accessible using the
+ *   get_pixel accessor of the assembling context
+ * @FPI_FRAME_FORMAT_8BIT: One byte per pixel, stored row by row
+ * @FPI_FRAME_FORMAT_4BIT_PACKED: Two 4 bit pixels per byte, the first one in
+ *   the lower nibble. Frames are stored column by column, so that each byte
+ *   holds two vertically adjacent pixels, as returned by AES sensors
+ * @FPI_FRAME_FORMAT_16BIT: One native endian 16 bit value per pixel, stored
+ *   row by row. The brightness is taken from the upper 8 bits
+ *
+ * The memory layout of the pixel data of frames and lines. For all formats
+ * except %FPI_FRAME_FORMAT_CALLBACK the assembling routines read the pixel
+ * data directly instead of calling the get_pixel accessor for every pixel.
+ */
+typedef enum {
+  FPI_FRAME_FORMAT_CALLBACK = 0,
+  FPI_FRAME_FORMAT_8BIT,
+  FPI_FRAME_FORMAT_4BIT_PACKED,
+  FPI_FRAME_FORMAT_16BIT,
+} FpiFrameFormat;
+
 /**
  * fpi_frame:
  * @delta_x: X offset of the frame
@@ -38,12 +60,35 @@ struct fpi_frame
   unsigned char data[0];
 };
 
+/**
+ * FpiFrameStore:
+ *
+ * An opaque structure holding a sequence of equally sized items, such as
+ * #fpi_frame structures or lines, in one contiguous block of memory. See
+ * fpi_frame_store_new().
+ */
+typedef struct _FpiFrameStore FpiFrameStore;
+
+FpiFrameStore *fpi_frame_store_new (gsize item_size,
+                                    guint n_reserved);
+void fpi_frame_store_free (FpiFrameStore *self);
+void fpi_frame_store_clear (FpiFrameStore *self);
+gpointer fpi_frame_store_append (FpiFrameStore *self);
+gpointer fpi_frame_store_get (FpiFrameStore *self,
+                              guint          index);
+guint fpi_frame_store_get_n_items (FpiFrameStore *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiFrameStore, fpi_frame_store_free);
+
 /**
  * fpi_frame_asmbl_ctx:
  * @frame_width: width of the frame
  * @frame_height: height of the frame
  * @image_width: resulting image width
  * @get_pixel: pixel accessor, returns pixel brightness at x,y of frame
+ * @format: layout of the frame data, see #FpiFrameFormat
+ * @stride: distance in bytes between two rows (two columns for
+ *   %FPI_FRAME_FORMAT_4BIT_PACKED) of the frame data, 0 if tightly packed
  *
  * #fpi_frame_asmbl_ctx is a structure holding the context for frame
  * assembling routines.
@@ -51,6 +96,11 @@ struct fpi_frame
  * Drivers should define their own #fpi_frame_asmbl_ctx depending on
  * hardware parameters of scanner. @image_width is usually 25% wider than
  * @frame_width to take horizontal movement into account.
+ *
+ * Drivers should set @format if the frame data has one of the layouts
+ * described by #FpiFrameFormat, @get_pixel is only needed otherwise.
+ * Movement estimation compares frames on several threads at once, so
+ * @get_pixel must not modify any shared state.
  */
 struct fpi_frame_asmbl_ctx
 {
@@ -61,6 +111,8 @@ struct fpi_frame_asmbl_ctx
                              struct fpi_frame           *frame,
                              unsigned int                x,
                              unsigned int                y);
+  FpiFrameFormat format;
+  unsigned int   stride;
 };
 
 void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
@@ -69,6 +121,43 @@ void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
 FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
                               GSList                     *stripes);
 
+void fpi_do_movement_estimation_store (struct fpi_frame_asmbl_ctx *ctx,
+                                       FpiFrameStore              *stripes);
+
+FpImage *fpi_assemble_frames_store (struct fpi_frame_asmbl_ctx *ctx,
+                                    FpiFrameStore              *stripes);
+
+void fpi_do_movement_estimation_async (struct fpi_frame_asmbl_ctx *ctx,
+                                       GSList                     *stripes,
+                                       GCancellable               *cancellable,
+                                       GAsyncReadyCallback         callback,
+                                       gpointer                    user_data);
+gboolean fpi_do_movement_estimation_finish (GAsyncResult *result,
+                                            GError      **error);
+
+/**
+ * FpiFrameAssembler:
+ *
+ * An opaque structure to assemble frames of a swipe while it is still
+ * being captured, see fpi_frame_assembler_new().
+ */
+typedef struct _FpiFrameAssembler FpiFrameAssembler;
+
+FpiFrameAssembler *fpi_frame_assembler_new (const struct fpi_frame_asmbl_ctx *ctx,
+                                            gboolean                          estimate_movement);
+void fpi_frame_assembler_free (FpiFrameAssembler *self);
+void fpi_frame_assembler_reset (FpiFrameAssembler *self);
+void fpi_frame_assembler_add_frame (FpiFrameAssembler *self,
+                                    struct fpi_frame  *frame);
+void fpi_frame_assembler_add_frame_data (FpiFrameAssembler *self,
+                                         const guint8      *data,
+                                         int                delta_x,
+                                         int                delta_y);
+guint fpi_frame_assembler_get_n_frames (FpiFrameAssembler *self);
+FpImage *fpi_frame_assembler_finish (FpiFrameAssembler *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiFrameAssembler, fpi_frame_assembler_free);
+
 /**
  * fpi_line_asmbl_ctx:
  * @line_width: width of line
@@ -79,6 +168,9 @@ FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
  * @get_deviation: pointer to a function that returns the numerical difference
  *                 between two lines
  * @get_pixel: pixel accessor, returns pixel brightness at x of line
+ * @format: layout of the line data, see #FpiFrameFormat
+ * @offset: offset in bytes of the pixel data from the start of the line data
+ * @user_data: driver data for use by @get_deviation and @get_pixel
  *
  * #fpi_line_asmbl_ctx is a structure holding the context for line assembling
  * routines.
@@ -95,7 +187,12 @@ FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
  * The function pointed to by @get_deviation should return the numerical difference
  * between two lines. Higher values means lines are more different. If the reader
  * returns two lines at a time, this function should be used to estimate the
- * difference between pairs of lines.
+ * difference between pairs of lines. Both @get_deviation and @get_pixel
+ * are passed the line data itself, i.e. the data of a #GSList element or
+ * an item of a #FpiFrameStore.
+ *
+ * Drivers should set @format and @offset if the line data has one of the
+ * layouts described by #FpiFrameFormat, @get_pixel is only needed otherwise.
  */
 struct fpi_line_asmbl_ctx
 {
@@ -105,13 +202,24 @@ struct fpi_line_asmbl_ctx
   unsigned int median_filter_size;
   unsigned int max_search_offset;
   int          (*get_deviation)(struct fpi_line_asmbl_ctx *ctx,
-                                GSList                    *line1,
-                                GSList                    *line2);
+                                gconstpointer              line1,
+                                gconstpointer              line2);
   unsigned char (*get_pixel)(struct fpi_line_asmbl_ctx *ctx,
-                             GSList                    *line,
+                             gconstpointer              line,
                              unsigned int               x);
+  FpiFrameFormat format;
+  unsigned int   offset;
+  gpointer       user_data;
 };
 
 FpImage *fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
                              GSList                    *lines,
                              size_t                     num_lines);
+
+FpImage *fpi_assemble_lines_store (struct fpi_line_asmbl_ctx *ctx,
+                                   FpiFrameStore             *lines);
+
+int fpi_line_sum_std_sq_dev (const guint8 *line1,
+                             const guint8 *line2,
+                             unsigned int  size,
+                             unsigned int  step);
@@ -21,6 +21,7 @@
 #include <gusb.h>
 #include "fp-context.h"
 #include "fpi-compat.h"
+#include "fpi-device.h"
 
 /**
  * fpi_get_driver_types:
@@ -33,3 +34,31 @@
  *   all driver types
  */
 GArray *fpi_get_driver_types (void);
+
+/**
+ * FpiDriverIdEntry:
+ * @driver: The ID of the driver, see #FpDeviceClass
+ * @driver_index: The index of the driver in fpi_get_driver_types()
+ * @type: The #FpDeviceType of the driver
+ * @entry: A copy of the entry in the id table of the driver
+ *
+ * An entry in the id table of all drivers that is generated at build time.
+ */
+typedef struct
+{
+  const gchar *driver;
+  guint        driver_index;
+  FpDeviceType type;
+  FpIdEntry    entry;
+} FpiDriverIdEntry;
+
+/**
+ * fpi_driver_id_table:
+ *
+ * The id tables of all drivers, terminated by an entry with a %NULL
+ * @driver. This is generated at build time by fprint-list-id-table, so
+ * that devices can be matched without initializing every driver class.
+ *
+ * Stability: private
+ */
+extern const FpiDriverIdEntry fpi_driver_id_table[];
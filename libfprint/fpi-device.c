@@ -305,7 +305,7 @@ fpi_device_update_features (FpDevice       *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_PROBE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_PROBE);
   g_return_if_fail ((value & update) == value);
 
   priv->features = (priv->features & ~update) | (value & update);
@@ -324,7 +324,9 @@ timeout_finalize (GSource *source)
   FpDevicePrivate *priv;
 
   priv = fp_device_get_instance_private (timeout_source->device);
+  g_mutex_lock (&priv->lock);
   priv->sources = g_slist_remove (priv->sources, source);
+  g_mutex_unlock (&priv->lock);
 }
 
 static gboolean
@@ -346,6 +348,68 @@ static GSourceFuncs timeout_funcs = {
   NULL, NULL
 };
 
+/* Returns the main context that driver code of @device runs on. This is
+ * the worker context if fp_device_set_worker_thread() was used, otherwise
+ * the context of the current task.
+ */
+GMainContext *
+fpi_device_get_context (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  if (priv->worker_context)
+    return priv->worker_context;
+
+  if (priv->current_task)
+    return g_task_get_context (priv->current_task);
+
+  return g_main_context_get_thread_default ();
+}
+
+typedef struct
+{
+  FpDevice            *device;
+  FpDeviceDispatchFunc func;
+} FpDeviceDispatchData;
+
+static gboolean
+fpi_device_dispatch_cb (gpointer user_data)
+{
+  FpDeviceDispatchData *data = user_data;
+
+  data->func (data->device);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Calls @func on the worker thread if there is one, or right away. No
+ * reference is taken, the caller must ensure that a task keeps @device
+ * alive until @func ran.
+ */
+void
+fpi_device_dispatch (FpDevice            *device,
+                     FpDeviceDispatchFunc func)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceDispatchData *data;
+
+  if (!priv->worker_context)
+    {
+      func (device);
+      return;
+    }
+
+  data = g_new0 (FpDeviceDispatchData, 1);
+  data->device = device;
+  data->func = func;
+
+  g_main_context_invoke_full (priv->worker_context,
+                              G_PRIORITY_DEFAULT,
+                              fpi_device_dispatch_cb,
+                              data,
+                              g_free);
+}
+
 /**
  * fpi_device_add_timeout:
  * @device: The #FpDevice
@@ -368,22 +432,18 @@ fpi_device_add_timeout (FpDevice      *device,
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceTimeoutSource *source;
-  GMainContext *context;
 
   source = (FpDeviceTimeoutSource *) g_source_new (&timeout_funcs,
                                                    sizeof (FpDeviceTimeoutSource));
   source->device = device;
 
-  if (priv->current_task)
-    context = g_task_get_context (priv->current_task);
-  else
-    context = g_main_context_get_thread_default ();
-
-  g_source_attach (&source->source, context);
+  g_source_attach (&source->source, fpi_device_get_context (device));
   g_source_set_callback (&source->source, (GSourceFunc) func, user_data, destroy_notify);
   g_source_set_ready_time (&source->source,
                            g_source_get_time (&source->source) + interval * (guint64) 1000);
+  g_mutex_lock (&priv->lock);
   priv->sources = g_slist_prepend (priv->sources, source);
+  g_mutex_unlock (&priv->lock);
   g_source_unref (&source->source);
 
   return &source->source;
@@ -409,6 +469,25 @@ fpi_device_get_usb_device (FpDevice *device)
   return priv->usb_device;
 }
 
+/**
+ * fpi_device_get_usb_transfer_pool:
+ * @device: The #FpDevice
+ *
+ * Get the pool that transfers created with fpi_usb_transfer_new() for this
+ * #FpDevice are recycled through.
+ *
+ * Returns: (transfer none): The #FpiUsbTransferPool
+ */
+FpiUsbTransferPool *
+fpi_device_get_usb_transfer_pool (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
+
+  return priv->usb_transfer_pool;
+}
+
 /**
  * fpi_device_get_udev_data:
  * @device: The #FpDevice
@@ -478,10 +557,17 @@ FpiDeviceAction
 fpi_device_get_current_action (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpiDeviceAction action;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), FPI_DEVICE_ACTION_NONE);
 
-  return priv->current_action;
+  /* Driver code on the worker thread may still call this while the task is
+   * returned on the thread of the API user. */
+  g_mutex_lock (&priv->lock);
+  action = priv->current_action;
+  g_mutex_unlock (&priv->lock);
+
+  return action;
 }
 
 /**
@@ -499,11 +585,16 @@ gboolean
 fpi_device_action_is_cancelled (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gboolean cancelled;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), TRUE);
-  g_return_val_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE, TRUE);
+  g_return_val_if_fail (fpi_device_get_current_action (device) != FPI_DEVICE_ACTION_NONE, TRUE);
 
-  return g_cancellable_is_cancelled (priv->current_cancellable);
+  g_mutex_lock (&priv->lock);
+  cancelled = g_cancellable_is_cancelled (priv->current_cancellable);
+  g_mutex_unlock (&priv->lock);
+
+  return cancelled;
 }
 
 /**
@@ -534,10 +625,9 @@ fpi_device_get_enroll_data (FpDevice *device,
                             FpPrint **print)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
-  FpEnrollData *data;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_ENROLL);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_ENROLL);
 
   data = g_task_get_task_data (priv->current_task);
   g_assert (data);
@@ -560,7 +650,7 @@ fpi_device_get_capture_data (FpDevice *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_CAPTURE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_CAPTURE);
 
   if (wait_for_finger)
     *wait_for_finger = priv->wait_for_finger;
@@ -581,7 +671,7 @@ fpi_device_get_verify_data (FpDevice *device,
   FpMatchData *data;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_VERIFY);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_VERIFY);
 
   data = g_task_get_task_data (priv->current_task);
   g_assert (data);
@@ -612,7 +702,7 @@ fpi_device_get_identify_data (FpDevice   *device,
   FpMatchData *data;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_IDENTIFY);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_IDENTIFY);
 
   data = g_task_get_task_data (priv->current_task);
   g_assert (data);
@@ -635,7 +725,7 @@ fpi_device_get_delete_data (FpDevice *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_DELETE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_DELETE);
 
   if (print)
     *print = g_task_get_task_data (priv->current_task);
@@ -657,11 +747,16 @@ GCancellable *
 fpi_device_get_cancellable (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  GCancellable *cancellable;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
-  g_return_val_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE, NULL);
+  g_return_val_if_fail (fpi_device_get_current_action (device) != FPI_DEVICE_ACTION_NONE, NULL);
+
+  g_mutex_lock (&priv->lock);
+  cancellable = priv->current_cancellable;
+  g_mutex_unlock (&priv->lock);
 
-  return priv->current_cancellable;
+  return cancellable;
 }
 
 static void
@@ -721,16 +816,14 @@ void
 fpi_device_action_error (FpDevice *device,
                          GError   *error)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE);
+  g_return_if_fail (fpi_device_get_current_action (device) != FPI_DEVICE_ACTION_NONE);
 
   if (error != NULL)
     {
       g_autofree char *action_str = NULL;
 
-      action_str = g_enum_to_string (FPI_TYPE_DEVICE_ACTION, priv->current_action);
+      action_str = g_enum_to_string (FPI_TYPE_DEVICE_ACTION, fpi_device_get_current_action (device));
       g_debug ("Device reported generic error (%s) during action; action was: %s",
                error->message, action_str);
     }
@@ -741,7 +834,7 @@ fpi_device_action_error (FpDevice *device,
     }
 
 
-  switch (priv->current_action)
+  switch (fpi_device_get_current_action (device))
     {
     case FPI_DEVICE_ACTION_PROBE:
       fpi_device_probe_complete (device, NULL, NULL, error);
@@ -818,7 +911,7 @@ fpi_device_critical_enter (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
-  g_return_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE);
+  g_return_if_fail (fpi_device_get_current_action (device) != FPI_DEVICE_ACTION_NONE);
 
   priv->critical_section += 1;
 
@@ -836,9 +929,15 @@ fpi_device_critical_section_flush_idle_cb (FpDevice *device)
 
   if (priv->cancel_queued)
     {
+      gboolean busy;
+
       /* Cancellation must only happen if the driver is busy. */
-      if (priv->current_action != FPI_DEVICE_ACTION_NONE &&
-          priv->current_task_idle_return_source == NULL)
+      g_mutex_lock (&priv->lock);
+      busy = priv->current_action != FPI_DEVICE_ACTION_NONE &&
+             priv->current_task_idle_return_source == NULL;
+      g_mutex_unlock (&priv->lock);
+
+      if (busy)
         cls->cancel (device);
       priv->cancel_queued = FALSE;
 
@@ -881,7 +980,7 @@ fpi_device_critical_leave (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
-  g_return_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE);
+  g_return_if_fail (fpi_device_get_current_action (device) != FPI_DEVICE_ACTION_NONE);
   g_return_if_fail (priv->critical_section);
 
   priv->critical_section -= 1;
@@ -901,7 +1000,7 @@ fpi_device_critical_leave (FpDevice *device)
   g_source_set_name (priv->critical_section_flush_source,
                      "Flush libfprint driver critical section");
   g_source_attach (priv->critical_section_flush_source,
-                   g_task_get_context (priv->current_task));
+                   fpi_device_get_context (device));
   g_source_unref (priv->critical_section_flush_source);
 }
 
@@ -910,7 +1009,14 @@ clear_device_cancel_action (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
-  g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
+  /* The handlers may run on any thread, disconnecting waits for them, so
+   * that no new idle cancel source can be queued after it is removed. */
+  if (priv->current_task_cancellable_id)
+    {
+      g_cancellable_disconnect (g_task_get_cancellable (priv->current_task),
+                                priv->current_task_cancellable_id);
+      priv->current_task_cancellable_id = 0;
+    }
 
   if (priv->current_cancellable_id)
     {
@@ -919,12 +1025,9 @@ clear_device_cancel_action (FpDevice *device)
       priv->current_cancellable_id = 0;
     }
 
-  if (priv->current_task_cancellable_id)
-    {
-      g_cancellable_disconnect (g_task_get_cancellable (priv->current_task),
-                                priv->current_task_cancellable_id);
-      priv->current_task_cancellable_id = 0;
-    }
+  g_mutex_lock (&priv->lock);
+  g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
+  g_mutex_unlock (&priv->lock);
 }
 
 typedef enum _FpDeviceTaskReturnType {
@@ -954,15 +1057,17 @@ fp_device_task_return_in_idle_cb (gpointer user_data)
   g_autoptr(GError) cancellation_reason = NULL;
 
 
-  action_str = g_enum_to_string (FPI_TYPE_DEVICE_ACTION, priv->current_action);
-  g_debug ("Completing action %s in idle!", action_str);
-
+  g_mutex_lock (&priv->lock);
   task = g_steal_pointer (&priv->current_task);
   action = priv->current_action;
   priv->current_action = FPI_DEVICE_ACTION_NONE;
   priv->current_task_idle_return_source = NULL;
   g_clear_object (&priv->current_cancellable);
   cancellation_reason = g_steal_pointer (&priv->current_cancellation_reason);
+  g_mutex_unlock (&priv->lock);
+
+  action_str = g_enum_to_string (FPI_TYPE_DEVICE_ACTION, action);
+  g_debug ("Completing action %s in idle!", action_str);
 
   fpi_device_update_temp (data->device, FALSE);
 
@@ -1090,6 +1195,7 @@ fpi_device_return_task_in_idle (FpDevice              *device,
   data->type = return_type;
   data->result = return_data;
 
+  g_mutex_lock (&priv->lock);
   priv->current_task_idle_return_source = g_idle_source_new ();
   g_source_set_priority (priv->current_task_idle_return_source,
                          g_task_get_priority (priv->current_task));
@@ -1101,6 +1207,7 @@ fpi_device_return_task_in_idle (FpDevice              *device,
   g_source_attach (priv->current_task_idle_return_source,
                    g_task_get_context (priv->current_task));
   g_source_unref (priv->current_task_idle_return_source);
+  g_mutex_unlock (&priv->lock);
 }
 
 /**
@@ -1121,7 +1228,7 @@ fpi_device_probe_complete (FpDevice    *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_PROBE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_PROBE);
 
   g_debug ("Device reported probe completion");
 
@@ -1161,15 +1268,14 @@ fpi_device_probe_complete (FpDevice    *device,
 void
 fpi_device_open_complete (FpDevice *device, GError *error)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_OPEN);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_OPEN);
 
   g_debug ("Device reported open completion");
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  fpi_device_invalidate_print_list_cache (device);
 
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
@@ -1190,18 +1296,44 @@ fpi_device_close_complete (FpDevice *device, GError *error)
 {
   GError *nested_error = NULL;
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GSource) pending = NULL;
+  guint polls, captures;
+  gint64 mean_delay, max_delay;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_CLOSE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_CLOSE);
 
   g_debug ("Device reported close completion");
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  fpi_device_invalidate_print_list_cache (device);
+
+  fpi_device_get_poll_stats (device, &polls, &captures,
+                             &mean_delay, &max_delay);
+  if (polls > 0)
+    fp_dbg ("Finger polling: %u polls, %u captures, delay %" G_GINT64_FORMAT
+            " ms mean, %" G_GINT64_FORMAT " ms max",
+            polls, captures, mean_delay / 1000, max_delay / 1000);
+
+  g_mutex_lock (&priv->lock);
+  pending = g_steal_pointer (&priv->poll_pending);
+  g_mutex_unlock (&priv->lock);
 
   switch (priv->type)
     {
     case FP_DEVICE_TYPE_USB:
+      if (priv->usb_transfer_pool)
+        {
+          guint hits, misses;
+          gsize cached;
+
+          fpi_usb_transfer_pool_get_stats (priv->usb_transfer_pool,
+                                           &hits, &misses, &cached);
+          fp_dbg ("USB transfer pool: %u hits, %u misses, %" G_GSIZE_FORMAT " bytes cached",
+                  hits, misses, cached);
+        }
+
       if (!g_usb_device_close (priv->usb_device, &nested_error))
         {
           if (error == NULL)
@@ -1241,15 +1373,14 @@ fpi_device_close_complete (FpDevice *device, GError *error)
 void
 fpi_device_enroll_complete (FpDevice *device, FpPrint *print, GError *error)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_ENROLL);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_ENROLL);
 
   g_debug ("Device reported enroll completion");
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  fpi_device_invalidate_print_list_cache (device);
 
   if (!error)
     {
@@ -1316,7 +1447,7 @@ fpi_device_verify_complete (FpDevice *device,
   FpMatchData *data;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_VERIFY);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_VERIFY);
 
   g_debug ("Device reported verify completion");
 
@@ -1381,7 +1512,7 @@ fpi_device_identify_complete (FpDevice *device,
   FpMatchData *data;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_IDENTIFY);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_IDENTIFY);
 
   g_debug ("Device reported identify completion");
 
@@ -1437,10 +1568,8 @@ fpi_device_capture_complete (FpDevice *device,
                              FpImage  *image,
                              GError   *error)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_CAPTURE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_CAPTURE);
 
   g_debug ("Device reported capture completion");
 
@@ -1483,15 +1612,14 @@ void
 fpi_device_delete_complete (FpDevice *device,
                             GError   *error)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_DELETE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_DELETE);
 
   g_debug ("Device reported deletion completion");
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  fpi_device_invalidate_print_list_cache (device);
 
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
@@ -1521,7 +1649,7 @@ fpi_device_list_complete (FpDevice  *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_LIST);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_LIST);
 
   g_debug ("Device reported listing completion");
 
@@ -1540,6 +1668,14 @@ fpi_device_list_complete (FpDevice  *device,
                                         "Driver failed to provide a list of prints");
     }
 
+  g_mutex_lock (&priv->lock);
+  if (!error && priv->print_list_cache_enabled)
+    {
+      g_clear_pointer (&priv->print_list_cache, g_ptr_array_unref);
+      priv->print_list_cache = fpi_device_copy_print_list (prints);
+    }
+  g_mutex_unlock (&priv->lock);
+
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_PTR_ARRAY, prints);
   else
@@ -1608,7 +1744,7 @@ fpi_device_suspend (FpDevice *device)
    * For long running tasks, call the driver handler right away, for short
    * tasks, wait for completion and then return the task.
    */
-  switch (priv->current_action)
+  switch (fpi_device_get_current_action (device))
     {
     case FPI_DEVICE_ACTION_NONE:
       fpi_device_suspend_complete (device, NULL);
@@ -1653,7 +1789,7 @@ fpi_device_resume (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
-  switch (priv->current_action)
+  switch (fpi_device_get_current_action (device))
     {
     case FPI_DEVICE_ACTION_NONE:
       fpi_device_resume_complete (device, NULL);
@@ -1765,7 +1901,7 @@ fpi_device_suspend_completed (FpDevice *device)
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   /* We have an ongoing operation, allow the device to wake up the machine. */
-  if (priv->current_action != FPI_DEVICE_ACTION_NONE)
+  if (fpi_device_get_current_action (device) != FPI_DEVICE_ACTION_NONE)
     fpi_device_configure_wakeup (device, TRUE);
 
   if (priv->critical_section)
@@ -1799,6 +1935,7 @@ fpi_device_suspend_complete (FpDevice *device,
                              GError   *error)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GCancellable) cancellable = NULL;
 
   g_return_if_fail (FP_IS_DEVICE (device));
   g_return_if_fail (priv->suspend_resume_task);
@@ -1807,10 +1944,14 @@ fpi_device_suspend_complete (FpDevice *device,
   priv->suspend_error = g_steal_pointer (&error);
   priv->is_suspended = TRUE;
 
-  /* If there is no error, we have no running task, return immediately. */
+  /* If there is no error, we have no running task, return immediately. The
+   * task may be returned on the thread of the API user at the same time, so
+   * hold the lock until we are connected to it. */
+  g_mutex_lock (&priv->lock);
   if (!priv->suspend_error || !priv->current_task ||
       g_task_get_completed (priv->current_task))
     {
+      g_mutex_unlock (&priv->lock);
       fpi_device_suspend_completed (device);
       return;
     }
@@ -1826,8 +1967,10 @@ fpi_device_suspend_complete (FpDevice *device,
   if (!priv->current_cancellation_reason)
     priv->current_cancellation_reason = fpi_device_error_new_msg (FP_DEVICE_ERROR_BUSY,
                                                                   "Cannot run while suspended.");
+  cancellable = g_object_ref (priv->current_cancellable);
+  g_mutex_unlock (&priv->lock);
 
-  g_cancellable_cancel (priv->current_cancellable);
+  g_cancellable_cancel (cancellable);
 }
 
 /**
@@ -1869,15 +2012,14 @@ void
 fpi_device_clear_storage_complete (FpDevice *device,
                                    GError   *error)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_CLEAR_STORAGE);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_CLEAR_STORAGE);
 
   g_debug ("Device reported deletion completion");
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  fpi_device_invalidate_print_list_cache (device);
 
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
@@ -1886,6 +2028,107 @@ fpi_device_clear_storage_complete (FpDevice *device,
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_ERROR, error);
 }
 
+typedef struct
+{
+  GTask   *task;
+  gint     completed_stages;
+  FpPrint *match;
+  FpPrint *print;
+  GError  *error;
+} FpDeviceReportData;
+
+static void
+fpi_device_report_data_free (FpDeviceReportData *data)
+{
+  g_clear_object (&data->match);
+  g_clear_object (&data->print);
+  g_clear_error (&data->error);
+  g_object_unref (data->task);
+  g_free (data);
+}
+
+/* With a worker thread, progress and match callbacks are passed to the
+ * context of the task, which is where the API user expects them. The task
+ * keeps the device alive until then. All values are owned by the report,
+ * as the driver may carry on and modify the task data in the meantime.
+ */
+static void
+fpi_device_report_in_task_context (FpDevice   *device,
+                                   GSourceFunc func,
+                                   gint        completed_stages,
+                                   FpPrint    *match,
+                                   FpPrint    *print,
+                                   GError     *error)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceReportData *data;
+
+  data = g_new0 (FpDeviceReportData, 1);
+  data->task = g_object_ref (priv->current_task);
+  data->completed_stages = completed_stages;
+  data->match = match;
+  data->print = print;
+  data->error = error;
+
+  g_main_context_invoke_full (g_task_get_context (priv->current_task),
+                              G_PRIORITY_DEFAULT,
+                              func,
+                              data,
+                              (GDestroyNotify) fpi_device_report_data_free);
+}
+
+static void
+enroll_progress_report (GTask   *task,
+                        gint     completed_stages,
+                        FpPrint *print,
+                        GError  *error)
+{
+  FpEnrollData *data = g_task_get_task_data (task);
+
+  if (data->enroll_progress_cb)
+    {
+      data->enroll_progress_cb (g_task_get_source_object (task),
+                                completed_stages,
+                                print,
+                                data->enroll_progress_data,
+                                error);
+    }
+}
+
+static gboolean
+enroll_progress_report_cb (gpointer user_data)
+{
+  FpDeviceReportData *data = user_data;
+
+  enroll_progress_report (data->task, data->completed_stages,
+                          data->print, data->error);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+match_report (GTask   *task,
+              FpPrint *match,
+              FpPrint *print,
+              GError  *error)
+{
+  FpMatchData *data = g_task_get_task_data (task);
+
+  if (data->match_cb)
+    data->match_cb (g_task_get_source_object (task),
+                    match, print, data->match_data, error);
+}
+
+static gboolean
+match_report_cb (gpointer user_data)
+{
+  FpDeviceReportData *data = user_data;
+
+  match_report (data->task, data->match, data->print, data->error);
+
+  return G_SOURCE_REMOVE;
+}
+
 /**
 
  * fpi_device_enroll_progress:
@@ -1907,7 +2150,7 @@ fpi_device_enroll_progress (FpDevice *device,
   FpEnrollData *data;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_ENROLL);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_ENROLL);
   g_return_if_fail (error == NULL || error->domain == FP_DEVICE_RETRY);
 
   g_debug ("Device reported enroll progress, reported %i of %i have been completed", completed_stages, priv->nr_enroll_stages);
@@ -1921,17 +2164,17 @@ fpi_device_enroll_progress (FpDevice *device,
       g_clear_object (&print);
     }
 
-  data = g_task_get_task_data (priv->current_task);
-
-  if (data->enroll_progress_cb)
+  if (priv->worker_context)
     {
-      data->enroll_progress_cb (device,
-                                completed_stages,
-                                print,
-                                data->enroll_progress_data,
-                                error);
+      fpi_device_report_in_task_context (device, enroll_progress_report_cb,
+                                         completed_stages, NULL,
+                                         g_steal_pointer (&print),
+                                         g_steal_pointer (&error));
+      return;
     }
 
+  enroll_progress_report (priv->current_task, completed_stages, print, error);
+
   g_clear_error (&error);
   g_clear_object (&print);
 }
@@ -1958,7 +2201,7 @@ fpi_device_verify_report (FpDevice      *device,
   gboolean call_cb = TRUE;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_VERIFY);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_VERIFY);
   g_return_if_fail (data->result_reported == FALSE);
 
   data->result_reported = TRUE;
@@ -2004,8 +2247,16 @@ fpi_device_verify_report (FpDevice      *device,
       data->print = g_steal_pointer (&print);
     }
 
-  if (call_cb && data->match_cb)
-    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+  if (!call_cb)
+    return;
+
+  if (priv->worker_context)
+    fpi_device_report_in_task_context (device, match_report_cb, 0,
+                                       data->match ? g_object_ref (data->match) : NULL,
+                                       data->print ? g_object_ref (data->print) : NULL,
+                                       data->error ? g_error_copy (data->error) : NULL);
+  else
+    match_report (priv->current_task, data->match, data->print, data->error);
 }
 
 /**
@@ -2044,7 +2295,7 @@ fpi_device_identify_report (FpDevice *device,
   gboolean call_cb = TRUE;
 
   g_return_if_fail (FP_IS_DEVICE (device));
-  g_return_if_fail (priv->current_action == FPI_DEVICE_ACTION_IDENTIFY);
+  g_return_if_fail (fpi_device_get_current_action (device) == FPI_DEVICE_ACTION_IDENTIFY);
   g_return_if_fail (data->result_reported == FALSE);
 
   data->result_reported = TRUE;
@@ -2094,8 +2345,50 @@ fpi_device_identify_report (FpDevice *device,
         data->print = g_steal_pointer (&print);
     }
 
-  if (call_cb && data->match_cb)
-    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+  if (!call_cb)
+    return;
+
+  if (priv->worker_context)
+    fpi_device_report_in_task_context (device, match_report_cb, 0,
+                                       data->match ? g_object_ref (data->match) : NULL,
+                                       data->print ? g_object_ref (data->print) : NULL,
+                                       data->error ? g_error_copy (data->error) : NULL);
+  else
+    match_report (priv->current_task, data->match, data->print, data->error);
+}
+
+static gboolean
+update_finger_status (FpDevice           *device,
+                      FpFingerStatusFlags added_status,
+                      FpFingerStatusFlags removed_status)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autofree char *status_string = NULL;
+  FpFingerStatusFlags old_status;
+  FpFingerStatusFlags finger_status;
+
+  /* The status is reported by the driver, but also reset on the thread of
+   * the API user when opening the device. */
+  g_mutex_lock (&priv->lock);
+  old_status = priv->finger_status;
+  finger_status = (old_status | added_status) & ~removed_status;
+  priv->finger_status = finger_status;
+  g_mutex_unlock (&priv->lock);
+
+  if (old_status == finger_status)
+    return FALSE;
+
+  status_string = g_flags_to_string (FP_TYPE_FINGER_STATUS_FLAGS, finger_status);
+  fp_dbg ("Device reported finger status change: %s", status_string);
+
+  /* A finger showing up is a hint to poll again right away */
+  if ((finger_status & FP_FINGER_STATUS_PRESENT) &&
+      !(old_status & FP_FINGER_STATUS_PRESENT))
+    fpi_device_poll_wake (device);
+
+  g_object_notify (G_OBJECT (device), "finger-status");
+
+  return TRUE;
 }
 
 /**
@@ -2112,19 +2405,7 @@ gboolean
 fpi_device_report_finger_status (FpDevice           *device,
                                  FpFingerStatusFlags finger_status)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-  g_autofree char *status_string = NULL;
-
-  if (priv->finger_status == finger_status)
-    return FALSE;
-
-  status_string = g_flags_to_string (FP_TYPE_FINGER_STATUS_FLAGS, finger_status);
-  fp_dbg ("Device reported finger status change: %s", status_string);
-
-  priv->finger_status = finger_status;
-  g_object_notify (G_OBJECT (device), "finger-status");
-
-  return TRUE;
+  return update_finger_status (device, finger_status, ~finger_status);
 }
 
 /**
@@ -2144,22 +2425,235 @@ gboolean
 fpi_device_report_finger_status_changes (FpDevice           *device,
                                          FpFingerStatusFlags added_status,
                                          FpFingerStatusFlags removed_status)
+{
+  return update_finger_status (device, added_status, removed_status);
+}
+
+/**
+ * fpi_device_poll_reset:
+ * @device: The #FpDevice
+ *
+ * Go back to polling at the minimum interval for
+ * fpi_ssm_next_state_polled() and forget about earlier polls. This is done
+ * automatically when an image device is activated, other drivers should call
+ * it when they start waiting for a finger.
+ */
+void
+fpi_device_poll_reset (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
-  FpFingerStatusFlags finger_status = priv->finger_status;
 
-  finger_status |= added_status;
-  finger_status &= ~removed_status;
+  g_return_if_fail (FP_IS_DEVICE (device));
 
-  return fpi_device_report_finger_status (device, finger_status);
+  g_mutex_lock (&priv->lock);
+  priv->poll_interval_ms = priv->poll_min_ms;
+  priv->poll_fast_left = MAX (POLL_FAST_MS / priv->poll_min_ms, 1);
+  priv->poll_last_idle = 0;
+  g_mutex_unlock (&priv->lock);
 }
 
-static void
-update_temp_timeout (FpDevice *device, gpointer user_data)
+/**
+ * fpi_device_poll_wake:
+ * @device: The #FpDevice
+ *
+ * Hint that a finger may be present, e.g. because an interrupt arrived. A
+ * pending fpi_ssm_next_state_polled() fires immediately and polling goes
+ * back to the minimum interval. This is done automatically when
+ * %FP_FINGER_STATUS_PRESENT is reported.
+ */
+void
+fpi_device_poll_wake (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GSource) pending = NULL;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  g_mutex_lock (&priv->lock);
+  priv->poll_interval_ms = priv->poll_min_ms;
+  priv->poll_fast_left = MAX (POLL_FAST_MS / priv->poll_min_ms, 1);
+  pending = g_steal_pointer (&priv->poll_pending);
+  g_mutex_unlock (&priv->lock);
+
+  if (pending && !g_source_is_destroyed (pending))
+    g_source_set_ready_time (pending, 0);
+}
+
+/**
+ * fpi_device_poll_report_capture:
+ * @device: The #FpDevice
+ *
+ * Report that a finger was captured. The time since the last poll that did
+ * not find a finger is recorded as the idle poll to capture delay and polling
+ * goes back to the minimum interval. This is done automatically by
+ * fpi_image_device_image_captured().
+ */
+void
+fpi_device_poll_report_capture (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gint64 delay;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  g_mutex_lock (&priv->lock);
+  delay = priv->poll_last_idle ? g_get_monotonic_time () - priv->poll_last_idle : -1;
+  if (delay >= 0)
+    {
+      priv->poll_captures++;
+      priv->poll_delay_total += delay;
+      priv->poll_delay_max = MAX (priv->poll_delay_max, delay);
+    }
+  g_mutex_unlock (&priv->lock);
+
+  if (delay >= 0)
+    fp_dbg ("Idle poll to capture delay: %" G_GINT64_FORMAT " ms",
+            delay / 1000);
+
+  fpi_device_poll_reset (device);
+}
+
+/**
+ * fpi_device_get_poll_stats:
+ * @device: The #FpDevice
+ * @polls: (out) (optional): Number of polls scheduled
+ * @captures: (out) (optional): Number of captures with a measured delay
+ * @mean_delay_us: (out) (optional): Mean idle poll to capture delay
+ * @max_delay_us: (out) (optional): Maximum idle poll to capture delay
+ *
+ * Get the statistics of the finger polling scheduler. The delay is
+ * measured from the last poll that did not find a finger, not from the
+ * moment the finger was placed, so it is only an upper bound of the touch
+ * to capture latency.
+ */
+void
+fpi_device_get_poll_stats (FpDevice *device,
+                           guint    *polls,
+                           guint    *captures,
+                           gint64   *mean_delay_us,
+                           gint64   *max_delay_us)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  g_mutex_lock (&priv->lock);
+  if (polls)
+    *polls = priv->poll_count;
+  if (captures)
+    *captures = priv->poll_captures;
+  if (mean_delay_us)
+    *mean_delay_us = priv->poll_captures ?
+                     priv->poll_delay_total / priv->poll_captures : 0;
+  if (max_delay_us)
+    *max_delay_us = priv->poll_delay_max;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * fpi_device_copy_print_list:
+ * @prints: (element-type FpPrint): An array of prints
+ *
+ * Purely internal function to copy a list of prints for the print list
+ * cache. The prints themselves are shared.
+ *
+ * Returns: (transfer container): A new array of prints
+ */
+GPtrArray *
+fpi_device_copy_print_list (GPtrArray *prints)
+{
+  GPtrArray *copy;
+
+  copy = g_ptr_array_new_full (prints->len, g_object_unref);
+  for (guint i = 0; i < prints->len; i++)
+    g_ptr_array_add (copy, g_object_ref (g_ptr_array_index (prints, i)));
+
+  return copy;
+}
+
+/**
+ * fpi_device_invalidate_print_list_cache:
+ * @device: The #FpDevice
+ *
+ * Purely internal function to drop the cached print list, called whenever
+ * the storage of the device may have changed.
+ */
+void
+fpi_device_invalidate_print_list_cache (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_mutex_lock (&priv->lock);
+  g_clear_pointer (&priv->print_list_cache, g_ptr_array_unref);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * fpi_device_poll_next_interval:
+ * @device: The #FpDevice
+ *
+ * Purely internal function to get the delay for the next poll. The
+ * poll is counted as one that did not find a finger.
+ *
+ * Returns: The delay in milliseconds
+ */
+guint
+fpi_device_poll_next_interval (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  guint interval;
+
+  g_mutex_lock (&priv->lock);
+  priv->poll_count++;
+  priv->poll_last_idle = g_get_monotonic_time ();
+
+  if (priv->poll_fast_left > 0)
+    {
+      priv->poll_fast_left--;
+      interval = priv->poll_min_ms;
+    }
+  else
+    {
+      interval = priv->poll_interval_ms;
+      priv->poll_interval_ms = MIN (priv->poll_interval_ms * 2, priv->poll_max_ms);
+    }
+  g_mutex_unlock (&priv->lock);
+
+  return interval;
+}
+
+/**
+ * fpi_device_poll_set_pending:
+ * @device: The #FpDevice
+ * @source: The #GSource of the pending poll
+ *
+ * Purely internal function to remember the pending poll, so that
+ * fpi_device_poll_wake() can fire it early.
+ */
+void
+fpi_device_poll_set_pending (FpDevice *device,
+                             GSource  *source)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GSource) old_source = NULL;
+
+  /* The previous source may be finalized when it is released, which
+   * takes the lock to remove it from the list of timeouts. */
+  g_mutex_lock (&priv->lock);
+  old_source = g_steal_pointer (&priv->poll_pending);
+  priv->poll_pending = g_source_ref (source);
+  g_mutex_unlock (&priv->lock);
+}
+
+static gboolean
+update_temp_timeout (gpointer user_data)
 {
+  FpDevice *device = user_data;
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   fpi_device_update_temp (device, priv->temp_last_active);
+
+  return G_SOURCE_REMOVE;
 }
 
 /**
@@ -2180,6 +2674,8 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
   gdouble next_threshold;
   gdouble old_ratio;
   FpTemperature old_temp;
+  FpTemperature new_temp;
+  g_autoptr(GCancellable) cancellable = NULL;
   g_autofree char *old_temp_str = NULL;
   g_autofree char *new_temp_str = NULL;
 
@@ -2206,33 +2702,53 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
   priv->temp_last_active = is_active;
   priv->temp_last_update = now;
 
+  /* The model is only updated on the thread of the API user, but the
+   * current temperature is also read by driver code. */
   old_temp = priv->temp_current;
   if (priv->temp_current_ratio < TEMP_COLD_THRESH)
     {
-      priv->temp_current = FP_TEMPERATURE_COLD;
+      new_temp = FP_TEMPERATURE_COLD;
       next_threshold = is_active ? TEMP_COLD_THRESH : -1.0;
     }
   else if (priv->temp_current_ratio < TEMP_HOT_WARM_THRESH)
     {
-      priv->temp_current = FP_TEMPERATURE_WARM;
+      new_temp = FP_TEMPERATURE_WARM;
       next_threshold = is_active ? TEMP_WARM_HOT_THRESH : TEMP_COLD_THRESH;
     }
   else if (priv->temp_current_ratio < TEMP_WARM_HOT_THRESH)
     {
       /* Keep HOT until we reach TEMP_HOT_WARM_THRESH */
-      if (priv->temp_current != FP_TEMPERATURE_HOT)
-        priv->temp_current = FP_TEMPERATURE_WARM;
+      if (old_temp != FP_TEMPERATURE_HOT)
+        new_temp = FP_TEMPERATURE_WARM;
+      else
+        new_temp = FP_TEMPERATURE_HOT;
 
       next_threshold = is_active ? TEMP_WARM_HOT_THRESH : TEMP_HOT_WARM_THRESH;
     }
   else
     {
-      priv->temp_current = FP_TEMPERATURE_HOT;
+      new_temp = FP_TEMPERATURE_HOT;
       next_threshold = is_active ? -1.0 : TEMP_HOT_WARM_THRESH;
     }
 
+  /* If the device is HOT, then do an internal cancellation of long running tasks. */
+  g_mutex_lock (&priv->lock);
+  priv->temp_current = new_temp;
+  if (new_temp == FP_TEMPERATURE_HOT &&
+      (priv->current_action == FPI_DEVICE_ACTION_ENROLL ||
+       priv->current_action == FPI_DEVICE_ACTION_VERIFY ||
+       priv->current_action == FPI_DEVICE_ACTION_IDENTIFY ||
+       priv->current_action == FPI_DEVICE_ACTION_CAPTURE))
+    {
+      if (!priv->current_cancellation_reason)
+        priv->current_cancellation_reason = fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT);
+
+      cancellable = g_object_ref (priv->current_cancellable);
+    }
+  g_mutex_unlock (&priv->lock);
+
   old_temp_str = g_enum_to_string (FP_TYPE_TEMPERATURE, old_temp);
-  new_temp_str = g_enum_to_string (FP_TYPE_TEMPERATURE, priv->temp_current);
+  new_temp_str = g_enum_to_string (FP_TYPE_TEMPERATURE, new_temp);
   g_debug ("Updated temperature model after %0.2f seconds, ratio %0.2f -> %0.2f, active %d -> %d, %s -> %s",
            passed_seconds,
            old_ratio,
@@ -2242,23 +2758,11 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
            old_temp_str,
            new_temp_str);
 
-  if (priv->temp_current != old_temp)
+  if (new_temp != old_temp)
     g_object_notify (G_OBJECT (device), "temperature");
 
-  /* If the device is HOT, then do an internal cancellation of long running tasks. */
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
-    {
-      if (priv->current_action == FPI_DEVICE_ACTION_ENROLL ||
-          priv->current_action == FPI_DEVICE_ACTION_VERIFY ||
-          priv->current_action == FPI_DEVICE_ACTION_IDENTIFY ||
-          priv->current_action == FPI_DEVICE_ACTION_CAPTURE)
-        {
-          if (!priv->current_cancellation_reason)
-            priv->current_cancellation_reason = fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT);
-
-          g_cancellable_cancel (priv->current_cancellable);
-        }
-    }
+  if (cancellable)
+    g_cancellable_cancel (cancellable);
 
   g_clear_pointer (&priv->temp_timeout, g_source_destroy);
 
@@ -2273,8 +2777,193 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
 
   passed_seconds += TEMP_DELAY_SECONDS;
 
-  priv->temp_timeout = fpi_device_add_timeout (device,
-                                               passed_seconds * 1000,
-                                               update_temp_timeout,
-                                               NULL, NULL);
+  /* The model is updated on the thread of the API user, also if driver
+   * code runs on a worker thread. */
+  priv->temp_timeout = g_timeout_source_new (passed_seconds * 1000);
+  g_source_set_callback (priv->temp_timeout, update_temp_timeout, device, NULL);
+  g_source_attach (priv->temp_timeout,
+                   priv->worker_caller_context ?
+                   priv->worker_caller_context : fpi_device_get_context (device));
+  g_source_unref (priv->temp_timeout);
+}
+
+/* Calibration data is kept for the lifetime of the process, so that it
+ * survives the #FpDevice being closed or re-created after a hotplug.
+ */
+typedef struct
+{
+  GBytes       *data;
+  gint64        saved_time;
+  FpTemperature temperature;
+} FpiCalibrationEntry;
+
+G_LOCK_DEFINE_STATIC (calibration_cache);
+static GHashTable *calibration_cache = NULL;
+
+static void
+calibration_entry_free (FpiCalibrationEntry *entry)
+{
+  g_bytes_unref (entry->data);
+  g_free (entry);
+}
+
+static gchar *
+calibration_cache_key (FpDevice *device, const gchar *firmware)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  const gchar *location = NULL;
+
+  switch (priv->type)
+    {
+    case FP_DEVICE_TYPE_USB:
+      location = g_usb_device_get_platform_id (priv->usb_device);
+      break;
+
+    case FP_DEVICE_TYPE_UDEV:
+      location = priv->udev_data.spidev_path;
+      if (!location)
+        location = priv->udev_data.hidraw_path;
+      break;
+
+    case FP_DEVICE_TYPE_VIRTUAL:
+      location = priv->virtual_env;
+      break;
+    }
+
+  return g_strdup_printf ("%s|%s|%s", fp_device_get_driver (device),
+                          location ? location : "", firmware);
+}
+
+/**
+ * fpi_device_calibration_save:
+ * @device: The #FpDevice
+ * @firmware: A string identifying the sensor and firmware version
+ * @data: The calibration data
+ *
+ * Store calibration data, e.g. register values and a background frame, so
+ * that a later activation of the same physical device can skip calibration.
+ * The data is kept in memory for the lifetime of the process, keyed by the
+ * driver, the location of the device and @firmware.
+ */
+void
+fpi_device_calibration_save (FpDevice    *device,
+                             const gchar *firmware,
+                             GBytes      *data)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpiCalibrationEntry *entry;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (firmware != NULL);
+  g_return_if_fail (data != NULL);
+
+  entry = g_new0 (FpiCalibrationEntry, 1);
+  entry->data = g_bytes_ref (data);
+  entry->saved_time = g_get_monotonic_time ();
+  g_mutex_lock (&priv->lock);
+  entry->temperature = priv->temp_current;
+  g_mutex_unlock (&priv->lock);
+
+  G_LOCK (calibration_cache);
+  if (!calibration_cache)
+    calibration_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) calibration_entry_free);
+  g_hash_table_replace (calibration_cache,
+                        calibration_cache_key (device, firmware), entry);
+  G_UNLOCK (calibration_cache);
+
+  fp_dbg ("Saved %" G_GSIZE_FORMAT " bytes of calibration data",
+          g_bytes_get_size (data));
+}
+
+/**
+ * fpi_device_calibration_load:
+ * @device: The #FpDevice
+ * @firmware: A string identifying the sensor and firmware version
+ * @max_age_seconds: The maximum age of the data, or 0 for no limit
+ *
+ * Retrieve calibration data stored with fpi_device_calibration_save(). Data
+ * older than @max_age_seconds or saved while the device was at a different
+ * #FpTemperature is considered stale and dropped.
+ *
+ * The driver must still check that the data is valid for the sensor, e.g. by
+ * comparing a fresh frame with the stored background, and call
+ * fpi_device_calibration_clear() if it is not.
+ *
+ * Returns: (transfer full) (nullable): The calibration data or %NULL
+ */
+GBytes *
+fpi_device_calibration_load (FpDevice    *device,
+                             const gchar *firmware,
+                             guint        max_age_seconds)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpiCalibrationEntry *entry = NULL;
+  g_autofree gchar *key = NULL;
+  GBytes *data = NULL;
+  FpTemperature temperature;
+
+  g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
+  g_return_val_if_fail (firmware != NULL, NULL);
+
+  key = calibration_cache_key (device, firmware);
+
+  g_mutex_lock (&priv->lock);
+  temperature = priv->temp_current;
+  g_mutex_unlock (&priv->lock);
+
+  G_LOCK (calibration_cache);
+  if (calibration_cache)
+    entry = g_hash_table_lookup (calibration_cache, key);
+
+  if (entry && max_age_seconds > 0 &&
+      g_get_monotonic_time () - entry->saved_time > (gint64) max_age_seconds * G_USEC_PER_SEC)
+    {
+      fp_dbg ("Dropping stale calibration data");
+      g_hash_table_remove (calibration_cache, key);
+    }
+  else if (entry && entry->temperature != temperature)
+    {
+      fp_dbg ("Dropping calibration data, device temperature changed");
+      g_hash_table_remove (calibration_cache, key);
+    }
+  else if (entry)
+    {
+      data = g_bytes_ref (entry->data);
+    }
+  G_UNLOCK (calibration_cache);
+
+  fp_dbg ("Calibration data %s", data ? "found" : "not found");
+
+  return data;
+}
+
+/**
+ * fpi_device_calibration_clear:
+ * @device: The #FpDevice
+ *
+ * Drop all calibration data stored for @device, e.g. because it turned out
+ * to be invalid or the sensor was recalibrated.
+ */
+void
+fpi_device_calibration_clear (FpDevice *device)
+{
+  g_autofree gchar *prefix = NULL;
+  GHashTableIter iter;
+  const gchar *key;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  /* The key ends with the firmware string */
+  prefix = calibration_cache_key (device, "");
+
+  G_LOCK (calibration_cache);
+  if (calibration_cache)
+    {
+      g_hash_table_iter_init (&iter, calibration_cache);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &key, NULL))
+        if (g_str_has_prefix (key, prefix))
+          g_hash_table_iter_remove (&iter);
+    }
+  G_UNLOCK (calibration_cache);
 }
@@ -86,6 +86,10 @@ struct _FpIdEntry
  *   after being mostly cold. Set to -1 if the device can be always-on.
  * @temp_cold_seconds: Assumed time in seconds for the device to be mostly cold
  *   after having been too hot to operate.
+ * @poll_min_ms: Shortest interval in ms for fpi_ssm_next_state_polled(), used
+ *   right after activation or a touch. Defaults to 10 ms if unset.
+ * @poll_max_ms: Longest interval in ms for fpi_ssm_next_state_polled() that
+ *   an idle device backs off to. Defaults to 250 ms if unset.
  * @usb_discover: Class method to check whether a USB device is supported by
  *  the driver. Should return 0 if the device is unsupported and a positive
  *  score otherwise. The default score is 50 and the driver with the highest
@@ -157,6 +161,10 @@ struct _FpDeviceClass
   gint32 temp_hot_seconds;
   gint32 temp_cold_seconds;
 
+  /* Finger polling scheduler limits */
+  guint poll_min_ms;
+  guint poll_max_ms;
+
   /* Callbacks */
   gint (*usb_discover) (GUsbDevice *usb_device);
   void (*probe)    (FpDevice *device);
@@ -325,4 +333,21 @@ gboolean fpi_device_report_finger_status_changes (FpDevice           *device,
                                                   FpFingerStatusFlags added_status,
                                                   FpFingerStatusFlags removed_status);
 
+void fpi_device_poll_reset (FpDevice *device);
+void fpi_device_poll_wake (FpDevice *device);
+void fpi_device_poll_report_capture (FpDevice *device);
+void fpi_device_get_poll_stats (FpDevice *device,
+                                guint    *polls,
+                                guint    *captures,
+                                gint64   *mean_delay_us,
+                                gint64   *max_delay_us);
+
+void fpi_device_calibration_save (FpDevice    *device,
+                                  const gchar *firmware,
+                                  GBytes      *data);
+GBytes *fpi_device_calibration_load (FpDevice    *device,
+                                     const gchar *firmware,
+                                     guint        max_age_seconds);
+void fpi_device_calibration_clear (FpDevice *device);
+
 G_END_DECLS
@@ -492,6 +492,8 @@ fpi_image_device_image_captured (FpImageDevice *self, FpImage *image)
 
   g_debug ("Image device captured an image");
 
+  fpi_device_poll_report_capture (FP_DEVICE (self));
+
   priv->minutiae_scan_active = TRUE;
 
   /* XXX: We also detect minutiae in capture mode, we solely do this
@@ -562,6 +564,30 @@ fpi_image_device_retry_scan (FpImageDevice *self, FpDeviceRetry retry)
     }
 }
 
+/**
+ * fpi_image_device_new_image:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @width: Width of the image
+ * @height: Height of the image
+ *
+ * Creates a new #FpImage for a capture. This is the same as fp_image_new(),
+ * but the pixel buffers are recycled through a per-device pool, so that
+ * devices capturing images continuously do not need to allocate new memory
+ * for every image. The pixel data is not cleared, the driver needs to fill
+ * all of it.
+ *
+ * Returns: (transfer full): A new #FpImage
+ */
+FpImage *
+fpi_image_device_new_image (FpImageDevice *self,
+                            gint           width,
+                            gint           height)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  return fpi_image_new_pooled (priv->image_pool, width, height);
+}
+
 /**
  * fpi_image_device_session_error:
  * @self: a #FpImageDevice imaging fingerprint device
@@ -653,6 +679,7 @@ fpi_image_device_activate_complete (FpImageDevice *self, GError *error)
   g_debug ("Image device activation completed");
 
   priv->active = TRUE;
+  fpi_device_poll_reset (FP_DEVICE (self));
 
   /* We always want to capture at this point, move to AWAIT_FINGER
    * state. */
@@ -735,6 +762,16 @@ fpi_image_device_close_complete (FpImageDevice *self, GError *error)
   g_return_if_fail (priv->active == FALSE);
   g_return_if_fail (action == FPI_DEVICE_ACTION_CLOSE);
 
+  if (priv->image_pool)
+    {
+      guint hits, misses;
+      gsize cached;
+
+      fpi_image_pool_get_stats (priv->image_pool, &hits, &misses, &cached);
+      fp_dbg ("Image buffer pool: %u hits, %u misses, %" G_GSIZE_FORMAT " bytes cached",
+              hits, misses, cached);
+    }
+
   priv->state = FPI_IMAGE_DEVICE_STATE_INACTIVE;
   g_object_notify (G_OBJECT (self), "fpi-image-device-state");
 
@@ -137,3 +137,7 @@ void fpi_image_device_image_captured (FpImageDevice *self,
                                       FpImage       *image);
 void fpi_image_device_retry_scan (FpImageDevice *self,
                                   FpDeviceRetry  retry);
+
+FpImage *fpi_image_device_new_image (FpImageDevice *self,
+                                     gint           width,
+                                     gint           height);
@@ -26,8 +26,8 @@
 #include <nbis.h>
 #include <config.h>
 
-#ifdef HAVE_PIXMAN
-#include <pixman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
 #endif
 
 /**
@@ -38,6 +38,144 @@
  * Internal image handling routines. See #FpImage for public routines.
  */
 
+/* Number of pixels that can be accumulated into 32 bit partial sums without
+ * risking an overflow (255 * 255 * 16384 < 2^32). The totals are kept in
+ * 64 bit so that arbitrarily large frames work. */
+#define STATS_BLOCK_SIZE 16384
+
+#ifdef __SSE2__
+static inline guint32
+hsum_epi32 (__m128i v)
+{
+  v = _mm_add_epi32 (v, _mm_shuffle_epi32 (v, _MM_SHUFFLE (1, 0, 3, 2)));
+  v = _mm_add_epi32 (v, _mm_shuffle_epi32 (v, _MM_SHUFFLE (2, 3, 0, 1)));
+
+  return _mm_cvtsi128_si32 (v);
+}
+#endif
+
+/* Sums the pixels of one block and their squares. With SSE2, psadbw sums
+ * 8 pixels at a time into 64 bit lanes and pmaddwd squares the pixels
+ * widened to 16 bit, adding neighbouring lanes into 32 bit. The remaining
+ * pixels are handled by the scalar loop. */
+static inline void
+block_sum_sq_sum (const guint8 *buf,
+                  gint          n,
+                  guint32      *sum,
+                  guint32      *sq_sum)
+{
+  guint32 s = 0, sq = 0;
+  gint j = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i s_acc = zero, sq_acc = zero;
+
+  for (; j + 16 <= n; j += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (buf + j));
+      __m128i lo = _mm_unpacklo_epi8 (v, zero);
+      __m128i hi = _mm_unpackhi_epi8 (v, zero);
+
+      s_acc = _mm_add_epi64 (s_acc, _mm_sad_epu8 (v, zero));
+      sq_acc = _mm_add_epi32 (sq_acc, _mm_madd_epi16 (lo, lo));
+      sq_acc = _mm_add_epi32 (sq_acc, _mm_madd_epi16 (hi, hi));
+    }
+
+  s = _mm_cvtsi128_si32 (s_acc) + _mm_cvtsi128_si32 (_mm_srli_si128 (s_acc, 8));
+  sq = hsum_epi32 (sq_acc);
+#endif
+
+  for (; j < n; j++)
+    {
+      guint32 v = buf[j];
+
+      s += v;
+      sq += v * v;
+    }
+
+  *sum = s;
+  *sq_sum = sq;
+}
+
+/* Sums the squared differences of one block, the differences are kept in
+ * signed 16 bit lanes for pmaddwd. */
+static inline guint32
+block_sq_diff_sum (const guint8 *buf1,
+                   const guint8 *buf2,
+                   gint          n)
+{
+  guint32 res = 0;
+  gint j = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i acc = zero;
+
+  for (; j + 16 <= n; j += 16)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (buf1 + j));
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (buf2 + j));
+      __m128i lo = _mm_sub_epi16 (_mm_unpacklo_epi8 (a, zero),
+                                  _mm_unpacklo_epi8 (b, zero));
+      __m128i hi = _mm_sub_epi16 (_mm_unpackhi_epi8 (a, zero),
+                                  _mm_unpackhi_epi8 (b, zero));
+
+      acc = _mm_add_epi32 (acc, _mm_madd_epi16 (lo, lo));
+      acc = _mm_add_epi32 (acc, _mm_madd_epi16 (hi, hi));
+    }
+
+  res = hsum_epi32 (acc);
+#endif
+
+  for (; j < n; j++)
+    {
+      gint32 dev = (gint32) buf1[j] - (gint32) buf2[j];
+
+      res += dev * dev;
+    }
+
+  return res;
+}
+
+static inline void
+sum_sq_sum (const guint8 *buf,
+            gint          size,
+            guint64      *sum,
+            guint64      *sq_sum)
+{
+  guint64 s = 0, sq = 0;
+  gint i;
+
+  for (i = 0; i < size; i += STATS_BLOCK_SIZE)
+    {
+      guint32 block_s, block_sq;
+
+      block_sum_sq_sum (buf + i, MIN (size - i, STATS_BLOCK_SIZE),
+                        &block_s, &block_sq);
+      s += block_s;
+      sq += block_sq;
+    }
+
+  *sum = s;
+  *sq_sum = sq;
+}
+
+static inline guint64
+sq_diff_sum (const guint8 *buf1,
+             const guint8 *buf2,
+             gint          size)
+{
+  guint64 res = 0;
+  gint i;
+
+  for (i = 0; i < size; i += STATS_BLOCK_SIZE)
+    res += block_sq_diff_sum (buf1 + i, buf2 + i,
+                              MIN (size - i, STATS_BLOCK_SIZE));
+
+  return res;
+}
+
 /**
  * fpi_std_sq_dev:
  * @buf: buffer (usually bitmap, one byte per pixel)
@@ -58,21 +196,43 @@ gint
 fpi_std_sq_dev (const guint8 *buf,
                 gint          size)
 {
-  guint64 res = 0, mean = 0;
-  gint i;
+  guint64 sum, sq_sum, mean;
 
-  for (i = 0; i < size; i++)
-    mean += buf[i];
+  g_return_val_if_fail (size > 0, 0);
 
-  mean /= size;
+  sum_sq_sum (buf, size, &sum, &sq_sum);
 
-  for (i = 0; i < size; i++)
-    {
-      int dev = (int) buf[i] - mean;
-      res += dev * dev;
-    }
+  /* The (integer) mean is needed for the result to be identical to the
+   * two pass calculation, expand sum ((buf[i] - mean) ^ 2) which gives
+   * sq_sum - 2 * mean * sum + size * mean ^ 2. */
+  mean = sum / size;
+
+  return (sq_sum + size * mean * mean - 2 * mean * sum) / size;
+}
+
+/**
+ * fpi_std_sq_dev_batch:
+ * @buf: buffer containing @count frames or lines
+ * @size: size of each frame or line
+ * @stride: distance in bytes between the start of consecutive frames
+ * @count: number of frames or lines
+ * @results: (out caller-allocates) (array length=count): return location
+ *   for the results
+ *
+ * Calculates fpi_std_sq_dev() for @count frames or lines stored in one
+ * buffer, e.g. a chunk of lines as received from the device.
+ */
+void
+fpi_std_sq_dev_batch (const guint8 *buf,
+                      gint          size,
+                      gint          stride,
+                      gint          count,
+                      gint         *results)
+{
+  gint i;
 
-  return res / size;
+  for (i = 0; i < count; i++)
+    results[i] = fpi_std_sq_dev (buf + i * stride, size);
 }
 
 /**
@@ -97,58 +257,507 @@ fpi_mean_sq_diff_norm (const guint8 *buf1,
                        const guint8 *buf2,
                        gint          size)
 {
-  int res = 0, i;
+  g_return_val_if_fail (size > 0, 0);
+
+  return sq_diff_sum (buf1, buf2, size) / size;
+}
+
+/**
+ * fpi_percentiles_u16:
+ * @buf: buffer of 16 bit values, usually raw sensor data
+ * @size: number of values in @buf
+ * @ranks: (array length=n_ranks): positions in the sorted values, in
+ *   ascending order
+ * @values: (out caller-allocates) (array length=n_ranks): return location
+ *   for the values
+ * @n_ranks: number of ranks
+ *
+ * Finds the values that would be at the positions @ranks if @buf was
+ * sorted in ascending order, e.g. rank 0 is the minimum and rank @size - 1
+ * the maximum. The values are selected using a histogram of the upper byte
+ * followed by one of the lower byte for every 256 value range that
+ * contains one of the ranks. This does not modify @buf and takes linear
+ * time, which is a lot cheaper than sorting a copy of the data.
+ */
+void
+fpi_percentiles_u16 (const guint16 *buf,
+                     gint           size,
+                     const gint    *ranks,
+                     guint16       *values,
+                     gint           n_ranks)
+{
+  guint hi[256] = { 0, };
+  guint lo[256];
+  gint lo_bin = -1;
+  guint below = 0;
+  gint bin = 0;
+  gint i, r;
+
+  for (r = 0; r < n_ranks; r++)
+    g_return_if_fail (ranks[r] >= (r > 0 ? ranks[r - 1] : 0) && ranks[r] < size);
 
   for (i = 0; i < size; i++)
+    hi[buf[i] >> 8]++;
+
+  for (r = 0; r < n_ranks; r++)
     {
-      int dev = (int) buf1[i] - (int) buf2[i];
-      res += dev * dev;
+      guint rank;
+      gint v;
+
+      /* The ranks are ascending, so the search continues from the bin
+       * of the previous one */
+      while (below + hi[bin] <= (guint) ranks[r])
+        below += hi[bin++];
+
+      if (bin != lo_bin)
+        {
+          memset (lo, 0, sizeof (lo));
+          for (i = 0; i < size; i++)
+            if ((buf[i] >> 8) == bin)
+              lo[buf[i] & 0xff]++;
+          lo_bin = bin;
+        }
+
+      rank = ranks[r] - below;
+      for (v = 0; lo[v] <= rank; v++)
+        rank -= lo[v];
+
+      values[r] = bin << 8 | v;
+    }
+}
+
+/* Sets up the source column (offset by one for the zero padding) and the
+ * 8 bit interpolation weight for each destination column. The fixed point
+ * arithmetic is the same as the one pixman uses for a bilinear scale
+ * transform, i.e. sampling at the pixel centers, 16.16 fixed point
+ * coordinates that are advanced by the (truncated) inverse of the factor and
+ * 7 bit interpolation weights. */
+static void
+bilinear_setup (guint    dst_size,
+                guint    factor,
+                gint    *index,
+                guint16 *weight)
+{
+  gint32 inv = 65536 / factor;
+  gint32 pos = (inv * 32768 + 32768) >> 16;
+  guint i;
+
+  for (i = 0; i < dst_size; i++)
+    {
+      gint32 p = pos - 32768;
+
+      /* Floor division, index -1 refers to the zero padding */
+      index[i] = (p >> 16) + 1;
+      weight[i] = ((p >> 9) & 0x7f) << 1;
+
+      pos += inv;
+    }
+}
+
+/* Horizontally interpolates one (zero padded) source row. The result is
+ * kept with 16 bit precision so that the vertical pass gives exactly the
+ * same result as interpolating all four pixels at once. */
+static void
+bilinear_row (const guint8  *padded_row,
+              const gint    *x_index,
+              const guint16 *x_weight,
+              guint          dst_width,
+              guint16       *out)
+{
+  guint x;
+
+  for (x = 0; x < dst_width; x++)
+    {
+      guint16 w = x_weight[x];
+
+      out[x] = padded_row[x_index[x]] * (256 - w) +
+               padded_row[x_index[x] + 1] * w;
+    }
+}
+
+static void
+resize_bilinear (const guint8 *src,
+                 guint         width,
+                 guint         height,
+                 guint         w_factor,
+                 guint         h_factor,
+                 guint8       *dst)
+{
+  guint new_width = width * w_factor;
+  guint new_height = height * h_factor;
+  g_autofree gint *x_index = g_new (gint, new_width);
+  g_autofree guint16 *x_weight = g_new (guint16, new_width);
+  g_autofree gint *y_index = g_new (gint, new_height);
+  g_autofree guint16 *y_weight = g_new (guint16, new_height);
+  g_autofree guint8 *padded_row = g_malloc0 (width + 2);
+  g_autofree guint16 *rows = g_new (guint16, 2 * new_width);
+  guint16 *row1 = rows, *row2 = rows + new_width;
+  /* Row -1 is a valid (all zero) source row, so use -2 as invalid index */
+  gint row1_index = -2, row2_index = -2;
+  guint x, y;
+
+  bilinear_setup (new_width, w_factor, x_index, x_weight);
+  bilinear_setup (new_height, h_factor, y_index, y_weight);
+
+  for (y = 0; y < new_height; y++)
+    {
+      /* Source rows y_index - 1 and y_index, outside of the image the
+       * pixels are zero (i.e. no repeat). Rows only move forward, so
+       * each interpolated source row is computed only once. */
+      gint top = y_index[y] - 1;
+      guint32 wy = y_weight[y];
+
+      if (row2_index == top)
+        {
+          guint16 *tmp = row1;
+
+          row1 = row2;
+          row2 = tmp;
+          row1_index = top;
+          row2_index = -2;
+        }
+
+      if (row1_index != top)
+        {
+          if (top >= 0 && top < (gint) height)
+            {
+              memcpy (padded_row + 1, src + top * width, width);
+              bilinear_row (padded_row, x_index, x_weight, new_width, row1);
+            }
+          else
+            {
+              memset (row1, 0, new_width * sizeof (guint16));
+            }
+          row1_index = top;
+        }
+
+      if (row2_index != top + 1)
+        {
+          if (top + 1 >= 0 && top + 1 < (gint) height)
+            {
+              memcpy (padded_row + 1, src + (top + 1) * width, width);
+              bilinear_row (padded_row, x_index, x_weight, new_width, row2);
+            }
+          else
+            {
+              memset (row2, 0, new_width * sizeof (guint16));
+            }
+          row2_index = top + 1;
+        }
+
+      for (x = 0; x < new_width; x++)
+        dst[x] = (row1[x] * (256 - wy) + row2[x] * wy) >> 16;
+
+      dst += new_width;
     }
+}
+
+static void
+resize_nearest (const guint8 *src,
+                guint         width,
+                guint         height,
+                guint         w_factor,
+                guint         h_factor,
+                guint8       *dst)
+{
+  guint new_width = width * w_factor;
+  guint x, y, i;
+
+  for (y = 0; y < height; y++)
+    {
+      const guint8 *row = src + y * width;
+
+      for (x = 0; x < new_width; x++)
+        dst[x] = row[x / w_factor];
+
+      /* Replicate the row for the remaining lines */
+      for (i = 1; i < h_factor; i++)
+        memcpy (dst + i * new_width, dst, new_width);
 
-  return res / size;
+      dst += h_factor * new_width;
+    }
 }
 
+/**
+ * fpi_image_resize_full:
+ * @orig: The #FpImage to resize
+ * @w_factor: Horizontal factor to upscale by
+ * @h_factor: Vertical factor to upscale by
+ * @filter: The #FpiImageResizeFilter to use
+ *
+ * Upscales an image by integer factors into a new image. The bilinear
+ * filter gives the same result as a pixman bilinear scale transform
+ * (without repeat) would.
+ *
+ * Returns: (transfer full): A new #FpImage
+ */
+FpImage *
+fpi_image_resize_full (FpImage             *orig,
+                       guint                w_factor,
+                       guint                h_factor,
+                       FpiImageResizeFilter filter)
+{
+  FpImage *newimg;
+
+  g_return_val_if_fail (FP_IS_IMAGE (orig), NULL);
+  g_return_val_if_fail (w_factor > 0 && h_factor > 0, NULL);
+
+  newimg = fpi_image_new_pooled (orig->pool,
+                                 orig->width * w_factor,
+                                 orig->height * h_factor);
+  newimg->flags = orig->flags;
+
+  switch (filter)
+    {
+    case FPI_IMAGE_RESIZE_NEAREST:
+      resize_nearest (orig->data, orig->width, orig->height,
+                      w_factor, h_factor, newimg->data);
+      break;
+
+    case FPI_IMAGE_RESIZE_BILINEAR:
+    default:
+      resize_bilinear (orig->data, orig->width, orig->height,
+                       w_factor, h_factor, newimg->data);
+      break;
+    }
+
+  return newimg;
+}
+
+/**
+ * fpi_image_resize:
+ * @orig: The #FpImage to resize
+ * @w_factor: Horizontal factor to upscale by
+ * @h_factor: Vertical factor to upscale by
+ *
+ * Upscales an image by integer factors using bilinear interpolation,
+ * see fpi_image_resize_full().
+ *
+ * Returns: (transfer full): A new #FpImage
+ */
 FpImage *
-fpi_image_resize (FpImage *orig_img,
+fpi_image_resize (FpImage *orig,
                   guint    w_factor,
                   guint    h_factor)
 {
-#ifdef HAVE_PIXMAN
-  int new_width = orig_img->width * w_factor;
-  int new_height = orig_img->height * h_factor;
-  pixman_image_t *orig, *resized;
-  pixman_transform_t transform;
-  FpImage *newimg;
+  return fpi_image_resize_full (orig, w_factor, h_factor,
+                                FPI_IMAGE_RESIZE_BILINEAR);
+}
 
-  orig = pixman_image_create_bits (PIXMAN_a8, orig_img->width, orig_img->height, (uint32_t *) orig_img->data, orig_img->width);
-  resized = pixman_image_create_bits (PIXMAN_a8, new_width, new_height, NULL, new_width);
+struct _FpiImagePool
+{
+  GMutex      lock;
+  GHashTable *buffers;
+  gsize       max_cached;
+  gsize       cached;
+  guint       hits;
+  guint       misses;
+};
 
-  pixman_transform_init_identity (&transform);
-  pixman_transform_scale (NULL, &transform, pixman_int_to_fixed (w_factor), pixman_int_to_fixed (h_factor));
-  pixman_image_set_transform (orig, &transform);
-  pixman_image_set_filter (orig, PIXMAN_FILTER_BILINEAR, NULL, 0);
-  pixman_image_composite32 (PIXMAN_OP_SRC,
-                            orig, /* src */
-                            NULL, /* mask */
-                            resized, /* dst */
-                            0, 0, /* src x y */
-                            0, 0, /* mask x y */
-                            0, 0, /* dst x y */
-                            new_width, new_height /* width height */
-                           );
+/**
+ * fpi_image_pool_new:
+ * @max_cached: The maximum number of bytes to keep around for reuse
+ *
+ * Creates a new pool that recycles buffers, e.g. the pixel data of
+ * #FpImage objects created with fpi_image_new_pooled(). Buffers are kept
+ * per size, so a device producing images of the same dimensions will
+ * get its buffers back rather than allocating new ones for each capture.
+ *
+ * The pool is reference counted and can be used from any thread.
+ *
+ * Returns: (transfer full): A new #FpiImagePool
+ */
+FpiImagePool *
+fpi_image_pool_new (gsize max_cached)
+{
+  FpiImagePool *pool = g_atomic_rc_box_new0 (FpiImagePool);
 
-  newimg = fp_image_new (new_width, new_height);
-  newimg->flags = orig_img->flags;
+  g_mutex_init (&pool->lock);
+  pool->buffers = g_hash_table_new_full (NULL, NULL, NULL,
+                                         (GDestroyNotify) g_ptr_array_unref);
+  pool->max_cached = max_cached;
 
-  memcpy (newimg->data, pixman_image_get_data (resized), new_width * new_height);
+  return pool;
+}
 
-  pixman_image_unref (orig);
-  pixman_image_unref (resized);
+/**
+ * fpi_image_pool_ref:
+ * @pool: A #FpiImagePool
+ *
+ * Increments the reference count of @pool.
+ *
+ * Returns: (transfer full): @pool
+ */
+FpiImagePool *
+fpi_image_pool_ref (FpiImagePool *pool)
+{
+  g_return_val_if_fail (pool, NULL);
 
-  return newimg;
-#else
-  fp_err ("Libfprint compiled without pixman support, impossible to resize");
+  return g_atomic_rc_box_acquire (pool);
+}
 
-  return g_object_ref (orig_img);
-#endif
+static void
+fpi_image_pool_clear (FpiImagePool *pool)
+{
+  g_hash_table_destroy (pool->buffers);
+  g_mutex_clear (&pool->lock);
+}
+
+/**
+ * fpi_image_pool_unref:
+ * @pool: A #FpiImagePool
+ *
+ * Decrements the reference count of @pool, freeing all cached buffers
+ * once it drops to zero.
+ */
+void
+fpi_image_pool_unref (FpiImagePool *pool)
+{
+  g_return_if_fail (pool);
+
+  g_atomic_rc_box_release_full (pool, (GDestroyNotify) fpi_image_pool_clear);
+}
+
+/**
+ * fpi_image_pool_alloc:
+ * @pool: (nullable): A #FpiImagePool
+ * @size: The size of the buffer
+ *
+ * Takes a buffer of @size bytes from the pool, allocating a new one if
+ * none is cached. The content of the buffer is undefined. If @pool is
+ * %NULL, this is the same as g_malloc().
+ *
+ * Returns: (transfer full): A buffer to be returned with
+ *   fpi_image_pool_release()
+ */
+gpointer
+fpi_image_pool_alloc (FpiImagePool *pool, gsize size)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+  GPtrArray *free_buffers;
+
+  if (!pool)
+    return g_malloc (size);
+
+  locker = g_mutex_locker_new (&pool->lock);
+
+  free_buffers = g_hash_table_lookup (pool->buffers, GSIZE_TO_POINTER (size));
+  if (free_buffers && free_buffers->len > 0)
+    {
+      pool->hits++;
+      pool->cached -= size;
+
+      return g_ptr_array_steal_index_fast (free_buffers, free_buffers->len - 1);
+    }
+
+  pool->misses++;
+
+  return g_malloc (size);
+}
+
+/**
+ * fpi_image_pool_release:
+ * @pool: (nullable): A #FpiImagePool
+ * @buffer: (nullable) (transfer full): The buffer to return
+ * @size: The size of @buffer
+ *
+ * Returns a buffer allocated with g_malloc() or fpi_image_pool_alloc() to
+ * the pool. The buffer is freed if @pool is %NULL or if keeping it would
+ * exceed the maximum size of the pool.
+ */
+void
+fpi_image_pool_release (FpiImagePool *pool, gpointer buffer, gsize size)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+  GPtrArray *free_buffers;
+
+  if (!buffer)
+    return;
+
+  if (!pool || size == 0)
+    {
+      g_free (buffer);
+      return;
+    }
+
+  locker = g_mutex_locker_new (&pool->lock);
+
+  if (pool->cached + size > pool->max_cached)
+    {
+      g_free (buffer);
+      return;
+    }
+
+  free_buffers = g_hash_table_lookup (pool->buffers, GSIZE_TO_POINTER (size));
+  if (!free_buffers)
+    {
+      free_buffers = g_ptr_array_new_with_free_func (g_free);
+      g_hash_table_insert (pool->buffers, GSIZE_TO_POINTER (size), free_buffers);
+    }
+
+  g_ptr_array_add (free_buffers, buffer);
+  pool->cached += size;
+}
+
+/**
+ * fpi_image_pool_get_stats:
+ * @pool: A #FpiImagePool
+ * @hits: (out) (optional): Number of allocations served from the pool
+ * @misses: (out) (optional): Number of allocations that needed new memory
+ * @cached: (out) (optional): Number of bytes currently kept for reuse
+ *
+ * Retrieves usage statistics of the pool.
+ */
+void
+fpi_image_pool_get_stats (FpiImagePool *pool,
+                          guint        *hits,
+                          guint        *misses,
+                          gsize        *cached)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+
+  g_return_if_fail (pool);
+
+  locker = g_mutex_locker_new (&pool->lock);
+
+  if (hits)
+    *hits = pool->hits;
+  if (misses)
+    *misses = pool->misses;
+  if (cached)
+    *cached = pool->cached;
+}
+
+/**
+ * fpi_image_new_pooled:
+ * @pool: (nullable): A #FpiImagePool
+ * @width: Width of the image
+ * @height: Height of the image
+ *
+ * Creates a new #FpImage like fp_image_new(), but with the pixel data
+ * taken from @pool. Unlike with fp_image_new(), the pixel data is not
+ * cleared, the caller needs to fill all of it. The image keeps a reference
+ * to the pool and returns its buffers to it when finalized.
+ *
+ * Returns: (transfer full): A new #FpImage
+ */
+FpImage *
+fpi_image_new_pooled (FpiImagePool *pool,
+                      gint          width,
+                      gint          height)
+{
+  FpImage *self;
+
+  if (!pool)
+    return fp_image_new (width, height);
+
+  /* Create an empty image, and assign the buffer from the pool */
+  self = g_object_new (FP_TYPE_IMAGE, NULL);
+  self->width = width;
+  self->height = height;
+  self->pool = fpi_image_pool_ref (pool);
+  self->data_size = (gsize) width * height;
+  self->data = fpi_image_pool_alloc (pool, self->data_size);
+
+  return self;
 }
@@ -40,6 +40,26 @@ typedef enum {
   FPI_IMAGE_PARTIAL         = 1 << 3,
 } FpiImageFlags;
 
+/**
+ * FpiImageResizeFilter:
+ * @FPI_IMAGE_RESIZE_BILINEAR: Bilinear interpolation
+ * @FPI_IMAGE_RESIZE_NEAREST: Nearest neighbour, i.e. pixel replication
+ *
+ * The interpolation used by fpi_image_resize_full().
+ */
+typedef enum {
+  FPI_IMAGE_RESIZE_BILINEAR,
+  FPI_IMAGE_RESIZE_NEAREST,
+} FpiImageResizeFilter;
+
+/**
+ * FpiImagePool:
+ *
+ * A thread safe pool that recycles image sized buffers, see
+ * fpi_image_pool_new().
+ */
+typedef struct _FpiImagePool FpiImagePool;
+
 /**
  * FpImage:
  * @width: Width of the image
@@ -70,6 +90,12 @@ struct _FpImage
   GPtrArray *minutiae;
 
   gboolean   detection_in_progress;
+
+  /* Buffers are returned to the pool with the size they were allocated
+   * with, width and height may be changed by drivers. */
+  FpiImagePool *pool;
+  gsize         data_size;
+  gsize         binarized_size;
 };
 
 gint fpi_std_sq_dev (const guint8 *buf,
@@ -77,7 +103,40 @@ gint fpi_std_sq_dev (const guint8 *buf,
 gint fpi_mean_sq_diff_norm (const guint8 *buf1,
                             const guint8 *buf2,
                             gint          size);
+void fpi_std_sq_dev_batch (const guint8 *buf,
+                           gint          size,
+                           gint          stride,
+                           gint          count,
+                           gint         *results);
+void fpi_percentiles_u16 (const guint16 *buf,
+                          gint           size,
+                          const gint    *ranks,
+                          guint16       *values,
+                          gint           n_ranks);
 
 FpImage *fpi_image_resize (FpImage *orig,
                            guint    w_factor,
                            guint    h_factor);
+FpImage *fpi_image_resize_full (FpImage             *orig,
+                                guint                w_factor,
+                                guint                h_factor,
+                                FpiImageResizeFilter filter);
+
+FpiImagePool *fpi_image_pool_new (gsize max_cached);
+FpiImagePool *fpi_image_pool_ref (FpiImagePool *pool);
+void          fpi_image_pool_unref (FpiImagePool *pool);
+gpointer      fpi_image_pool_alloc (FpiImagePool *pool,
+                                    gsize         size);
+void          fpi_image_pool_release (FpiImagePool *pool,
+                                      gpointer      buffer,
+                                      gsize         size);
+void          fpi_image_pool_get_stats (FpiImagePool *pool,
+                                        guint        *hits,
+                                        guint        *misses,
+                                        gsize        *cached);
+
+FpImage      *fpi_image_new_pooled (FpiImagePool *pool,
+                                    gint          width,
+                                    gint          height);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiImagePool, fpi_image_pool_unref)
@@ -0,0 +1,207 @@
+/*
+ * FPrint batched register writes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define FP_COMPONENT "regmap"
+
+#include "fpi-log.h"
+#include "fpi-regmap.h"
+
+/**
+ * SECTION:fpi-regmap
+ * @title: Batched register writes
+ * @short_description: Helpers to send register tables to a device
+ *
+ * Many devices are set up by writing long tables of registers. The
+ * functions in this section send such a table using as few round trips
+ * as the device protocol allows. The protocol is described by a
+ * #FpiRegmapProtocol, its pack function decides how many writes fit into
+ * a single transfer and up to @max_in_flight transfers are submitted at
+ * the same time.
+ *
+ * Sync points (%FPI_REGMAP_SYNC) can be used to wait for all previous
+ * writes to complete before continuing, e.g. after resetting the device.
+ * They also force the following writes into a new transfer.
+ */
+
+typedef struct
+{
+  FpDevice         *device;
+  FpiRegmapProtocol protocol;
+  FpiRegmapWrite   *writes;
+  gsize             n_writes;
+  gsize             offset;
+  guint             in_flight;
+  GCancellable     *cancellable;
+  GError           *error;
+
+  FpiRegmapCallback callback;
+  gpointer          user_data;
+} FpiRegmapJob;
+
+static void regmap_continue (FpiRegmapJob *job);
+
+static void
+regmap_transfer_cb (FpiUsbTransfer *transfer, FpDevice *device,
+                    gpointer user_data, GError *error)
+{
+  FpiRegmapJob *job = user_data;
+
+  job->in_flight--;
+
+  if (error && !job->error)
+    job->error = error;
+  else if (error)
+    g_error_free (error);
+
+  regmap_continue (job);
+}
+
+static void
+regmap_continue (FpiRegmapJob *job)
+{
+  while (!job->error &&
+         job->offset < job->n_writes &&
+         job->in_flight < job->protocol.max_in_flight)
+    {
+      FpiUsbTransfer *transfer;
+      gsize n_run;
+      guint n_packed;
+
+      if (job->writes[job->offset].reg == FPI_REGMAP_SYNC)
+        {
+          if (job->in_flight > 0)
+            return;
+
+          job->offset++;
+          continue;
+        }
+
+      for (n_run = 1; job->offset + n_run < job->n_writes; n_run++)
+        if (job->writes[job->offset + n_run].reg == FPI_REGMAP_SYNC)
+          break;
+
+      transfer = fpi_usb_transfer_new (job->device);
+      n_packed = job->protocol.pack (transfer,
+                                     &job->writes[job->offset],
+                                     MIN (n_run, G_MAXUINT));
+      g_assert (n_packed > 0 && n_packed <= n_run);
+
+      job->offset += n_packed;
+      job->in_flight++;
+
+      fpi_usb_transfer_submit (transfer, job->protocol.timeout_ms,
+                               job->cancellable, regmap_transfer_cb, job);
+    }
+
+  if (job->in_flight > 0)
+    return;
+
+  if (!job->error && job->offset < job->n_writes)
+    return;
+
+  fp_dbg ("register writes %s", job->error ? "failed" : "completed");
+
+  job->callback (job->device, job->user_data, g_steal_pointer (&job->error));
+
+  g_clear_object (&job->cancellable);
+  g_free (job->writes);
+  g_free (job);
+}
+
+/**
+ * fpi_regmap_write_full:
+ * @device: The #FpDevice
+ * @protocol: The #FpiRegmapProtocol of the device
+ * @writes: (array length=n_writes): The writes, in order
+ * @n_writes: The number of writes
+ * @cancellable: (nullable): Cancellable to use for the transfers
+ * @callback: Called once all writes completed, or on the first error
+ * @user_data: Data to pass to @callback
+ *
+ * Sends a list of register writes to the device. @writes is copied, it
+ * does not need to stay valid. Writes are packed and submitted in order,
+ * after an error no further writes are submitted and @callback is called
+ * once all transfers still in flight returned.
+ */
+void
+fpi_regmap_write_full (FpDevice                *device,
+                       const FpiRegmapProtocol *protocol,
+                       const FpiRegmapWrite    *writes,
+                       gsize                    n_writes,
+                       GCancellable            *cancellable,
+                       FpiRegmapCallback        callback,
+                       gpointer                 user_data)
+{
+  FpiRegmapJob *job;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (protocol && protocol->pack);
+  g_return_if_fail (writes || n_writes == 0);
+  g_return_if_fail (callback);
+
+  fp_dbg ("write %" G_GSIZE_FORMAT " regs", n_writes);
+
+  job = g_new0 (FpiRegmapJob, 1);
+  job->device = device;
+  job->protocol = *protocol;
+  job->protocol.max_in_flight = MAX (job->protocol.max_in_flight, 1);
+  job->writes = g_memdup2 (writes, n_writes * sizeof (FpiRegmapWrite));
+  job->n_writes = n_writes;
+  job->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  job->callback = callback;
+  job->user_data = user_data;
+
+  regmap_continue (job);
+}
+
+static void
+regmap_ssm_cb (FpDevice *device, gpointer user_data, GError *error)
+{
+  FpiSsm *ssm = user_data;
+
+  if (error)
+    fpi_ssm_mark_failed (ssm, error);
+  else
+    fpi_ssm_next_state (ssm);
+}
+
+/**
+ * fpi_regmap_write:
+ * @ssm: The #FpiSsm to advance
+ * @device: The #FpDevice
+ * @protocol: The #FpiRegmapProtocol of the device
+ * @writes: (array length=n_writes): The writes, in order
+ * @n_writes: The number of writes
+ * @cancellable: (nullable): Cancellable to use for the transfers
+ *
+ * Same as fpi_regmap_write_full(), but moves @ssm to the next state once
+ * all writes completed, or marks it as failed.
+ */
+void
+fpi_regmap_write (FpiSsm                  *ssm,
+                  FpDevice                *device,
+                  const FpiRegmapProtocol *protocol,
+                  const FpiRegmapWrite    *writes,
+                  gsize                    n_writes,
+                  GCancellable            *cancellable)
+{
+  g_return_if_fail (ssm);
+
+  fpi_regmap_write_full (device, protocol, writes, n_writes, cancellable,
+                         regmap_ssm_cb, ssm);
+}
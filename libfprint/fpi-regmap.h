@@ -0,0 +1,105 @@
+/*
+ * FPrint batched register writes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "fpi-usb-transfer.h"
+#include "fpi-ssm.h"
+
+G_BEGIN_DECLS
+
+/**
+ * FPI_REGMAP_SYNC:
+ *
+ * Register address of a sync point in a list of #FpiRegmapWrite. Writes
+ * after a sync point are only sent once all writes before it completed.
+ */
+#define FPI_REGMAP_SYNC G_MAXUINT16
+
+/**
+ * FpiRegmapWrite:
+ * @reg: The register to write to, or %FPI_REGMAP_SYNC
+ * @value: The value to write
+ *
+ * A single register write.
+ */
+typedef struct
+{
+  guint16 reg;
+  guint16 value;
+} FpiRegmapWrite;
+
+/**
+ * FpiRegmapPackFunc:
+ * @transfer: A new #FpiUsbTransfer to fill
+ * @writes: The pending writes, never containing a sync point
+ * @n_writes: The number of pending writes, at least one
+ *
+ * Fills @transfer with as many of @writes as the protocol allows to be
+ * sent in a single request.
+ *
+ * Returns: The number of writes packed into @transfer, at least one
+ */
+typedef guint (*FpiRegmapPackFunc)(FpiUsbTransfer       *transfer,
+                                   const FpiRegmapWrite *writes,
+                                   guint                 n_writes);
+
+/**
+ * FpiRegmapProtocol:
+ * @pack: Packs writes into a transfer
+ * @timeout_ms: Timeout for each transfer in ms
+ * @max_in_flight: Number of transfers that may be submitted at the same
+ *   time, 0 is treated like 1
+ *
+ * Describes how a device expects register writes to be sent.
+ */
+typedef struct
+{
+  FpiRegmapPackFunc pack;
+  guint             timeout_ms;
+  guint             max_in_flight;
+} FpiRegmapProtocol;
+
+/**
+ * FpiRegmapCallback:
+ * @device: The #FpDevice
+ * @user_data: User data passed to fpi_regmap_write_full()
+ * @error: (transfer full) (nullable): The first error that occurred
+ *
+ * Called once all register writes completed or failed.
+ */
+typedef void (*FpiRegmapCallback)(FpDevice *device,
+                                  gpointer  user_data,
+                                  GError   *error);
+
+void fpi_regmap_write_full (FpDevice                *device,
+                            const FpiRegmapProtocol *protocol,
+                            const FpiRegmapWrite    *writes,
+                            gsize                    n_writes,
+                            GCancellable            *cancellable,
+                            FpiRegmapCallback        callback,
+                            gpointer                 user_data);
+
+void fpi_regmap_write (FpiSsm                  *ssm,
+                       FpDevice                *device,
+                       const FpiRegmapProtocol *protocol,
+                       const FpiRegmapWrite    *writes,
+                       gsize                    n_writes,
+                       GCancellable            *cancellable);
+
+G_END_DECLS
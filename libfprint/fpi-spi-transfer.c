@@ -293,21 +293,66 @@ fpi_spi_transfer_read_full (FpiSpiTransfer *transfer,
   transfer->free_buffer_rd = free_func;
 }
 
-static void
-transfer_finish_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+static gboolean
+transfer_complete_cb (gpointer user_data)
 {
-  GTask *task = G_TASK (res);
-  FpiSpiTransfer *transfer = g_task_get_task_data (task);
+  FpiSpiTransfer *transfer = user_data;
+  g_autoptr(GCancellable) cancellable = g_steal_pointer (&transfer->cancellable);
+  g_autoptr(FpDevice) device = transfer->device;
+  FpiSpiTransfer *reported = NULL;
+  FpiSpiTransfer *next;
   GError *error = NULL;
   FpiSpiTransferCallback callback;
 
-  g_task_propagate_boolean (task, &error);
+  g_clear_pointer (&transfer->context, g_main_context_unref);
+
+  /* A batch is reported once, using its first failed transfer or
+   * otherwise its last one. Transfers after a failure were not run. */
+  for (FpiSpiTransfer *t = transfer; t; t = t->batch_next)
+    {
+      if (error)
+        {
+          g_clear_error (&t->error);
+          continue;
+        }
+
+      reported = t;
+      error = g_steal_pointer (&t->error);
+      log_transfer (t, FALSE, error);
+    }
 
-  log_transfer (transfer, FALSE, error);
+  /* Like GTask, report the cancellation even if the transfer went
+   * through, the driver relies on it to stop. */
+  if (g_cancellable_is_cancelled (cancellable))
+    {
+      g_clear_error (&error);
+      g_cancellable_set_error_if_cancelled (cancellable, &error);
+    }
 
   callback = transfer->callback;
   transfer->callback = NULL;
-  callback (transfer, transfer->device, transfer->user_data, error);
+  callback (reported, device, transfer->user_data, error);
+
+  for (; transfer; transfer = next)
+    {
+      next = g_steal_pointer (&transfer->batch_next);
+      fpi_spi_transfer_unref (transfer);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Hands the completed transfer back to the context it was submitted from */
+static void
+post_completion (FpiSpiTransfer *transfer)
+{
+  g_autoptr(GSource) source = NULL;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_name (source, "[libfprint] spi transfer completion");
+  g_source_set_callback (source, transfer_complete_cb, transfer, NULL);
+  g_source_attach (source, transfer->context);
 }
 
 static int
@@ -383,22 +428,17 @@ transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
 }
 
 static void
-transfer_thread_func (GTask        *task,
-                      gpointer      source_object,
-                      gpointer      task_data,
-                      GCancellable *cancellable)
+transfer_execute (FpiSpiTransfer *transfer)
 {
-  FpiSpiTransfer *transfer = (FpiSpiTransfer *) task_data;
   gsize full_length;
   gsize transferred = 0;
   int status = 0;
 
   if (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_INVALID_ARGUMENT,
-                               "Transfer with neither write or read!");
+      transfer->error = g_error_new (G_IO_ERROR,
+                                     G_IO_ERROR_INVALID_ARGUMENT,
+                                     "Transfer with neither write or read!");
       return;
     }
 
@@ -412,19 +452,207 @@ transfer_thread_func (GTask        *task,
     status = transfer_chunk (transfer, full_length, &transferred);
 
   if (status < 0)
+    transfer->error = g_error_new (G_IO_ERROR,
+                                   g_io_error_from_errno (errno),
+                                   "Error invoking ioctl for SPI transfer (%d)",
+                                   errno);
+}
+
+/* At most two spi_ioc_transfer entries are needed per transfer, the
+ * message size also needs to fit into the 14 bit ioctl size field. */
+#define MAX_BATCH_TRANSFERS 32
+
+static gsize
+transfer_batch_length (FpiSpiTransfer *transfer)
+{
+  gsize length = 0;
+
+  if (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL)
+    return G_MAXSIZE;
+
+  if (transfer->buffer_wr)
+    length += transfer->length_wr;
+  if (transfer->buffer_rd)
+    length += transfer->length_rd;
+
+  return length;
+}
+
+/* Runs several small transfers using a single SPI_IOC_MESSAGE. The chip
+ * select is toggled between the transfers, so that the device sees the
+ * same as if each transfer was submitted on its own. */
+static void
+transfer_execute_message (FpiSpiTransfer **transfers, guint n_transfers)
+{
+  struct spi_ioc_transfer xfer[MAX_BATCH_TRANSFERS * 2] = { 0 };
+  int n_xfer = 0;
+  int status;
+
+  for (guint i = 0; i < n_transfers; i++)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               g_io_error_from_errno (errno),
-                               "Error invoking ioctl for SPI transfer (%d)",
-                               errno);
+      FpiSpiTransfer *transfer = transfers[i];
+
+      if (transfer->buffer_wr)
+        {
+          xfer[n_xfer].tx_buf = (gsize) transfer->buffer_wr;
+          xfer[n_xfer].len = transfer->length_wr;
+          n_xfer += 1;
+        }
+
+      if (transfer->buffer_rd)
+        {
+          xfer[n_xfer].rx_buf = (gsize) transfer->buffer_rd;
+          xfer[n_xfer].len = transfer->length_rd;
+          n_xfer += 1;
+        }
+
+      /* Deselect the chip at the end of each transfer but the last one */
+      if (i + 1 < n_transfers)
+        xfer[n_xfer - 1].cs_change = TRUE;
     }
-  else
+
+  /* This ioctl cannot be interrupted. */
+  status = ioctl (transfers[0]->spidev_fd, SPI_IOC_MESSAGE (n_xfer), xfer);
+
+  /* It is not known which part failed, so fail all of them */
+  if (status < 0)
     {
-      g_task_return_boolean (task, TRUE);
+      int errsv = errno;
+
+      for (guint i = 0; i < n_transfers; i++)
+        transfers[i]->error = g_error_new (G_IO_ERROR,
+                                           g_io_error_from_errno (errsv),
+                                           "Error invoking ioctl for SPI transfer (%d)",
+                                           errsv);
     }
 }
 
+/* Runs the transfers of a batch in order, merging as many as possible into
+ * each ioctl call. Nothing is run after a failure. */
+static void
+transfer_execute_batch (FpiSpiTransfer *transfer)
+{
+  FpiSpiTransfer *batch[MAX_BATCH_TRANSFERS];
+
+  while (transfer)
+    {
+      gsize batch_length = transfer_batch_length (transfer);
+      guint n_batch = 0;
+
+      batch[n_batch++] = transfer;
+      transfer = transfer->batch_next;
+
+      if (batch_length <= block_size)
+        {
+          while (transfer && n_batch < MAX_BATCH_TRANSFERS)
+            {
+              gsize length = transfer_batch_length (transfer);
+
+              if (length > block_size - batch_length)
+                break;
+
+              batch_length += length;
+              batch[n_batch++] = transfer;
+              transfer = transfer->batch_next;
+            }
+        }
+
+      if (n_batch == 1)
+        transfer_execute (batch[0]);
+      else
+        transfer_execute_message (batch, n_batch);
+
+      if (batch[n_batch - 1]->error)
+        return;
+    }
+}
+
+/* Every device has one thread doing the SPI I/O. Transfers are queued to it
+ * and run in order, batches submitted using fpi_spi_transfer_submit_batch()
+ * are merged into as few ioctl calls as possible. */
+typedef struct
+{
+  GThread     *thread;
+  GAsyncQueue *queue;
+  GMutex       lock;
+  GCond        cond;
+} FpiSpiWorker;
+
+/* Pushed to the queue to stop the thread */
+static FpiSpiTransfer worker_stop;
+
+static gpointer
+spi_worker_thread (gpointer user_data)
+{
+  FpiSpiWorker *worker = user_data;
+
+  while (TRUE)
+    {
+      FpiSpiTransfer *transfer;
+
+      transfer = g_async_queue_pop (worker->queue);
+      if (transfer == &worker_stop)
+        break;
+
+      if (transfer->batch_next)
+        transfer_execute_batch (transfer);
+      else
+        transfer_execute (transfer);
+
+      if (!transfer->sync)
+        {
+          post_completion (transfer);
+          continue;
+        }
+
+      g_mutex_lock (&worker->lock);
+      transfer->done = TRUE;
+      g_cond_broadcast (&worker->cond);
+      g_mutex_unlock (&worker->lock);
+    }
+
+  return NULL;
+}
+
+static void
+spi_worker_free (FpiSpiWorker *worker)
+{
+  g_async_queue_push (worker->queue, &worker_stop);
+  g_thread_join (worker->thread);
+
+  g_async_queue_unref (worker->queue);
+  g_mutex_clear (&worker->lock);
+  g_cond_clear (&worker->cond);
+  g_free (worker);
+}
+
+static FpiSpiWorker *
+get_spi_worker (FpDevice *device)
+{
+  static GQuark worker_quark = 0;
+  FpiSpiWorker *worker;
+
+  if (G_UNLIKELY (worker_quark == 0))
+    worker_quark = g_quark_from_static_string ("fpi-spi-worker");
+
+  worker = g_object_get_qdata (G_OBJECT (device), worker_quark);
+  if (worker)
+    return worker;
+
+  worker = g_new0 (FpiSpiWorker, 1);
+  worker->queue = g_async_queue_new ();
+  g_mutex_init (&worker->lock);
+  g_cond_init (&worker->cond);
+  worker->thread = g_thread_new ("fpi-spi-io", spi_worker_thread, worker);
+
+  /* The thread is stopped when the device is finalized, there is nothing
+   * queued at that point as every transfer holds a device reference. */
+  g_object_set_qdata_full (G_OBJECT (device), worker_quark, worker,
+                           (GDestroyNotify) spi_worker_free);
+
+  return worker;
+}
+
 /**
  * fpi_spi_transfer_submit:
  * @transfer: (transfer full): The transfer to submit, must have been filled.
@@ -437,6 +665,9 @@ transfer_thread_func (GTask        *task,
  * The underlying transfer cannot be cancelled. The current implementation
  * will only call @callback after the transfer has been completed.
  *
+ * Transfers are run in the order they are submitted, see
+ * fpi_spi_transfer_submit_batch() to send several of them at once.
+ *
  * Note that #FpiSpiTransfer will be stolen when this function is called.
  * So that all associated data will be free'ed automatically, after the
  * callback ran unless fpi_usb_transfer_ref() is explicitly called.
@@ -447,7 +678,7 @@ fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
                          FpiSpiTransferCallback callback,
                          gpointer               user_data)
 {
-  g_autoptr(GTask) task = NULL;
+  FpiSpiWorker *worker;
 
   g_return_if_fail (transfer);
   g_return_if_fail (callback);
@@ -460,15 +691,81 @@ fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
 
   log_transfer (transfer, TRUE, NULL);
 
-  task = g_task_new (transfer->device,
-                     cancellable,
-                     transfer_finish_cb,
-                     NULL);
-  g_task_set_task_data (task,
-                        g_steal_pointer (&transfer),
-                        (GDestroyNotify) fpi_spi_transfer_unref);
+  worker = get_spi_worker (transfer->device);
+
+  g_object_ref (transfer->device);
+  transfer->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  transfer->context = g_main_context_ref_thread_default ();
+  transfer->sync = FALSE;
+
+  g_async_queue_push (worker->queue, g_steal_pointer (&transfer));
+}
+
+/**
+ * fpi_spi_transfer_submit_batch:
+ * @transfers: (array length=n_transfers) (transfer full): The transfers to
+ *   submit, must have been filled.
+ * @n_transfers: The number of transfers, at least one
+ * @cancellable: Cancellable to use, e.g. fpi_device_get_cancellable()
+ * @callback: Callback on completion or error
+ * @user_data: Data to pass to callback
+ *
+ * Submit several SPI transfers for the same spidev device, to be run one
+ * after the other. As many of them as fit into the spidev buffer are sent
+ * to the device using a single ioctl call, with the chip being deselected
+ * in between, so that the device sees the same as if each transfer was
+ * submitted on its own.
+ *
+ * The batch stops at the first transfer that fails. @callback is called
+ * once, with that transfer and its error, or with the last transfer if all
+ * of them succeeded. If several transfers were merged into the ioctl call
+ * that failed, the first of them is reported as it is not known which one
+ * failed.
+ *
+ * Note that the transfers will be stolen when this function is called,
+ * like with fpi_spi_transfer_submit().
+ */
+void
+fpi_spi_transfer_submit_batch (FpiSpiTransfer       **transfers,
+                               guint                  n_transfers,
+                               GCancellable          *cancellable,
+                               FpiSpiTransferCallback callback,
+                               gpointer               user_data)
+{
+  FpiSpiTransfer *head;
+  FpiSpiWorker *worker;
+
+  g_return_if_fail (transfers);
+  g_return_if_fail (n_transfers > 0);
+  g_return_if_fail (callback);
+
+  head = transfers[0];
+
+  for (guint i = 0; i < n_transfers; i++)
+    {
+      /* Recycling is allowed, but not two at the same time. */
+      g_return_if_fail (transfers[i]->callback == NULL);
+      g_return_if_fail (transfers[i]->batch_next == NULL);
+      g_return_if_fail (transfers[i]->device == head->device);
+      g_return_if_fail (transfers[i]->spidev_fd == head->spidev_fd);
+
+      log_transfer (transfers[i], TRUE, NULL);
+    }
 
-  g_task_run_in_thread (task, transfer_thread_func);
+  for (guint i = 0; i + 1 < n_transfers; i++)
+    transfers[i]->batch_next = transfers[i + 1];
+
+  head->callback = callback;
+  head->user_data = user_data;
+
+  worker = get_spi_worker (head->device);
+
+  g_object_ref (head->device);
+  head->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+  head->context = g_main_context_ref_thread_default ();
+  head->sync = FALSE;
+
+  g_async_queue_push (worker->queue, head);
 }
 
 /**
@@ -488,9 +785,8 @@ gboolean
 fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
                               GError        **error)
 {
-  g_autoptr(GTask) task = NULL;
-  GError *err = NULL;
-  gboolean res;
+  FpiSpiWorker *worker;
+  GError *err;
 
   g_return_val_if_fail (transfer, FALSE);
 
@@ -499,21 +795,28 @@ fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
 
   log_transfer (transfer, TRUE, NULL);
 
-  task = g_task_new (transfer->device,
-                     NULL,
-                     NULL,
-                     NULL);
-  g_task_set_task_data (task,
-                        fpi_spi_transfer_ref (transfer),
-                        (GDestroyNotify) fpi_spi_transfer_unref);
+  worker = get_spi_worker (transfer->device);
 
-  g_task_run_in_thread_sync (task, transfer_thread_func);
+  /* Queued like any other transfer to keep the order */
+  transfer->sync = TRUE;
+  transfer->done = FALSE;
+  g_async_queue_push (worker->queue, transfer);
 
-  res = g_task_propagate_boolean (task, &err);
+  g_mutex_lock (&worker->lock);
+  while (!transfer->done)
+    g_cond_wait (&worker->cond, &worker->lock);
+  g_mutex_unlock (&worker->lock);
+
+  transfer->sync = FALSE;
+  err = g_steal_pointer (&transfer->error);
 
   log_transfer (transfer, FALSE, err);
 
-  g_propagate_error (error, err);
+  if (err)
+    {
+      g_propagate_error (error, err);
+      return FALSE;
+    }
 
-  return res;
+  return TRUE;
 }
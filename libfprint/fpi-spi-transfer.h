@@ -73,6 +73,14 @@ struct _FpiSpiTransfer
   /* Data free function */
   GDestroyNotify free_buffer_wr;
   GDestroyNotify free_buffer_rd;
+
+  /* State while queued on the I/O thread */
+  GCancellable   *cancellable;
+  GMainContext   *context;
+  GError         *error;
+  gboolean        sync;
+  gboolean        done;
+  FpiSpiTransfer *batch_next;
 };
 
 GType              fpi_spi_transfer_get_type (void) G_GNUC_CONST;
@@ -104,6 +112,12 @@ void               fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
                                             FpiSpiTransferCallback callback,
                                             gpointer               user_data);
 
+void               fpi_spi_transfer_submit_batch (FpiSpiTransfer       **transfers,
+                                                  guint                  n_transfers,
+                                                  GCancellable          *cancellable,
+                                                  FpiSpiTransferCallback callback,
+                                                  gpointer               user_data);
+
 gboolean           fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
                                                  GError        **error);
 
@@ -23,6 +23,7 @@
 
 #include "drivers_api.h"
 #include "fpi-ssm.h"
+#include "fp-device-private.h"
 
 
 /**
@@ -515,6 +516,27 @@ fpi_ssm_next_state_delayed (FpiSsm *machine,
   g_source_set_name (machine->timeout, source_name);
 }
 
+/**
+ * fpi_ssm_next_state_polled:
+ * @machine: an #FpiSsm state machine
+ *
+ * Like fpi_ssm_next_state_delayed(), but the delay is picked by the
+ * polling scheduler of the device. Use this in loops that poll the sensor
+ * for a finger: the device is polled quickly after activation and after a
+ * touch, and more slowly the longer it stays idle. The pending delay is
+ * cut short by fpi_device_poll_wake(). The range of the delay is set by
+ * the @poll_min_ms and @poll_max_ms fields of #FpDeviceClass.
+ */
+void
+fpi_ssm_next_state_polled (FpiSsm *machine)
+{
+  g_return_if_fail (machine != NULL);
+
+  fpi_ssm_next_state_delayed (machine,
+                              fpi_device_poll_next_interval (machine->dev));
+  fpi_device_poll_set_pending (machine->dev, machine->timeout);
+}
+
 /**
  * fpi_ssm_jump_to_state:
  * @machine: an #FpiSsm state machine
@@ -78,6 +78,7 @@ void fpi_ssm_jump_to_state (FpiSsm *machine,
                             int     state);
 void fpi_ssm_next_state_delayed (FpiSsm *machine,
                                  int     delay);
+void fpi_ssm_next_state_polled (FpiSsm *machine);
 void fpi_ssm_jump_to_state_delayed (FpiSsm *machine,
                                     int     state,
                                     int     delay);
@@ -88,22 +88,266 @@ log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
     }
 }
 
+/* Buffers are recycled in power of two size classes, starting with the
+ * maximum packet size of full speed devices. Larger buffers are rare and
+ * are always allocated. */
+#define POOL_MIN_BUFFER_SHIFT 6
+#define POOL_N_BUFFER_CLASSES 11
+#define POOL_MAX_TRANSFERS 32
+
+struct _FpiUsbTransferPool
+{
+  GMutex     lock;
+  GPtrArray *transfers;
+  GPtrArray *buffers[POOL_N_BUFFER_CLASSES];
+  gsize      max_cached;
+  gsize      cached;
+  guint      hits;
+  guint      misses;
+};
+
+static void
+transfer_struct_free (gpointer data)
+{
+  g_slice_free (FpiUsbTransfer, data);
+}
+
+/**
+ * fpi_usb_transfer_pool_new:
+ * @max_cached: The maximum number of buffer bytes to keep for reuse
+ *
+ * Creates a new pool for #FpiUsbTransfer structures and their buffers.
+ * Every #FpDevice owns one, transfers created with fpi_usb_transfer_new()
+ * are taken from it and given back when freed, so that drivers issuing a
+ * lot of small commands do not need to allocate memory for each of them.
+ *
+ * Returns: (transfer full): A new #FpiUsbTransferPool
+ */
+FpiUsbTransferPool *
+fpi_usb_transfer_pool_new (gsize max_cached)
+{
+  FpiUsbTransferPool *pool = g_atomic_rc_box_new0 (FpiUsbTransferPool);
+
+  g_mutex_init (&pool->lock);
+  pool->transfers = g_ptr_array_new_with_free_func (transfer_struct_free);
+  for (gint i = 0; i < POOL_N_BUFFER_CLASSES; i++)
+    pool->buffers[i] = g_ptr_array_new_with_free_func (g_free);
+  pool->max_cached = max_cached;
+
+  return pool;
+}
+
+/**
+ * fpi_usb_transfer_pool_ref:
+ * @pool: A #FpiUsbTransferPool
+ *
+ * Increments the reference count of @pool.
+ *
+ * Returns: (transfer full): @pool
+ */
+FpiUsbTransferPool *
+fpi_usb_transfer_pool_ref (FpiUsbTransferPool *pool)
+{
+  g_return_val_if_fail (pool, NULL);
+
+  return g_atomic_rc_box_acquire (pool);
+}
+
+static void
+fpi_usb_transfer_pool_clear (FpiUsbTransferPool *pool)
+{
+  g_ptr_array_unref (pool->transfers);
+  for (gint i = 0; i < POOL_N_BUFFER_CLASSES; i++)
+    g_ptr_array_unref (pool->buffers[i]);
+  g_mutex_clear (&pool->lock);
+}
+
+/**
+ * fpi_usb_transfer_pool_unref:
+ * @pool: A #FpiUsbTransferPool
+ *
+ * Decrements the reference count of @pool, freeing all cached transfers
+ * and buffers once it drops to zero. Every pooled transfer holds a
+ * reference until it is freed.
+ */
+void
+fpi_usb_transfer_pool_unref (FpiUsbTransferPool *pool)
+{
+  g_return_if_fail (pool);
+
+  g_atomic_rc_box_release_full (pool, (GDestroyNotify) fpi_usb_transfer_pool_clear);
+}
+
+/**
+ * fpi_usb_transfer_pool_get_stats:
+ * @pool: A #FpiUsbTransferPool
+ * @hits: (out) (optional): Number of transfers and buffers served from the pool
+ * @misses: (out) (optional): Number of transfers and buffers that needed new memory
+ * @cached: (out) (optional): Number of buffer bytes currently kept for reuse
+ *
+ * Retrieves usage statistics of the pool.
+ */
+void
+fpi_usb_transfer_pool_get_stats (FpiUsbTransferPool *pool,
+                                 guint              *hits,
+                                 guint              *misses,
+                                 gsize              *cached)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+
+  g_return_if_fail (pool);
+
+  locker = g_mutex_locker_new (&pool->lock);
+
+  if (hits)
+    *hits = pool->hits;
+  if (misses)
+    *misses = pool->misses;
+  if (cached)
+    *cached = pool->cached;
+}
+
+static gint
+pool_buffer_class (gsize length)
+{
+  gint class = 0;
+
+  while (((gsize) 1 << (class + POOL_MIN_BUFFER_SHIFT)) < length)
+    class++;
+
+  return class < POOL_N_BUFFER_CLASSES ? class : -1;
+}
+
+static FpiUsbTransfer *
+pool_take_transfer (FpiUsbTransferPool *pool)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->lock);
+  FpiUsbTransfer *transfer;
+
+  if (pool->transfers->len > 0)
+    {
+      pool->hits++;
+      transfer = g_ptr_array_steal_index_fast (pool->transfers,
+                                               pool->transfers->len - 1);
+      memset (transfer, 0, sizeof (FpiUsbTransfer));
+
+      return transfer;
+    }
+
+  pool->misses++;
+
+  return g_slice_new0 (FpiUsbTransfer);
+}
+
+static void
+pool_release_transfer (FpiUsbTransferPool *pool, FpiUsbTransfer *transfer)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->lock);
+
+  if (pool->transfers->len >= POOL_MAX_TRANSFERS)
+    {
+      g_slice_free (FpiUsbTransfer, transfer);
+      return;
+    }
+
+  g_ptr_array_add (pool->transfers, transfer);
+}
+
+/* Sets up a zeroed buffer of @length bytes for @transfer, taken from the
+ * pool if possible. Returns the destroy notify for the buffer, which is
+ * %NULL for pooled buffers as those are returned when the transfer is freed. */
+static GDestroyNotify
+transfer_alloc_buffer (FpiUsbTransfer *transfer,
+                       gsize           length,
+                       guint8        **buffer)
+{
+  FpiUsbTransferPool *pool = transfer->pool;
+  g_autoptr(GMutexLocker) locker = NULL;
+  gint class;
+  gsize size;
+
+  if (!pool || length == 0)
+    {
+      *buffer = g_malloc0 (length);
+      return g_free;
+    }
+
+  locker = g_mutex_locker_new (&pool->lock);
+
+  class = pool_buffer_class (length);
+  if (class < 0)
+    {
+      pool->misses++;
+      *buffer = g_malloc0 (length);
+      return g_free;
+    }
+
+  size = (gsize) 1 << (class + POOL_MIN_BUFFER_SHIFT);
+
+  if (pool->buffers[class]->len > 0)
+    {
+      pool->hits++;
+      pool->cached -= size;
+      *buffer = g_ptr_array_steal_index_fast (pool->buffers[class],
+                                              pool->buffers[class]->len - 1);
+      memset (*buffer, 0, length);
+    }
+  else
+    {
+      pool->misses++;
+      *buffer = g_malloc0 (size);
+    }
+
+  transfer->pool_buffer = *buffer;
+  transfer->pool_buffer_size = size;
+
+  return NULL;
+}
+
+static void
+pool_release_buffer (FpiUsbTransferPool *pool, guint8 *buffer, gsize size)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&pool->lock);
+
+  if (pool->cached + size > pool->max_cached)
+    {
+      g_free (buffer);
+      return;
+    }
+
+  g_ptr_array_add (pool->buffers[pool_buffer_class (size)], buffer);
+  pool->cached += size;
+}
+
 /**
  * fpi_usb_transfer_new:
  * @device: The #FpDevice the transfer is for
  *
- * Creates a new #FpiUsbTransfer.
+ * Creates a new #FpiUsbTransfer. The transfer and the buffer allocated when
+ * filling it are taken from the pool of @device and are returned to it
+ * once the transfer is freed.
  *
  * Returns: (transfer full): A newly created #FpiUsbTransfer
  */
 FpiUsbTransfer *
 fpi_usb_transfer_new (FpDevice * device)
 {
+  FpiUsbTransferPool *pool;
   FpiUsbTransfer *self;
 
   g_assert (device != NULL);
 
-  self = g_slice_new0 (FpiUsbTransfer);
+  pool = fpi_device_get_usb_transfer_pool (device);
+  if (pool)
+    {
+      self = pool_take_transfer (pool);
+      self->pool = fpi_usb_transfer_pool_ref (pool);
+    }
+  else
+    {
+      self = g_slice_new0 (FpiUsbTransfer);
+    }
+
   self->ref_count = 1;
   self->type = FP_TRANSFER_NONE;
 
@@ -115,14 +359,28 @@ fpi_usb_transfer_new (FpDevice * device)
 static void
 fpi_usb_transfer_free (FpiUsbTransfer *self)
 {
+  FpiUsbTransferPool *pool;
+
   g_assert (self);
   g_assert_cmpint (self->ref_count, ==, 0);
 
-  if (self->free_buffer && self->buffer)
+  /* The driver may have stolen the buffer, it owns the memory then */
+  if (self->buffer && self->buffer == self->pool_buffer)
+    pool_release_buffer (self->pool, self->buffer, self->pool_buffer_size);
+  else if (self->free_buffer && self->buffer)
     self->free_buffer (self->buffer);
   self->buffer = NULL;
 
-  g_slice_free (FpiUsbTransfer, self);
+  pool = g_steal_pointer (&self->pool);
+  if (pool)
+    {
+      pool_release_transfer (pool, self);
+      fpi_usb_transfer_pool_unref (pool);
+    }
+  else
+    {
+      g_slice_free (FpiUsbTransfer, self);
+    }
 }
 
 /**
@@ -176,11 +434,15 @@ fpi_usb_transfer_fill_bulk (FpiUsbTransfer *transfer,
                             guint8          endpoint,
                             gsize           length)
 {
+  GDestroyNotify free_func;
+  guint8 *buffer;
+
+  free_func = transfer_alloc_buffer (transfer, length, &buffer);
   fpi_usb_transfer_fill_bulk_full (transfer,
                                    endpoint,
-                                   g_malloc0 (length),
+                                   buffer,
                                    length,
-                                   g_free);
+                                   free_func);
 }
 
 /**
@@ -246,8 +508,8 @@ fpi_usb_transfer_fill_control (FpiUsbTransfer       *transfer,
   transfer->idx = idx;
 
   transfer->length = length;
-  transfer->buffer = g_malloc0 (length);
-  transfer->free_buffer = g_free;
+  transfer->free_buffer = transfer_alloc_buffer (transfer, length,
+                                                 &transfer->buffer);
 }
 
 /**
@@ -264,11 +526,15 @@ fpi_usb_transfer_fill_interrupt (FpiUsbTransfer *transfer,
                                  guint8          endpoint,
                                  gsize           length)
 {
+  GDestroyNotify free_func;
+  guint8 *buffer;
+
+  free_func = transfer_alloc_buffer (transfer, length, &buffer);
   fpi_usb_transfer_fill_interrupt_full (transfer,
                                         endpoint,
-                                        g_malloc0 (length),
+                                        buffer,
                                         length,
-                                        g_free);
+                                        free_func);
 }
 
 /**
@@ -33,6 +33,14 @@ G_BEGIN_DECLS
 typedef struct _FpiUsbTransfer FpiUsbTransfer;
 typedef struct _FpiSsm         FpiSsm;
 
+/**
+ * FpiUsbTransferPool:
+ *
+ * A thread safe pool that recycles #FpiUsbTransfer structures and their
+ * buffers, see fpi_usb_transfer_pool_new().
+ */
+typedef struct _FpiUsbTransferPool FpiUsbTransferPool;
+
 typedef void (*FpiUsbTransferCallback)(FpiUsbTransfer *transfer,
                                        FpDevice       *dev,
                                        gpointer        user_data,
@@ -102,6 +110,11 @@ struct _FpiUsbTransfer
 
   /* Data free function */
   GDestroyNotify free_buffer;
+
+  /* Pool the transfer and its buffer are returned to */
+  FpiUsbTransferPool *pool;
+  guint8             *pool_buffer;
+  gsize               pool_buffer_size;
 };
 
 GType              fpi_usb_transfer_get_type (void) G_GNUC_CONST;
@@ -156,4 +169,16 @@ gboolean           fpi_usb_transfer_submit_sync (FpiUsbTransfer *transfer,
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbTransfer, fpi_usb_transfer_unref)
 
+FpiUsbTransferPool *fpi_usb_transfer_pool_new (gsize max_cached);
+FpiUsbTransferPool *fpi_usb_transfer_pool_ref (FpiUsbTransferPool *pool);
+void               fpi_usb_transfer_pool_unref (FpiUsbTransferPool *pool);
+void               fpi_usb_transfer_pool_get_stats (FpiUsbTransferPool *pool,
+                                                    guint              *hits,
+                                                    guint              *misses,
+                                                    gsize              *cached);
+
+FpiUsbTransferPool *fpi_device_get_usb_transfer_pool (FpDevice *device);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbTransferPool, fpi_usb_transfer_pool_unref)
+
 G_END_DECLS
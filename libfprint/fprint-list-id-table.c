@@ -0,0 +1,110 @@
+/*
+ * Generate the id table of all drivers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <config.h>
+
+#include "fpi-context.h"
+#include "fpi-device.h"
+
+static void
+print_string (const gchar *str)
+{
+  g_autofree gchar *escaped = NULL;
+
+  if (!str)
+    {
+      g_print ("NULL");
+      return;
+    }
+
+  escaped = g_strescape (str, NULL);
+  g_print ("\"%s\"", escaped);
+}
+
+static void
+print_driver (const FpDeviceClass *cls, guint driver_index)
+{
+  const FpIdEntry *entry;
+
+  switch (cls->type)
+    {
+    case FP_DEVICE_TYPE_USB:
+      for (entry = cls->id_table; entry->pid; entry++)
+        {
+          g_print ("  { \"%s\", %u, FP_DEVICE_TYPE_USB,\n", cls->id, driver_index);
+          g_print ("    { .vid = 0x%04x, .pid = 0x%04x, .driver_data = %" G_GUINT64_FORMAT "ull } },\n",
+                   entry->vid, entry->pid, entry->driver_data);
+        }
+      break;
+
+    case FP_DEVICE_TYPE_VIRTUAL:
+      for (entry = cls->id_table; entry->pid; entry++)
+        {
+          g_print ("  { \"%s\", %u, FP_DEVICE_TYPE_VIRTUAL,\n", cls->id, driver_index);
+          g_print ("    { .virtual_envvar = ");
+          print_string (entry->virtual_envvar);
+          g_print (", .driver_data = %" G_GUINT64_FORMAT "ull } },\n",
+                   entry->driver_data);
+        }
+      break;
+
+    case FP_DEVICE_TYPE_UDEV:
+      for (entry = cls->id_table; entry->udev_types; entry++)
+        {
+          g_print ("  { \"%s\", %u, FP_DEVICE_TYPE_UDEV,\n", cls->id, driver_index);
+          g_print ("    { .udev_types = %u, .spi_acpi_id = ", entry->udev_types);
+          print_string (entry->spi_acpi_id);
+          g_print (", .hid_id = { .vid = 0x%04x, .pid = 0x%04x }, .driver_data = %" G_GUINT64_FORMAT "ull } },\n",
+                   entry->hid_id.vid, entry->hid_id.pid, entry->driver_data);
+        }
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GArray) drivers = fpi_get_driver_types ();
+  g_autofree char *program_name = NULL;
+  guint i;
+
+  program_name = g_path_get_basename (argv[0]);
+
+  g_print ("/* This file has been generated using %s, do not edit. */\n\n",
+           program_name);
+  g_print ("#include \"fpi-context.h\"\n\n");
+  g_print ("const FpiDriverIdEntry fpi_driver_id_table[] = {\n");
+
+  /* The order of drivers must not be changed, the index is used to find the
+   * GType in the array returned by fpi_get_driver_types(). */
+  for (i = 0; i < drivers->len; i++)
+    {
+      GType driver = g_array_index (drivers, GType, i);
+      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
+
+      print_driver (cls, i);
+    }
+
+  g_print ("  { NULL }\n");
+  g_print ("};\n");
+
+  return 0;
+}
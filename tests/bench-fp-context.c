@@ -0,0 +1,77 @@
+/*
+ * FpContext startup and hotplug benchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <gusb.h>
+#include <libfprint/fprint.h>
+
+#define ITERATIONS 50
+
+/* Creating the context measures startup, enumerating measures the hotplug
+ * path, as every USB device already connected to the host is announced
+ * through it, no matter if a driver handles it or not. The first iteration
+ * is reported separately as short-lived processes only ever see that one.
+ */
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GUsbContext) usb_ctx = NULL;
+  g_autoptr(GPtrArray) usb_devices = NULL;
+  gint64 cold_new = 0, cold_enumerate = 0;
+  gint64 warm_new = 0, warm_enumerate = 0;
+  guint n_devices = 0;
+  guint i;
+
+  usb_ctx = g_usb_context_new (NULL);
+  if (usb_ctx)
+    usb_devices = g_usb_context_get_devices (usb_ctx);
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      g_autoptr(FpContext) context = NULL;
+      gint64 start, created, enumerated;
+
+      start = g_get_monotonic_time ();
+      context = fp_context_new ();
+      created = g_get_monotonic_time ();
+      fp_context_enumerate (context);
+      enumerated = g_get_monotonic_time ();
+
+      n_devices = fp_context_get_devices (context)->len;
+
+      if (i == 0)
+        {
+          cold_new = created - start;
+          cold_enumerate = enumerated - created;
+        }
+      else
+        {
+          warm_new += created - start;
+          warm_enumerate += enumerated - created;
+        }
+    }
+
+  g_print ("USB devices on the host: %u, fingerprint devices: %u\n",
+           usb_devices ? usb_devices->len : 0, n_devices);
+  g_print ("cold: new %" G_GINT64_FORMAT " us, enumerate %" G_GINT64_FORMAT " us\n",
+           cold_new, cold_enumerate);
+  g_print ("warm: new %" G_GINT64_FORMAT " us, enumerate %" G_GINT64_FORMAT " us (mean of %u)\n",
+           warm_new / (ITERATIONS - 1), warm_enumerate / (ITERATIONS - 1),
+           ITERATIONS - 1);
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * U.are.U 4000 image decryption benchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "drivers/uru4000_crypt.h"
+
+#define IMAGE_SIZE (384 * 290)
+#define ITERATIONS 200
+
+/* The decoder as it was before it worked on blocks of key stream */
+static uint32_t
+update_key (uint32_t key)
+{
+  uint32_t bit = key & 0x9248144d;
+
+  bit ^= bit << 16;
+  bit ^= bit << 8;
+  bit ^= bit << 4;
+  bit ^= bit << 2;
+  bit ^= bit << 1;
+  return (bit & 0x80000000) | (key >> 1);
+}
+
+static uint32_t
+reference_decode (uint8_t *data, int num_bytes, uint32_t key)
+{
+  uint8_t xorbyte;
+  int i;
+
+  for (i = 0; i < num_bytes - 1; i++)
+    {
+      xorbyte  = ((key >>  4) & 1) << 0;
+      xorbyte |= ((key >>  8) & 1) << 1;
+      xorbyte |= ((key >> 11) & 1) << 2;
+      xorbyte |= ((key >> 14) & 1) << 3;
+      xorbyte |= ((key >> 18) & 1) << 4;
+      xorbyte |= ((key >> 21) & 1) << 5;
+      xorbyte |= ((key >> 24) & 1) << 6;
+      xorbyte |= ((key >> 29) & 1) << 7;
+      key = update_key (key);
+
+      data[i] = data[i + 1] ^ xorbyte;
+    }
+
+  data[i] = 0;
+  return update_key (key);
+}
+
+/* Decrypts a full random image with both decoders, checks that they agree
+ * and reports the mean time per image. */
+int
+main (int argc, char **argv)
+{
+  g_autofree guint8 *encrypted = g_malloc (IMAGE_SIZE);
+  g_autofree guint8 *reference = g_malloc (IMAGE_SIZE);
+  g_autofree guint8 *data = g_malloc (IMAGE_SIZE);
+  gint64 reference_time = 0, time = 0;
+  guint i;
+
+  uru4k_key_blocks_init ();
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      uint32_t key = g_random_int ();
+      uint32_t reference_key, new_key;
+      gint64 start;
+      guint j;
+
+      for (j = 0; j < IMAGE_SIZE; j++)
+        encrypted[j] = g_random_int_range (0, 256);
+
+      memcpy (reference, encrypted, IMAGE_SIZE);
+      start = g_get_monotonic_time ();
+      reference_key = reference_decode (reference, IMAGE_SIZE, key);
+      reference_time += g_get_monotonic_time () - start;
+
+      memcpy (data, encrypted, IMAGE_SIZE);
+      start = g_get_monotonic_time ();
+      new_key = uru4k_decode (data, IMAGE_SIZE, key);
+      time += g_get_monotonic_time () - start;
+
+      if (new_key != reference_key || memcmp (data, reference, IMAGE_SIZE) != 0)
+        {
+          g_printerr ("Decoded image differs from the reference for key %08x\n", key);
+          return 1;
+        }
+    }
+
+  g_print ("reference: %" G_GINT64_FORMAT " us, decode: %" G_GINT64_FORMAT " us (mean of %u)\n",
+           reference_time / ITERATIONS, time / ITERATIONS, ITERATIONS);
+
+  return 0;
+}
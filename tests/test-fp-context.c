@@ -93,6 +93,60 @@ test_context_enumerates_new_devices (void)
   fpt_teardown_virtual_device_environment ();
 }
 
+static void
+test_context_enumerate_time (void)
+{
+  g_autoptr(FpContext) context = NULL;
+  GPtrArray *devices;
+
+  context = fp_context_new ();
+  g_assert_cmpint (fp_context_get_enumerate_time (context), ==, -1);
+
+  fpt_setup_virtual_device_environment (FPT_VIRTUAL_DEVICE_IMAGE);
+
+  fp_context_enumerate (context);
+  devices = fp_context_get_devices (context);
+
+  g_assert_cmpuint (devices->len, ==, 1);
+  g_assert_cmpint (fp_context_get_enumerate_time (context), >=, 0);
+
+  fpt_teardown_virtual_device_environment ();
+}
+
+static void
+assert_driver_classes_not_initialized (GType type)
+{
+  g_autofree GType *children = NULL;
+  guint n_children, i;
+
+  children = g_type_children (type, &n_children);
+  for (i = 0; i < n_children; i++)
+    {
+      const gchar *name = g_type_name (children[i]);
+
+      assert_driver_classes_not_initialized (children[i]);
+
+      /* Base classes and the drivers used by the other tests */
+      if (G_TYPE_IS_ABSTRACT (children[i]) ||
+          g_str_has_prefix (name, "FpiDeviceVirtual") ||
+          g_str_has_prefix (name, "FpiDeviceFake"))
+        continue;
+
+      g_assert_null (g_type_class_peek (children[i]));
+    }
+}
+
+static void
+test_context_lazy_driver_classes (void)
+{
+  g_autoptr(FpContext) context = NULL;
+
+  context = fp_context_new ();
+  fp_context_enumerate (context);
+
+  assert_driver_classes_not_initialized (FP_TYPE_DEVICE);
+}
+
 #define DEV_REMOVED_CB 1
 #define CTX_DEVICE_REMOVED_CB 2
 
@@ -392,6 +446,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/context/no-devices", test_context_has_no_devices);
   g_test_add_func ("/context/has-virtual-device", test_context_has_virtual_device);
   g_test_add_func ("/context/enumerates-new-devices", test_context_enumerates_new_devices);
+  g_test_add_func ("/context/enumerate-time", test_context_enumerate_time);
+  g_test_add_func ("/context/lazy-driver-classes", test_context_lazy_driver_classes);
   g_test_add_func ("/context/remove-device-closed", test_context_remove_device_closed);
   g_test_add_func ("/context/remove-device-closing", test_context_remove_device_closing);
   g_test_add_func ("/context/remove-device-open", test_context_remove_device_open);
@@ -19,6 +19,7 @@
  */
 
 #include <glib.h>
+#include <string.h>
 #include <cairo.h>
 #include "fpi-assembling.h"
 #include "fpi-image.h"
@@ -125,12 +126,848 @@ test_frame_assembling (void)
   g_assert (1);
 }
 
+static void
+test_frame_assembling_reverse (void)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *img = NULL;
+  int width, height, stride, offset;
+  int test_height;
+  guchar *data;
+  struct fpi_frame_asmbl_ctx ctx = { 0, };
+  gint xborder = 5;
+
+  g_autoptr(FpImage) fp_img = NULL;
+  GSList *frames = NULL;
+
+  path = g_test_build_filename (G_TEST_DIST, "vfs5011", "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  data = cairo_image_surface_get_data (img);
+  width = cairo_image_surface_get_width (img);
+  height = cairo_image_surface_get_height (img);
+  stride = cairo_image_surface_get_stride (img);
+
+  ctx.get_pixel = cairo_get_pixel;
+  ctx.frame_width = width;
+  ctx.frame_height = 20;
+  ctx.image_width = width - 2 * xborder;
+
+  offset = 10;
+  test_height = height - (height - ctx.frame_height) % offset;
+
+  /* Same as above, but swiped the other way round */
+  for (int y = 0; y + ctx.frame_height < height; y += offset)
+    {
+      cairo_frame *frame = g_new0 (cairo_frame, 1);
+
+      frame->surf = img;
+      frame->width = width;
+      frame->height = height;
+      frame->stride = stride;
+      frame->data = data;
+      frame->x = 0;
+      frame->y = y;
+
+      frames = g_slist_prepend (frames, frame);
+    }
+
+  fpi_do_movement_estimation (&ctx, frames);
+  for (GSList *l = frames->next; l != NULL; l = l->next)
+    {
+      cairo_frame * frame = l->data;
+
+      g_assert_cmpint (frame->frame.delta_x, ==, 0);
+      g_assert_cmpint (frame->frame.delta_y, ==, -offset);
+    }
+
+  fp_img = fpi_assemble_frames (&ctx, frames);
+  g_assert_cmpint (fp_img->height, ==, test_height);
+  g_assert_false (fp_img->flags & FPI_IMAGE_V_FLIPPED);
+
+  for (int y = 0; y < test_height; y++)
+    for (int x = 0; x < ctx.image_width; x++)
+      g_assert_cmpint (data[(x + xborder) * 4 + y * stride + 1], ==, fp_img->data[x + y * ctx.image_width]);
+
+  g_slist_free_full (frames, g_free);
+  cairo_surface_destroy (img);
+}
+
+typedef struct
+{
+  struct fpi_frame_asmbl_ctx ctx;
+  FpiFrameFormat             format;
+  unsigned int               stride;
+} format_ctx;
+
+/* Reference accessor for the frame formats, see FpiFrameFormat */
+static unsigned char
+format_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
+                  struct fpi_frame           *frame,
+                  unsigned int                x,
+                  unsigned int                y)
+{
+  format_ctx *f_ctx = (format_ctx *) ctx;
+  guint8 packed;
+  guint16 v;
+
+  switch (f_ctx->format)
+    {
+    case FPI_FRAME_FORMAT_4BIT_PACKED:
+      packed = frame->data[x * f_ctx->stride + y / 2];
+      return (y % 2 ? packed >> 4 : packed & 0xf) * 17;
+
+    case FPI_FRAME_FORMAT_16BIT:
+      memcpy (&v, frame->data + y * f_ctx->stride + x * 2, sizeof (v));
+      return v >> 8;
+
+    case FPI_FRAME_FORMAT_CALLBACK:
+    case FPI_FRAME_FORMAT_8BIT:
+    default:
+      return frame->data[y * f_ctx->stride + x];
+    }
+}
+
+static GSList *
+frames_from_surface (guchar *data, int surf_stride, int width, int height,
+                     int frame_height, int offset, FpiFrameFormat format,
+                     unsigned int stride)
+{
+  GSList *frames = NULL;
+
+  for (int y = 0; y + frame_height < height; y += offset)
+    {
+      struct fpi_frame *frame = g_malloc0 (sizeof (struct fpi_frame) +
+                                           stride * MAX (width, frame_height));
+
+      for (int fy = 0; fy < frame_height; fy++)
+        for (int x = 0; x < width; x++)
+          {
+            guint8 p = data[x * 4 + (y + fy) * surf_stride + 1];
+            guint16 v = p << 8 | (x & 0xff);
+
+            switch (format)
+              {
+              case FPI_FRAME_FORMAT_4BIT_PACKED:
+                frame->data[x * stride + fy / 2] |= fy % 2 ? p & 0xf0 : p >> 4;
+                break;
+
+              case FPI_FRAME_FORMAT_16BIT:
+                memcpy (frame->data + fy * stride + x * 2, &v, sizeof (v));
+                break;
+
+              case FPI_FRAME_FORMAT_CALLBACK:
+              case FPI_FRAME_FORMAT_8BIT:
+              default:
+                frame->data[fy * stride + x] = p;
+                break;
+              }
+          }
+
+      frames = g_slist_append (frames, frame);
+    }
+
+  return frames;
+}
+
+static void
+test_frame_assembling_formats (void)
+{
+  const FpiFrameFormat formats[] = {
+    FPI_FRAME_FORMAT_8BIT,
+    FPI_FRAME_FORMAT_4BIT_PACKED,
+    FPI_FRAME_FORMAT_16BIT,
+  };
+  g_autofree char *path = NULL;
+  cairo_surface_t *img = NULL;
+  int width, height, surf_stride;
+  guchar *data;
+
+  path = g_test_build_filename (G_TEST_DIST, "vfs5011", "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  data = cairo_image_surface_get_data (img);
+  width = cairo_image_surface_get_width (img);
+  height = cairo_image_surface_get_height (img);
+  surf_stride = cairo_image_surface_get_stride (img);
+
+  /* Check each format with tightly packed and padded frame data */
+  for (guint i = 0; i < 2 * G_N_ELEMENTS (formats); i++)
+    {
+      format_ctx ref_ctx = { { 0, }, };
+      struct fpi_frame_asmbl_ctx ctx = { 0, };
+      g_autoptr(FpImage) fp_img = NULL;
+      g_autoptr(FpImage) ref_img = NULL;
+      GSList *frames, *ref_frames;
+      FpiFrameFormat format = formats[i / 2];
+      gboolean padded = i % 2;
+
+      ctx.frame_width = width;
+      ctx.frame_height = 20;
+      ctx.image_width = width - 10;
+      ctx.format = format;
+
+      switch (format)
+        {
+        case FPI_FRAME_FORMAT_4BIT_PACKED:
+          ref_ctx.stride = ctx.frame_height / 2;
+          break;
+
+        case FPI_FRAME_FORMAT_16BIT:
+          ref_ctx.stride = width * 2;
+          break;
+
+        case FPI_FRAME_FORMAT_CALLBACK:
+        case FPI_FRAME_FORMAT_8BIT:
+        default:
+          ref_ctx.stride = width;
+          break;
+        }
+
+      if (padded)
+        {
+          ref_ctx.stride += 3;
+          ctx.stride = ref_ctx.stride;
+        }
+
+      ref_ctx.ctx = ctx;
+      ref_ctx.ctx.format = FPI_FRAME_FORMAT_CALLBACK;
+      ref_ctx.ctx.get_pixel = format_get_pixel;
+      ref_ctx.format = format;
+
+      frames = frames_from_surface (data, surf_stride, width, height,
+                                    ctx.frame_height, 7, format, ref_ctx.stride);
+      ref_frames = frames_from_surface (data, surf_stride, width, height,
+                                        ctx.frame_height, 7, format, ref_ctx.stride);
+
+      fpi_do_movement_estimation (&ref_ctx.ctx, ref_frames);
+      ref_img = fpi_assemble_frames (&ref_ctx.ctx, ref_frames);
+
+      fpi_do_movement_estimation (&ctx, frames);
+      fp_img = fpi_assemble_frames (&ctx, frames);
+
+      for (GSList *l = frames, *r = ref_frames; l != NULL; l = l->next, r = r->next)
+        {
+          struct fpi_frame *frame = l->data;
+          struct fpi_frame *ref_frame = r->data;
+
+          g_assert_cmpint (frame->delta_x, ==, ref_frame->delta_x);
+          g_assert_cmpint (frame->delta_y, ==, ref_frame->delta_y);
+        }
+
+      g_assert_cmpint (fp_img->width, ==, ref_img->width);
+      g_assert_cmpint (fp_img->height, ==, ref_img->height);
+      g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                       ref_img->data, ref_img->width * ref_img->height);
+
+      g_slist_free_full (frames, g_free);
+      g_slist_free_full (ref_frames, g_free);
+    }
+
+  cairo_surface_destroy (img);
+}
+
+/* Straight forward version of the movement estimation for comparison */
+static guint64
+reference_find_overlap (struct fpi_frame_asmbl_ctx *ctx,
+                        struct fpi_frame           *first_frame,
+                        struct fpi_frame           *second_frame,
+                        int                        *dx_out,
+                        int                        *dy_out)
+{
+  guint64 min_error = 255 * ctx->frame_height * ctx->frame_width;
+
+  for (int dy = 2; dy < ctx->frame_height; dy++)
+    {
+      for (int dx = -8; dx < 8; dx++)
+        {
+          unsigned int width = ctx->frame_width - ABS (dx);
+          unsigned int height = ctx->frame_height - dy;
+          guint64 err = 0;
+
+          for (guint y = 0; y < height; y++)
+            for (guint x = 0; x < width; x++)
+              err += ABS (first_frame->data[y * ctx->frame_width + x + MAX (dx, 0)] -
+                          second_frame->data[(y + dy) * ctx->frame_width + x + MAX (-dx, 0)]);
+
+          err = err * ctx->frame_height * ctx->frame_width / (height * width);
+          if (err < min_error)
+            {
+              min_error = err;
+              *dx_out = -dx;
+              *dy_out = dy;
+            }
+        }
+    }
+
+  return min_error;
+}
+
+static GSList *
+frames_from_capture (const char *driver, int frame_width, int frame_height)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *img = NULL;
+  GSList *frames = NULL;
+  int width, height, stride;
+  int x, y;
+  guchar *data;
+
+  path = g_test_build_filename (G_TEST_DIST, driver, "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  data = cairo_image_surface_get_data (img);
+  width = cairo_image_surface_get_width (img);
+  height = cairo_image_surface_get_height (img);
+  stride = cairo_image_surface_get_stride (img);
+  g_assert_cmpint (width, >=, frame_width + 16);
+
+  /* Random swipe with some horizontal movement */
+  x = (width - frame_width) / 2;
+  for (y = 0; y + frame_height <= height; y += g_random_int_range (2, frame_height / 2))
+    {
+      struct fpi_frame *frame = g_malloc (sizeof (struct fpi_frame) +
+                                          frame_width * frame_height);
+
+      x = CLAMP (x + g_random_int_range (-3, 4), 0, width - frame_width);
+      for (int fy = 0; fy < frame_height; fy++)
+        for (int fx = 0; fx < frame_width; fx++)
+          frame->data[fy * frame_width + fx] = data[(x + fx) * 4 + (y + fy) * stride + 1];
+
+      frames = g_slist_append (frames, frame);
+    }
+
+  cairo_surface_destroy (img);
+
+  return frames;
+}
+
+static void
+test_frame_assembling_overlap (void)
+{
+  /* AES2501 and elan frame geometries */
+  const struct
+  {
+    const char *driver;
+    int         width;
+    int         height;
+  } captures[] = {
+    { "aes2501", 192, 16 },
+    { "elan", 144, 50 },
+  };
+
+  for (guint c = 0; c < G_N_ELEMENTS (captures); c++)
+    {
+      struct fpi_frame_asmbl_ctx ctx = { 0, };
+      g_autofree int *deltas = NULL;
+      GSList *frames;
+      guint64 err = 0, rev_err = 0;
+      guint num_frames = 1;
+      gboolean forward;
+
+      ctx.frame_width = captures[c].width;
+      ctx.frame_height = captures[c].height;
+      ctx.image_width = captures[c].width * 3 / 2;
+      ctx.format = FPI_FRAME_FORMAT_8BIT;
+
+      frames = frames_from_capture (captures[c].driver, ctx.frame_width, ctx.frame_height);
+      deltas = g_new0 (int, 4 * g_slist_length (frames));
+      fpi_do_movement_estimation (&ctx, frames);
+
+      for (GSList *l = frames->next, *prev = frames; l != NULL; prev = l, l = l->next, num_frames++)
+        {
+          int *d = &deltas[4 * num_frames];
+
+          err += reference_find_overlap (&ctx, l->data, prev->data, &d[0], &d[1]);
+          rev_err += reference_find_overlap (&ctx, prev->data, l->data, &d[2], &d[3]);
+        }
+
+      forward = (int) (err / num_frames) < (int) (rev_err / num_frames);
+
+      num_frames = 1;
+      for (GSList *l = frames->next; l != NULL; l = l->next, num_frames++)
+        {
+          struct fpi_frame *frame = l->data;
+          int *d = &deltas[4 * num_frames];
+
+          g_assert_cmpint (frame->delta_x, ==, forward ? d[0] : -d[2]);
+          g_assert_cmpint (frame->delta_y, ==, forward ? d[1] : -d[3]);
+        }
+
+      g_slist_free_full (frames, g_free);
+    }
+}
+
+static void
+test_frame_assembler (void)
+{
+  const struct
+  {
+    const char *driver;
+    int         width;
+    int         height;
+  } captures[] = {
+    { "aes2501", 192, 16 },
+    { "elan", 144, 50 },
+  };
+
+  for (guint c = 0; c < G_N_ELEMENTS (captures); c++)
+    {
+      struct fpi_frame_asmbl_ctx ctx = { 0, };
+      g_autoptr(FpiFrameAssembler) assembler = NULL;
+      g_autoptr(FpImage) ref_img = NULL;
+      g_autoptr(FpImage) fp_img = NULL;
+      GSList *frames;
+
+      ctx.frame_width = captures[c].width;
+      ctx.frame_height = captures[c].height;
+      ctx.image_width = captures[c].width * 3 / 2;
+      ctx.format = FPI_FRAME_FORMAT_8BIT;
+
+      frames = frames_from_capture (captures[c].driver, ctx.frame_width, ctx.frame_height);
+
+      /* Movement estimated while the frames are added */
+      assembler = fpi_frame_assembler_new (&ctx, TRUE);
+      for (GSList *l = frames; l != NULL; l = l->next)
+        fpi_frame_assembler_add_frame (assembler, l->data);
+      g_assert_cmpuint (fpi_frame_assembler_get_n_frames (assembler), ==, g_slist_length (frames));
+
+      fp_img = fpi_frame_assembler_finish (assembler);
+      g_assert_cmpuint (fpi_frame_assembler_get_n_frames (assembler), ==, 0);
+
+      fpi_do_movement_estimation (&ctx, frames);
+      ref_img = fpi_assemble_frames (&ctx, frames);
+
+      g_assert_cmpint (fp_img->width, ==, ref_img->width);
+      g_assert_cmpint (fp_img->height, ==, ref_img->height);
+      g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                       ref_img->data, ref_img->width * ref_img->height);
+
+      /* Movement reported by the frames themselves, i.e. by the hardware */
+      g_clear_pointer (&assembler, fpi_frame_assembler_free);
+      g_clear_object (&fp_img);
+      g_clear_object (&ref_img);
+
+      for (GSList *l = frames->next; l != NULL; l = l->next)
+        {
+          struct fpi_frame *frame = l->data;
+
+          frame->delta_x = g_random_int_range (-3, 4);
+          frame->delta_y = g_random_int_range (1, ctx.frame_height / 2);
+        }
+
+      assembler = fpi_frame_assembler_new (&ctx, FALSE);
+      for (GSList *l = frames; l != NULL; l = l->next)
+        {
+          struct fpi_frame *frame = l->data;
+
+          /* Passing the data directly must not make a difference */
+          fpi_frame_assembler_add_frame_data (assembler, frame->data,
+                                              frame->delta_x, frame->delta_y);
+        }
+
+      fp_img = fpi_frame_assembler_finish (assembler);
+      ref_img = fpi_assemble_frames (&ctx, frames);
+
+      g_assert_cmpint (fp_img->height, ==, ref_img->height);
+      g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                       ref_img->data, ref_img->width * ref_img->height);
+
+      g_slist_free_full (frames, g_free);
+    }
+}
+
+static void
+movement_estimation_done_cb (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  GAsyncResult **result = user_data;
+
+  *result = g_object_ref (res);
+}
+
+static void
+test_frame_assembling_async (void)
+{
+  const struct
+  {
+    const char *driver;
+    int         width;
+    int         height;
+  } captures[] = {
+    { "aes2501", 192, 16 },
+    { "elan", 144, 50 },
+  };
+
+  for (guint c = 0; c < G_N_ELEMENTS (captures); c++)
+    {
+      struct fpi_frame_asmbl_ctx ctx = { 0, };
+      g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+      g_autoptr(GAsyncResult) res = NULL;
+      g_autoptr(GError) error = NULL;
+      g_autofree int *deltas = NULL;
+      GSList *frames;
+      guint i;
+
+      ctx.frame_width = captures[c].width;
+      ctx.frame_height = captures[c].height;
+      ctx.image_width = captures[c].width * 3 / 2;
+      ctx.format = FPI_FRAME_FORMAT_8BIT;
+
+      frames = frames_from_capture (captures[c].driver, ctx.frame_width, ctx.frame_height);
+      deltas = g_new0 (int, 2 * g_slist_length (frames));
+
+      fpi_do_movement_estimation (&ctx, frames);
+      i = 0;
+      for (GSList *l = frames; l != NULL; l = l->next, i++)
+        {
+          struct fpi_frame *frame = l->data;
+
+          deltas[2 * i] = frame->delta_x;
+          deltas[2 * i + 1] = frame->delta_y;
+          frame->delta_x = frame->delta_y = 0;
+        }
+
+      fpi_do_movement_estimation_async (&ctx, frames, cancellable,
+                                        movement_estimation_done_cb, &res);
+      while (res == NULL)
+        g_main_context_iteration (NULL, TRUE);
+
+      g_assert_true (fpi_do_movement_estimation_finish (res, &error));
+      g_assert_no_error (error);
+
+      i = 0;
+      for (GSList *l = frames; l != NULL; l = l->next, i++)
+        {
+          struct fpi_frame *frame = l->data;
+
+          g_assert_cmpint (frame->delta_x, ==, deltas[2 * i]);
+          g_assert_cmpint (frame->delta_y, ==, deltas[2 * i + 1]);
+        }
+
+      /* A cancelled estimation leaves the frames alone */
+      g_clear_object (&res);
+      g_cancellable_cancel (cancellable);
+      fpi_do_movement_estimation_async (&ctx, frames, cancellable,
+                                        movement_estimation_done_cb, &res);
+      while (res == NULL)
+        g_main_context_iteration (NULL, TRUE);
+
+      g_assert_false (fpi_do_movement_estimation_finish (res, &error));
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+      g_slist_free_full (frames, g_free);
+    }
+}
+
+static void
+test_frame_store (void)
+{
+  g_autoptr(FpiFrameStore) store = NULL;
+  const gsize item_size = 5;
+  guint i;
+
+  /* Reserve less than needed to test growing */
+  store = fpi_frame_store_new (item_size, 3);
+  g_assert_cmpuint (fpi_frame_store_get_n_items (store), ==, 0);
+
+  for (i = 0; i < 100; i++)
+    {
+      guint8 *item = fpi_frame_store_append (store);
+
+      for (gsize j = 0; j < item_size; j++)
+        g_assert_cmpuint (item[j], ==, 0);
+      memset (item, i, item_size);
+    }
+
+  g_assert_cmpuint (fpi_frame_store_get_n_items (store), ==, 100);
+  for (i = 0; i < 100; i++)
+    {
+      guint8 *item = fpi_frame_store_get (store, i);
+
+      /* Items are adjacent */
+      g_assert_true (item == (guint8 *) fpi_frame_store_get (store, 0) + i * item_size);
+      for (gsize j = 0; j < item_size; j++)
+        g_assert_cmpuint (item[j], ==, i);
+    }
+
+  fpi_frame_store_clear (store);
+  g_assert_cmpuint (fpi_frame_store_get_n_items (store), ==, 0);
+}
+
+static void
+test_frame_assembling_store (void)
+{
+  struct fpi_frame_asmbl_ctx ctx = { 0, };
+  g_autoptr(FpiFrameStore) store = NULL;
+  g_autoptr(FpImage) ref_img = NULL;
+  g_autoptr(FpImage) fp_img = NULL;
+  GSList *frames;
+  gsize frame_size;
+  guint i;
+
+  ctx.frame_width = 192;
+  ctx.frame_height = 16;
+  ctx.image_width = ctx.frame_width * 3 / 2;
+  ctx.format = FPI_FRAME_FORMAT_8BIT;
+  frame_size = ctx.frame_width * ctx.frame_height;
+
+  frames = frames_from_capture ("aes2501", ctx.frame_width, ctx.frame_height);
+
+  store = fpi_frame_store_new (sizeof (struct fpi_frame) + frame_size, 8);
+  for (GSList *l = frames; l != NULL; l = l->next)
+    {
+      struct fpi_frame *frame = fpi_frame_store_append (store);
+
+      memcpy (frame->data, ((struct fpi_frame *) l->data)->data, frame_size);
+    }
+
+  fpi_do_movement_estimation (&ctx, frames);
+  fpi_do_movement_estimation_store (&ctx, store);
+
+  i = 0;
+  for (GSList *l = frames; l != NULL; l = l->next, i++)
+    {
+      struct fpi_frame *ref_frame = l->data;
+      struct fpi_frame *frame = fpi_frame_store_get (store, i);
+
+      g_assert_cmpint (frame->delta_x, ==, ref_frame->delta_x);
+      g_assert_cmpint (frame->delta_y, ==, ref_frame->delta_y);
+    }
+
+  ref_img = fpi_assemble_frames (&ctx, frames);
+  fp_img = fpi_assemble_frames_store (&ctx, store);
+
+  g_assert_cmpint (fp_img->height, ==, ref_img->height);
+  g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                   ref_img->data, ref_img->width * ref_img->height);
+
+  g_slist_free_full (frames, g_free);
+}
+
+static int
+test_line_deviation (struct fpi_line_asmbl_ctx *ctx,
+                     gconstpointer              line1,
+                     gconstpointer              line2)
+{
+  const guint8 *buf1 = line1, *buf2 = line2;
+  int res = 0;
+
+  for (unsigned int i = 0; i < ctx->line_width; i++)
+    res += ABS ((int) buf1[i] - (int) buf2[i]);
+
+  return res;
+}
+
+/* Lines of a slow swipe over a capture, each image row appears a few times */
+static FpiFrameStore *
+lines_from_capture (const char *driver, unsigned int line_width)
+{
+  g_autofree char *path = NULL;
+  FpiFrameStore *store;
+  cairo_surface_t *img;
+  guchar *data;
+  int stride, height;
+
+  path = g_test_build_filename (G_TEST_DIST, driver, "capture.png", NULL);
+  img = cairo_image_surface_create_from_png (path);
+  data = cairo_image_surface_get_data (img);
+  stride = cairo_image_surface_get_stride (img);
+  height = cairo_image_surface_get_height (img);
+  g_assert_cmpint (cairo_image_surface_get_width (img), >=, line_width);
+
+  store = fpi_frame_store_new (line_width, 16);
+
+  for (int y = 0; y < height; y++)
+    {
+      for (int n = g_random_int_range (1, 4); n > 0; n--)
+        {
+          guint8 *line = fpi_frame_store_append (store);
+
+          for (unsigned int x = 0; x < line_width; x++)
+            line[x] = data[x * 4 + y * stride + 1];
+        }
+    }
+
+  cairo_surface_destroy (img);
+
+  return store;
+}
+
+static void
+test_line_assembling_store (void)
+{
+  struct fpi_line_asmbl_ctx ctx = {
+    .line_width = 64,
+    .max_height = 1024,
+    .resolution = 10,
+    .median_filter_size = 25,
+    .max_search_offset = 30,
+    .get_deviation = test_line_deviation,
+    .format = FPI_FRAME_FORMAT_8BIT,
+  };
+  g_autoptr(FpiFrameStore) store = NULL;
+  g_autoptr(FpImage) ref_img = NULL;
+  g_autoptr(FpImage) fp_img = NULL;
+  GSList *lines = NULL;
+
+  store = lines_from_capture ("vfs5011", ctx.line_width);
+
+  for (guint i = fpi_frame_store_get_n_items (store); i > 0; i--)
+    lines = g_slist_prepend (lines, fpi_frame_store_get (store, i - 1));
+
+  ref_img = fpi_assemble_lines (&ctx, lines, g_slist_length (lines));
+  fp_img = fpi_assemble_lines_store (&ctx, store);
+
+  g_assert_cmpint (fp_img->width, ==, ref_img->width);
+  g_assert_cmpint (fp_img->height, ==, ref_img->height);
+  g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                   ref_img->data, ref_img->width * ref_img->height);
+
+  g_slist_free (lines);
+}
+
+/* Two pass calculation as done by the drivers before */
+static int
+reference_line_deviation (const guint8 *line1, const guint8 *line2,
+                          int size, int step)
+{
+  int res = 0, mean = 0, i;
+
+  for (i = 0; i < size; i++)
+    mean += (int) line1[i * step] + (int) line2[i * step];
+
+  mean /= size;
+
+  for (i = 0; i < size; i++)
+    {
+      int dev = (int) line1[i * step] + (int) line2[i * step] - mean;
+      res += dev * dev;
+    }
+
+  return res / size;
+}
+
+static void
+test_line_deviation_kernel (void)
+{
+  for (int i = 0; i < 10000; i++)
+    {
+      int step = g_random_int_range (1, 4);
+      int size = g_random_int_range (1, 300);
+      gboolean saturated = i % 10 == 0;
+      /* Exactly sized, so that reading past the lines is caught by valgrind */
+      g_autofree guint8 *line1 = g_malloc (size * step);
+      g_autofree guint8 *line2 = g_malloc (size * step);
+
+      for (int j = 0; j < size * step; j++)
+        {
+          line1[j] = saturated ? 255 : g_random_int_range (0, 256);
+          line2[j] = saturated ? 255 : g_random_int_range (0, 256);
+        }
+
+      g_assert_cmpint (fpi_line_sum_std_sq_dev (line1, line2, size, step), ==,
+                       reference_line_deviation (line1, line2, size, step));
+    }
+}
+
+static void
+test_line_assembling_perf (void)
+{
+  struct fpi_line_asmbl_ctx ctx = {
+    .line_width = 64,
+    .max_height = 1024,
+    .resolution = 10,
+    .median_filter_size = 25,
+    .max_search_offset = 30,
+    .get_deviation = test_line_deviation,
+    .format = FPI_FRAME_FORMAT_8BIT,
+  };
+  g_autoptr(FpiFrameStore) store = NULL;
+  const int iterations = 50;
+  guint num_lines;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in performance mode");
+      return;
+    }
+
+  store = lines_from_capture ("vfs5011", ctx.line_width);
+  num_lines = fpi_frame_store_get_n_items (store);
+
+  g_test_timer_start ();
+  for (int i = 0; i < iterations; i++)
+    g_object_unref (fpi_assemble_lines_store (&ctx, store));
+  g_test_minimized_result (g_test_timer_elapsed () / iterations / num_lines * 1e6,
+                           "line assembly (%u lines): %.2f us per line",
+                           num_lines, g_test_timer_last () / iterations / num_lines * 1e6);
+}
+
+static void
+test_frame_assembling_perf (void)
+{
+  const struct
+  {
+    const char *driver;
+    int         width;
+    int         height;
+  } captures[] = {
+    { "aes2501", 192, 16 },
+    { "elan", 144, 50 },
+  };
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in performance mode");
+      return;
+    }
+
+  for (guint c = 0; c < G_N_ELEMENTS (captures); c++)
+    {
+      struct fpi_frame_asmbl_ctx ctx = { 0, };
+      GSList *frames;
+      guint num_frames;
+      const int iterations = 20;
+
+      ctx.frame_width = captures[c].width;
+      ctx.frame_height = captures[c].height;
+      ctx.image_width = captures[c].width * 3 / 2;
+      ctx.format = FPI_FRAME_FORMAT_8BIT;
+
+      frames = frames_from_capture (captures[c].driver, ctx.frame_width, ctx.frame_height);
+      num_frames = g_slist_length (frames);
+
+      g_test_timer_start ();
+      for (int i = 0; i < iterations; i++)
+        fpi_do_movement_estimation (&ctx, frames);
+      g_test_minimized_result (g_test_timer_elapsed () / iterations / num_frames * 1e6,
+                               "%s movement estimation (%dx%d): %.1f us per stripe",
+                               captures[c].driver, ctx.frame_width, ctx.frame_height,
+                               g_test_timer_last () / iterations / num_frames * 1e6);
+
+      g_slist_free_full (frames, g_free);
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/assembling/frames", test_frame_assembling);
+  g_test_add_func ("/assembling/frames/reverse", test_frame_assembling_reverse);
+  g_test_add_func ("/assembling/frames/formats", test_frame_assembling_formats);
+  g_test_add_func ("/assembling/frames/overlap", test_frame_assembling_overlap);
+  g_test_add_func ("/assembling/frames/assembler", test_frame_assembler);
+  g_test_add_func ("/assembling/frames/async", test_frame_assembling_async);
+  g_test_add_func ("/assembling/frames/perf", test_frame_assembling_perf);
+  g_test_add_func ("/assembling/store", test_frame_store);
+  g_test_add_func ("/assembling/frames/store", test_frame_assembling_store);
+  g_test_add_func ("/assembling/lines/store", test_line_assembling_store);
+  g_test_add_func ("/assembling/lines/deviation", test_line_deviation_kernel);
+  g_test_add_func ("/assembling/lines/perf", test_line_assembling_perf);
 
   return g_test_run ();
 }
@@ -26,8 +26,11 @@
 #include "fpi-device.h"
 #include "fpi-compat.h"
 #include "fpi-log.h"
+#include "fpi-usb-transfer.h"
+#include "fpi-regmap.h"
 #include "test-device-fake.h"
 #include "fp-print-private.h"
+#include "fp-device-private.h"
 
 /* gcc 12.0.1 is complaining about dangling pointers in the auto_close* functions */
 #if G_GNUC_CHECK_VERSION (12, 0)
@@ -533,6 +536,223 @@ test_driver_get_driver_data (void)
   g_assert_cmpuint (fpi_device_get_driver_data (device), ==, driver_data);
 }
 
+static void
+test_driver_poll_schedule (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  const guint backoff[] = { 10, 20, 40, 80, 160, 250, 250 };
+  guint polls, captures;
+  gint64 mean_delay, max_delay;
+  guint i;
+
+  /* Fast polling for about a second, then exponential back-off */
+  for (i = 0; i < 1000 / 10; i++)
+    g_assert_cmpuint (fpi_device_poll_next_interval (device), ==, 10);
+  for (i = 0; i < G_N_ELEMENTS (backoff); i++)
+    g_assert_cmpuint (fpi_device_poll_next_interval (device), ==, backoff[i]);
+
+  fpi_device_get_poll_stats (device, &polls, &captures, NULL, NULL);
+  g_assert_cmpuint (polls, ==, 1000 / 10 + G_N_ELEMENTS (backoff));
+  g_assert_cmpuint (captures, ==, 0);
+
+  /* A capture records the delay and goes back to fast polling */
+  g_usleep (1000);
+  fpi_device_poll_report_capture (device);
+  fpi_device_get_poll_stats (device, &polls, &captures,
+                             &mean_delay, &max_delay);
+  g_assert_cmpuint (captures, ==, 1);
+  g_assert_cmpint (mean_delay, >=, 1000);
+  g_assert_cmpint (max_delay, ==, mean_delay);
+  g_assert_cmpuint (fpi_device_poll_next_interval (device), ==, 10);
+
+  /* Without a poll there is nothing to measure */
+  fpi_device_poll_reset (device);
+  fpi_device_poll_report_capture (device);
+  fpi_device_get_poll_stats (device, NULL, &captures, NULL, NULL);
+  g_assert_cmpuint (captures, ==, 1);
+
+  /* Finger hints go back to fast polling too */
+  for (i = 0; i < 1000 / 10 + 2; i++)
+    fpi_device_poll_next_interval (device);
+  g_assert_cmpuint (fpi_device_poll_next_interval (device), ==, 40);
+  fpi_device_report_finger_status (device, FP_FINGER_STATUS_PRESENT);
+  g_assert_cmpuint (fpi_device_poll_next_interval (device), ==, 10);
+}
+
+static void
+test_driver_calibration_cache (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(FpDevice) other_device = NULL;
+  g_autoptr(GBytes) data = g_bytes_new_static ("calibration", 12);
+  g_autoptr(GBytes) loaded = NULL;
+
+  g_assert_null (fpi_device_calibration_load (device, "fw1", 0));
+
+  fpi_device_calibration_save (device, "fw1", data);
+  loaded = fpi_device_calibration_load (device, "fw1", 0);
+  g_assert_true (g_bytes_equal (loaded, data));
+  g_clear_pointer (&loaded, g_bytes_unref);
+
+  /* Other firmware versions do not match */
+  g_assert_null (fpi_device_calibration_load (device, "fw2", 0));
+
+  /* The data survives the device being re-created */
+  g_clear_object (&device);
+  other_device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  loaded = fpi_device_calibration_load (other_device, "fw1", 0);
+  g_assert_true (g_bytes_equal (loaded, data));
+  g_clear_pointer (&loaded, g_bytes_unref);
+
+  fpi_device_calibration_clear (other_device);
+  g_assert_null (fpi_device_calibration_load (other_device, "fw1", 0));
+
+  /* Stale data is dropped */
+  fpi_device_calibration_save (other_device, "fw1", data);
+  g_usleep (1100 * G_TIME_SPAN_MILLISECOND);
+  g_assert_null (fpi_device_calibration_load (other_device, "fw1", 1));
+  g_assert_null (fpi_device_calibration_load (other_device, "fw1", 0));
+}
+
+static void
+test_driver_usb_transfer_pool (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  FpiUsbTransferPool *pool = fpi_device_get_usb_transfer_pool (device);
+  FpiUsbTransfer *transfer, *old_transfer;
+  guint8 *old_buffer;
+  guint hits, misses;
+  gsize cached;
+
+  g_assert_nonnull (pool);
+
+  transfer = fpi_usb_transfer_new (device);
+  fpi_usb_transfer_fill_bulk (transfer, 0x81, 100);
+  memset (transfer->buffer, 0xaa, 100);
+  old_transfer = transfer;
+  old_buffer = transfer->buffer;
+  fpi_usb_transfer_unref (transfer);
+
+  fpi_usb_transfer_pool_get_stats (pool, &hits, &misses, &cached);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (misses, ==, 2);
+  g_assert_cmpuint (cached, ==, 128);
+
+  /* Both the transfer and the buffer are reused, and the buffer is cleared */
+  transfer = fpi_usb_transfer_new (device);
+  g_assert_true (transfer == old_transfer);
+  g_assert_cmpint (transfer->type, ==, FP_TRANSFER_NONE);
+  fpi_usb_transfer_fill_control (transfer,
+                                 G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST,
+                                 G_USB_DEVICE_REQUEST_TYPE_VENDOR,
+                                 G_USB_DEVICE_RECIPIENT_DEVICE,
+                                 0x0c, 0, 0, 120);
+  g_assert_true (transfer->buffer == old_buffer);
+  for (gsize i = 0; i < 120; i++)
+    g_assert_cmpuint (transfer->buffer[i], ==, 0);
+
+  fpi_usb_transfer_pool_get_stats (pool, &hits, &misses, &cached);
+  g_assert_cmpuint (hits, ==, 2);
+  g_assert_cmpuint (misses, ==, 2);
+  g_assert_cmpuint (cached, ==, 0);
+
+  /* A stolen buffer belongs to the caller */
+  g_free (g_steal_pointer (&transfer->buffer));
+  fpi_usb_transfer_unref (transfer);
+
+  fpi_usb_transfer_pool_get_stats (pool, NULL, NULL, &cached);
+  g_assert_cmpuint (cached, ==, 0);
+
+  /* Huge buffers are not kept */
+  transfer = fpi_usb_transfer_new (device);
+  fpi_usb_transfer_fill_bulk (transfer, 0x81, 1024 * 1024);
+  fpi_usb_transfer_unref (transfer);
+
+  fpi_usb_transfer_pool_get_stats (pool, &hits, &misses, &cached);
+  g_assert_cmpuint (hits, ==, 3);
+  g_assert_cmpuint (misses, ==, 3);
+  g_assert_cmpuint (cached, ==, 0);
+
+  /* The transfer keeps the pool alive */
+  transfer = fpi_usb_transfer_new (device);
+  fpi_usb_transfer_fill_bulk (transfer, 0x81, 64);
+  g_clear_object (&device);
+  fpi_usb_transfer_unref (transfer);
+}
+
+static guint regmap_n_packed;
+
+static guint
+test_driver_regmap_pack (FpiUsbTransfer       *transfer,
+                         const FpiRegmapWrite *writes,
+                         guint                 n_writes)
+{
+  guint n = MIN (n_writes, 2);
+
+  fpi_usb_transfer_fill_bulk (transfer, 0x02, n * 2);
+  for (guint i = 0; i < n; i++)
+    {
+      g_assert_cmpuint (writes[i].reg, !=, FPI_REGMAP_SYNC);
+      transfer->buffer[i * 2] = writes[i].reg;
+      transfer->buffer[i * 2 + 1] = writes[i].value;
+    }
+
+  regmap_n_packed += n;
+
+  return n;
+}
+
+typedef struct
+{
+  gboolean done;
+  GError  *error;
+} RegmapResult;
+
+static void
+test_driver_regmap_cb (FpDevice *device,
+                       gpointer  user_data,
+                       GError   *error)
+{
+  RegmapResult *result = user_data;
+
+  g_assert_false (result->done);
+  result->done = TRUE;
+  result->error = error;
+}
+
+static void
+test_driver_regmap_cancelled (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  RegmapResult result = { 0 };
+  const FpiRegmapProtocol protocol = {
+    .pack = test_driver_regmap_pack,
+    .max_in_flight = 2,
+  };
+  const FpiRegmapWrite writes[] = {
+    { 1, 0x11 }, { 2, 0x22 }, { 3, 0x33 },
+    { FPI_REGMAP_SYNC, 0 },
+    { 4, 0x44 }, { 5, 0x55 },
+  };
+
+  /* A cancelled cancellable fails the transfers before they reach the
+   * device. Only the writes before the sync point are packed, up to
+   * max_in_flight transfers, and nothing is sent after the error. */
+  regmap_n_packed = 0;
+  g_cancellable_cancel (cancellable);
+  fpi_regmap_write_full (device, &protocol, writes, G_N_ELEMENTS (writes),
+                         cancellable, test_driver_regmap_cb, &result);
+  g_assert_false (result.done);
+  g_assert_cmpuint (regmap_n_packed, ==, 3);
+
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_error (result.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpuint (regmap_n_packed, ==, 3);
+  g_clear_error (&result.error);
+}
+
 static void
 test_driver_features_probe_updates (void)
 {
@@ -1296,6 +1516,218 @@ test_driver_enroll_progress (void)
   g_assert (fake_dev->last_called_function == test_driver_enroll_progress_vfunc);
 }
 
+typedef struct
+{
+  GThread *driver_thread;
+  GThread *progress_thread;
+  GThread *notify_thread;
+} WorkerThreadData;
+
+static void
+test_driver_worker_thread_enroll (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  WorkerThreadData *data = fake_dev->user_data;
+
+  data->driver_thread = g_thread_self ();
+
+  fpi_device_report_finger_status (device, FP_FINGER_STATUS_NEEDED);
+  fpi_device_enroll_progress (device, 1, NULL, NULL);
+
+  default_fake_dev_class.enroll (device);
+}
+
+static void
+test_driver_worker_thread_progress (FpDevice *device,
+                                    gint      completed_stages,
+                                    FpPrint  *print,
+                                    gpointer  user_data,
+                                    GError   *error)
+{
+  WorkerThreadData *data = user_data;
+
+  data->progress_thread = g_thread_self ();
+}
+
+static void
+test_driver_worker_thread_notify (FpDevice         *device,
+                                  GParamSpec       *pspec,
+                                  WorkerThreadData *data)
+{
+  data->notify_thread = g_thread_self ();
+}
+
+static void
+test_driver_worker_thread (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  g_autoptr(GError) error = NULL;
+  WorkerThreadData data = { 0 };
+  FpiDeviceFake *fake_dev;
+
+  dev_class->enroll = test_driver_worker_thread_enroll;
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  fake_dev = FPI_DEVICE_FAKE (device);
+  fake_dev->user_data = &data;
+
+  fp_device_set_worker_thread (device, TRUE);
+  g_signal_connect (device, "notify::finger-status",
+                    G_CALLBACK (test_driver_worker_thread_notify), &data);
+
+  g_assert_true (fp_device_open_sync (device, NULL, &error));
+  g_assert_no_error (error);
+  g_assert (fake_dev->last_called_function == dev_class->open);
+
+  enrolled_print = fp_device_enroll_sync (device, fp_print_new (device), NULL,
+                                          test_driver_worker_thread_progress,
+                                          &data, &error);
+  g_assert_no_error (error);
+  g_assert_true (FP_IS_PRINT (enrolled_print));
+
+  /* The driver runs on the worker, the API user only sees this thread */
+  g_assert_nonnull (data.driver_thread);
+  g_assert (data.driver_thread != g_thread_self ());
+  g_assert (data.progress_thread == g_thread_self ());
+  g_assert (data.notify_thread == g_thread_self ());
+
+  g_test_expect_message (G_LOG_DOMAIN, G_LOG_LEVEL_CRITICAL,
+                         "*assertion*is_open*failed");
+  fp_device_set_worker_thread (device, FALSE);
+  g_test_assert_expected_messages ();
+}
+
+typedef struct
+{
+  FpPrint *enrolled_print;
+  GSource *timeout;
+  guint    delay_ms;
+  guint    matched;
+  gboolean done;
+  gboolean success;
+} WorkerCancelData;
+
+static void
+test_driver_worker_thread_verify_timeout (FpDevice *device,
+                                          gpointer  user_data)
+{
+  WorkerCancelData *data = FPI_DEVICE_FAKE (device)->user_data;
+
+  data->timeout = NULL;
+  fpi_device_verify_complete (device, NULL);
+}
+
+static void
+test_driver_worker_thread_verify (FpDevice *device)
+{
+  WorkerCancelData *data = FPI_DEVICE_FAKE (device)->user_data;
+
+  fpi_device_verify_report (device, FPI_MATCH_SUCCESS, fp_print_new (device), NULL);
+  data->timeout = fpi_device_add_timeout (device, data->delay_ms,
+                                          test_driver_worker_thread_verify_timeout,
+                                          NULL, NULL);
+}
+
+static void
+test_driver_worker_thread_cancel (FpDevice *device)
+{
+  WorkerCancelData *data = FPI_DEVICE_FAKE (device)->user_data;
+
+  g_clear_pointer (&data->timeout, g_source_destroy);
+  fpi_device_verify_complete (device,
+                              g_error_new (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                           "Cancelled"));
+}
+
+static void
+test_driver_worker_thread_match (FpDevice *device,
+                                 FpPrint  *match,
+                                 FpPrint  *print,
+                                 gpointer  user_data,
+                                 GError   *error)
+{
+  WorkerCancelData *data = user_data;
+
+  g_assert_no_error (error);
+  g_assert (match == data->enrolled_print);
+  g_assert_true (FP_IS_PRINT (print));
+  data->matched += 1;
+}
+
+static void
+test_driver_worker_thread_verify_cb (GObject      *source_object,
+                                     GAsyncResult *res,
+                                     gpointer      user_data)
+{
+  g_autoptr(GError) error = NULL;
+  WorkerCancelData *data = user_data;
+  gboolean match = FALSE;
+
+  data->done = TRUE;
+  if (fp_device_verify_finish (FP_DEVICE (source_object), res, &match, NULL, &error))
+    {
+      g_assert_true (match);
+      data->success = TRUE;
+    }
+  else
+    {
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+      data->success = FALSE;
+    }
+}
+
+static void
+test_driver_worker_thread_cancel_stress (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  g_autoptr(GError) error = NULL;
+  WorkerCancelData data = { 0 };
+  guint succeeded = 0;
+  guint i, j;
+
+  dev_class->verify = test_driver_worker_thread_verify;
+  dev_class->cancel = test_driver_worker_thread_cancel;
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  FPI_DEVICE_FAKE (device)->user_data = &data;
+  enrolled_print = make_fake_print_reffed (device, NULL);
+  data.enrolled_print = enrolled_print;
+
+  fp_device_set_worker_thread (device, TRUE);
+  g_assert_true (fp_device_open_sync (device, NULL, &error));
+  g_assert_no_error (error);
+
+  /* Cancel at varying points, racing the report and the completion on the
+   * worker, the outcome of each verify is either a match or cancelled. */
+  for (i = 0; i < 100; i++)
+    {
+      g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+
+      data.done = FALSE;
+      data.delay_ms = i % 3;
+      fp_device_verify (device, enrolled_print, cancellable,
+                        test_driver_worker_thread_match, &data, NULL,
+                        test_driver_worker_thread_verify_cb, &data);
+
+      for (j = 0; j < i % 4; j++)
+        g_main_context_iteration (NULL, FALSE);
+      g_usleep ((i % 5) * 200);
+      g_cancellable_cancel (cancellable);
+
+      while (!data.done)
+        g_main_context_iteration (NULL, TRUE);
+
+      /* The driver always reports the match before it can be cancelled */
+      g_assert_cmpuint (data.matched, ==, i + 1);
+      if (data.success)
+        succeeded += 1;
+    }
+
+  g_debug ("%u of 100 verify operations completed before cancellation", succeeded);
+}
+
 typedef struct
 {
   gboolean   called;
@@ -2558,6 +2990,69 @@ test_driver_list (void)
   g_assert (prints == fake_dev->ret_list);
 }
 
+static void
+test_driver_list_cache (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(FpAutoCloseDevice) device = auto_close_fake_device_new ();
+  g_autoptr(GPtrArray) prints = make_fake_prints_gallery (device, 5);
+  g_autoptr(GPtrArray) listed = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  FpDeviceClass *dev_class = FP_DEVICE_GET_CLASS (device);
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  guint hits, misses;
+
+  fp_device_set_print_list_cache (device, TRUE);
+
+  fake_dev->ret_list = prints;
+  listed = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->list);
+  g_assert_no_error (error);
+  g_assert (listed == prints);
+  g_steal_pointer (&listed);
+
+  /* The second call does not reach the driver */
+  fake_dev->last_called_function = NULL;
+  listed = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert_null (fake_dev->last_called_function);
+  g_assert_no_error (error);
+  g_assert (listed != prints);
+  g_assert_cmpuint (listed->len, ==, prints->len);
+  for (guint i = 0; i < prints->len; i++)
+    g_assert (g_ptr_array_index (listed, i) == g_ptr_array_index (prints, i));
+  g_clear_pointer (&listed, g_ptr_array_unref);
+
+  fp_device_get_print_list_cache_stats (device, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 1);
+  g_assert_cmpuint (misses, ==, 1);
+
+  /* Deleting a print drops the cache */
+  enrolled_print = g_object_ref (g_ptr_array_index (prints, 0));
+  g_assert_true (fp_device_delete_print_sync (device, enrolled_print, NULL, &error));
+  g_assert_no_error (error);
+
+  g_ptr_array_remove_index (prints, 0);
+  fake_dev->ret_list = g_ptr_array_ref (prints);
+  listed = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->list);
+  g_assert_no_error (error);
+  g_assert_cmpuint (listed->len, ==, 4);
+  g_clear_pointer (&listed, g_ptr_array_unref);
+
+  /* Disabling the cache drops it as well */
+  fp_device_set_print_list_cache (device, FALSE);
+  fp_device_set_print_list_cache (device, TRUE);
+  fake_dev->ret_list = g_ptr_array_ref (prints);
+  fake_dev->last_called_function = NULL;
+  listed = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->list);
+  g_clear_pointer (&listed, g_ptr_array_unref);
+
+  fp_device_get_print_list_cache_stats (device, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 1);
+  g_assert_cmpuint (misses, ==, 3);
+}
+
 static void
 test_driver_list_error (void)
 {
@@ -3415,6 +3910,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/get_usb_device", test_driver_get_usb_device);
   g_test_add_func ("/driver/get_virtual_env", test_driver_get_virtual_env);
   g_test_add_func ("/driver/get_driver_data", test_driver_get_driver_data);
+  g_test_add_func ("/driver/usb_transfer_pool", test_driver_usb_transfer_pool);
+  g_test_add_func ("/driver/regmap/cancelled", test_driver_regmap_cancelled);
+  g_test_add_func ("/driver/poll_schedule", test_driver_poll_schedule);
+  g_test_add_func ("/driver/calibration_cache", test_driver_calibration_cache);
   g_test_add_func ("/driver/features/probe_updates", test_driver_features_probe_updates);
   g_test_add_func ("/driver/initial_features", test_driver_initial_features);
   g_test_add_func ("/driver/initial_features/none", test_driver_initial_features_none);
@@ -3438,6 +3937,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/enroll/error", test_driver_enroll_error);
   g_test_add_func ("/driver/enroll/error/no_print", test_driver_enroll_error_no_print);
   g_test_add_func ("/driver/enroll/progress", test_driver_enroll_progress);
+  g_test_add_func ("/driver/worker_thread", test_driver_worker_thread);
+  g_test_add_func ("/driver/worker_thread/cancel_stress", test_driver_worker_thread_cancel_stress);
   g_test_add_func ("/driver/enroll/update_nbis", test_driver_enroll_update_nbis);
   g_test_add_func ("/driver/enroll/update_nbis_wrong_device",
                    test_driver_enroll_update_nbis_wrong_device);
@@ -3472,6 +3973,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/capture/not_supported", test_driver_capture_not_supported);
   g_test_add_func ("/driver/capture/error", test_driver_capture_error);
   g_test_add_func ("/driver/list", test_driver_list);
+  g_test_add_func ("/driver/list/cache", test_driver_list_cache);
   g_test_add_func ("/driver/list/error", test_driver_list_error);
   g_test_add_func ("/driver/list/no_storage", test_driver_list_no_storage);
   g_test_add_func ("/driver/delete", test_driver_delete);
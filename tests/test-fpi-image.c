@@ -0,0 +1,478 @@
+/*
+ * Unit tests for libfprint internal image routines
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include "fpi-image.h"
+
+#ifdef HAVE_PIXMAN
+#include <pixman.h>
+#endif
+
+static void
+test_image_pool_recycle (void)
+{
+  g_autoptr(FpiImagePool) pool = fpi_image_pool_new (1024 * 1024);
+  g_autoptr(FpImage) image = NULL;
+  guint8 *data;
+  guint hits, misses;
+  gsize cached;
+
+  image = fpi_image_new_pooled (pool, 64, 32);
+  g_assert_cmpuint (image->width, ==, 64);
+  g_assert_cmpuint (image->height, ==, 32);
+
+  data = image->data;
+  memset (data, 0xaa, 64 * 32);
+  g_clear_object (&image);
+
+  fpi_image_pool_get_stats (pool, &hits, &misses, &cached);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (misses, ==, 1);
+  g_assert_cmpuint (cached, ==, 64 * 32);
+
+  /* Same dimensions reuse the buffer */
+  image = fpi_image_new_pooled (pool, 32, 64);
+  g_assert_true (image->data == data);
+
+  fpi_image_pool_get_stats (pool, &hits, &misses, &cached);
+  g_assert_cmpuint (hits, ==, 1);
+  g_assert_cmpuint (misses, ==, 1);
+  g_assert_cmpuint (cached, ==, 0);
+
+  /* Different sizes do not */
+  fpi_image_pool_release (pool, fpi_image_pool_alloc (pool, 100), 100);
+  fpi_image_pool_get_stats (pool, &hits, &misses, &cached);
+  g_assert_cmpuint (hits, ==, 1);
+  g_assert_cmpuint (misses, ==, 2);
+  g_assert_cmpuint (cached, ==, 100);
+}
+
+static void
+test_image_pool_max_cached (void)
+{
+  g_autoptr(FpiImagePool) pool = fpi_image_pool_new (300);
+  gpointer buffers[4];
+  gsize cached;
+
+  for (guint i = 0; i < G_N_ELEMENTS (buffers); i++)
+    buffers[i] = fpi_image_pool_alloc (pool, 100);
+
+  for (guint i = 0; i < G_N_ELEMENTS (buffers); i++)
+    fpi_image_pool_release (pool, buffers[i], 100);
+
+  /* Only three of the buffers fit */
+  fpi_image_pool_get_stats (pool, NULL, NULL, &cached);
+  g_assert_cmpuint (cached, ==, 300);
+}
+
+static void
+test_image_pool_resized (void)
+{
+  g_autoptr(FpiImagePool) pool = fpi_image_pool_new (1024 * 1024);
+  g_autoptr(FpImage) image = NULL;
+  gsize cached;
+
+  /* Drivers may shrink an image after filling it, the buffer still goes
+   * back with the size it was allocated with. */
+  image = fpi_image_new_pooled (pool, 64, 32);
+  image->height = 16;
+  g_clear_object (&image);
+
+  fpi_image_pool_get_stats (pool, NULL, NULL, &cached);
+  g_assert_cmpuint (cached, ==, 64 * 32);
+
+  image = fpi_image_new_pooled (pool, 64, 16);
+  fpi_image_pool_get_stats (pool, NULL, NULL, &cached);
+  g_assert_cmpuint (cached, ==, 64 * 32);
+}
+
+static void
+test_image_pool_outlives_owner (void)
+{
+  g_autoptr(FpiImagePool) pool = fpi_image_pool_new (1024 * 1024);
+  g_autoptr(FpImage) image = NULL;
+
+  image = fpi_image_new_pooled (pool, 16, 16);
+
+  /* The image keeps the pool alive */
+  g_clear_pointer (&pool, fpi_image_pool_unref);
+  g_clear_object (&image);
+}
+
+static gint
+reference_std_sq_dev (const guint8 *buf, gint size)
+{
+  gdouble mean = 0, res = 0;
+
+  for (gint i = 0; i < size; i++)
+    mean += buf[i];
+  mean = (guint64) mean / size;
+
+  for (gint i = 0; i < size; i++)
+    res += (buf[i] - mean) * (buf[i] - mean);
+
+  return (guint64) res / size;
+}
+
+static gint
+reference_mean_sq_diff_norm (const guint8 *buf1, const guint8 *buf2, gint size)
+{
+  guint64 res = 0;
+
+  for (gint i = 0; i < size; i++)
+    res += (buf1[i] - buf2[i]) * (buf1[i] - buf2[i]);
+
+  return res / size;
+}
+
+static void
+test_std_sq_dev (void)
+{
+  /* Include frames large enough to overflow 32 bit sums */
+  const gint sizes[] = { 1, 7, 53, 192 * 16, 240, 16387, 384 * 290, 1024 * 1024 };
+
+  for (guint s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      g_autofree guint8 *buf = g_malloc (sizes[s]);
+      g_autofree guint8 *buf2 = g_malloc (sizes[s]);
+
+      for (gint i = 0; i < sizes[s]; i++)
+        {
+          buf[i] = g_random_int_range (0, 256);
+          buf2[i] = g_random_int_range (0, 256);
+        }
+
+      g_assert_cmpint (fpi_std_sq_dev (buf, sizes[s]), ==,
+                       reference_std_sq_dev (buf, sizes[s]));
+      g_assert_cmpint (fpi_mean_sq_diff_norm (buf, buf2, sizes[s]), ==,
+                       reference_mean_sq_diff_norm (buf, buf2, sizes[s]));
+
+      /* Worst case for the accumulators */
+      for (gint i = 0; i < sizes[s]; i++)
+        {
+          buf[i] = (i % 2) ? 255 : 0;
+          buf2[i] = 255 - buf[i];
+        }
+
+      g_assert_cmpint (fpi_std_sq_dev (buf, sizes[s]), ==,
+                       reference_std_sq_dev (buf, sizes[s]));
+      if (sizes[s] > 1)
+        g_assert_cmpint (fpi_mean_sq_diff_norm (buf, buf2, sizes[s]), ==, 255 * 255);
+    }
+}
+
+static void
+test_stats_batch (void)
+{
+  const gint width = 240, stride = 256, count = 64;
+  g_autofree guint8 *buf = g_malloc (stride * count);
+  gint devs[64];
+
+  for (gint i = 0; i < stride * count; i++)
+    buf[i] = g_random_int_range (0, 256);
+
+  fpi_std_sq_dev_batch (buf, width, stride, count, devs);
+
+  for (gint i = 0; i < count; i++)
+    g_assert_cmpint (devs[i], ==, reference_std_sq_dev (buf + i * stride, width));
+}
+
+static gint
+cmp_u16 (gconstpointer a, gconstpointer b)
+{
+  return (gint) * (const guint16 *) a - (gint) * (const guint16 *) b;
+}
+
+static void
+test_percentiles (void)
+{
+  /* Elan frame sizes, plus a few odd ones */
+  const gint sizes[] = { 1, 2, 7, 96 * 96, 144 * 50, 3000 };
+
+  for (guint s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      const gint size = sizes[s];
+      const gint ranks[] = {
+        0, size * 3 / 10, size * 3 / 10, size * 65 / 100, size - 1
+      };
+      g_autofree guint16 *buf = g_new (guint16, size);
+      g_autofree guint16 *sorted = g_new (guint16, size);
+      guint16 values[G_N_ELEMENTS (ranks)];
+
+      /* Full range, 14 bit ADC values and only a few distinct values */
+      for (gint range = 0; range < 3; range++)
+        {
+          for (gint i = 0; i < size; i++)
+            buf[i] = range == 0 ? g_random_int_range (0, 0x10000) :
+                     range == 1 ? g_random_int_range (0, 0x4000) :
+                     g_random_int_range (1020, 1023);
+
+          memcpy (sorted, buf, size * sizeof (guint16));
+          qsort (sorted, size, sizeof (guint16), cmp_u16);
+
+          fpi_percentiles_u16 (buf, size, ranks, values, G_N_ELEMENTS (ranks));
+          for (guint r = 0; r < G_N_ELEMENTS (ranks); r++)
+            g_assert_cmpuint (values[r], ==, sorted[ranks[r]]);
+        }
+    }
+}
+
+static void
+test_stats_perf (void)
+{
+  /* Sizes of a swipe line, a swipe frame and a press sensor image */
+  const gint sizes[] = { 240, 192 * 16, 384 * 290 };
+  const gint iterations = 2000;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in performance mode");
+      return;
+    }
+
+  for (guint s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      g_autofree guint8 *buf = g_malloc (sizes[s]);
+      g_autofree guint8 *buf2 = g_malloc (sizes[s]);
+      volatile gint res;
+
+      for (gint i = 0; i < sizes[s]; i++)
+        {
+          buf[i] = g_random_int_range (0, 256);
+          buf2[i] = g_random_int_range (0, 256);
+        }
+
+      g_test_timer_start ();
+      for (gint i = 0; i < iterations; i++)
+        res = fpi_std_sq_dev (buf, sizes[s]);
+      g_test_minimized_result (g_test_timer_elapsed () / iterations * 1e6,
+                               "fpi_std_sq_dev (%d bytes): %.3f us",
+                               sizes[s], g_test_timer_last () / iterations * 1e6);
+
+      g_test_timer_start ();
+      for (gint i = 0; i < iterations; i++)
+        res = fpi_mean_sq_diff_norm (buf, buf2, sizes[s]);
+      g_test_minimized_result (g_test_timer_elapsed () / iterations * 1e6,
+                               "fpi_mean_sq_diff_norm (%d bytes): %.3f us",
+                               sizes[s], g_test_timer_last () / iterations * 1e6);
+
+      (void) res;
+    }
+}
+
+static guint8
+pixel_or_zero (FpImage *img, gint x, gint y)
+{
+  if (x < 0 || y < 0 || x >= (gint) img->width || y >= (gint) img->height)
+    return 0;
+
+  return img->data[y * img->width + x];
+}
+
+/* Straight forward version of the pixman bilinear scale transform */
+static FpImage *
+reference_resize (FpImage *orig, guint w_factor, guint h_factor)
+{
+  FpImage *res = fp_image_new (orig->width * w_factor, orig->height * h_factor);
+  gint32 x_inv = 65536 / w_factor, y_inv = 65536 / h_factor;
+  gint32 y_pos = (y_inv * 32768 + 32768) >> 16;
+
+  for (guint y = 0; y < res->height; y++, y_pos += y_inv)
+    {
+      gint32 x_pos = (x_inv * 32768 + 32768) >> 16;
+
+      for (guint x = 0; x < res->width; x++, x_pos += x_inv)
+        {
+          gint32 px = x_pos - 32768, py = y_pos - 32768;
+          gint x1 = px >> 16, y1 = py >> 16;
+          guint32 dx = ((px >> 9) & 0x7f) << 1, dy = ((py >> 9) & 0x7f) << 1;
+
+          res->data[y * res->width + x] =
+            (pixel_or_zero (orig, x1, y1) * (256 - dx) * (256 - dy) +
+             pixel_or_zero (orig, x1 + 1, y1) * dx * (256 - dy) +
+             pixel_or_zero (orig, x1, y1 + 1) * (256 - dx) * dy +
+             pixel_or_zero (orig, x1 + 1, y1 + 1) * dx * dy) >> 16;
+        }
+    }
+
+  return res;
+}
+
+#ifdef HAVE_PIXMAN
+static FpImage *
+pixman_resize (FpImage *orig_img, guint w_factor, guint h_factor)
+{
+  gint new_width = orig_img->width * w_factor;
+  gint new_height = orig_img->height * h_factor;
+  gint orig_stride = (orig_img->width + 3) & ~3;
+  g_autofree guint8 *orig_data = g_malloc0 (orig_stride * orig_img->height);
+  pixman_image_t *orig, *resized;
+  pixman_transform_t transform;
+  const guint8 *resized_data;
+  gint resized_stride;
+  FpImage *newimg;
+
+  for (guint y = 0; y < orig_img->height; y++)
+    memcpy (orig_data + y * orig_stride,
+            orig_img->data + y * orig_img->width, orig_img->width);
+
+  orig = pixman_image_create_bits (PIXMAN_a8, orig_img->width, orig_img->height,
+                                   (uint32_t *) orig_data, orig_stride);
+  resized = pixman_image_create_bits (PIXMAN_a8, new_width, new_height, NULL, 0);
+
+  pixman_transform_init_identity (&transform);
+  pixman_transform_scale (NULL, &transform, pixman_int_to_fixed (w_factor), pixman_int_to_fixed (h_factor));
+  pixman_image_set_transform (orig, &transform);
+  pixman_image_set_filter (orig, PIXMAN_FILTER_BILINEAR, NULL, 0);
+  pixman_image_composite32 (PIXMAN_OP_SRC, orig, NULL, resized,
+                            0, 0, 0, 0, 0, 0, new_width, new_height);
+
+  newimg = fp_image_new (new_width, new_height);
+  resized_data = (const guint8 *) pixman_image_get_data (resized);
+  resized_stride = pixman_image_get_stride (resized);
+  for (gint y = 0; y < new_height; y++)
+    memcpy (newimg->data + y * new_width, resized_data + y * resized_stride, new_width);
+
+  pixman_image_unref (orig);
+  pixman_image_unref (resized);
+
+  return newimg;
+}
+#endif
+
+static FpImage *
+random_image (guint width, guint height)
+{
+  FpImage *img = fp_image_new (width, height);
+
+  for (guint i = 0; i < width * height; i++)
+    img->data[i] = g_random_int_range (0, 256);
+
+  return img;
+}
+
+static void
+test_resize_bilinear (void)
+{
+  /* Sizes and factors as used by the drivers, plus odd ones */
+  const guint sizes[][2] = { { 1, 1 }, { 7, 3 }, { 96, 96 }, { 128, 128 }, { 103, 52 } };
+  const guint factors[][2] = { { 1, 1 }, { 2, 2 }, { 3, 3 }, { 2, 5 }, { 4, 1 } };
+
+  for (guint s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      g_autoptr(FpImage) orig = random_image (sizes[s][0], sizes[s][1]);
+
+      orig->flags = FPI_IMAGE_COLORS_INVERTED;
+
+      for (guint f = 0; f < G_N_ELEMENTS (factors); f++)
+        {
+          g_autoptr(FpImage) resized = NULL;
+          g_autoptr(FpImage) expected = NULL;
+
+          resized = fpi_image_resize (orig, factors[f][0], factors[f][1]);
+          expected = reference_resize (orig, factors[f][0], factors[f][1]);
+
+          g_assert_cmpuint (resized->width, ==, orig->width * factors[f][0]);
+          g_assert_cmpuint (resized->height, ==, orig->height * factors[f][1]);
+          g_assert_cmpint (resized->flags, ==, FPI_IMAGE_COLORS_INVERTED);
+          g_assert_cmpmem (resized->data, resized->width * resized->height,
+                           expected->data, expected->width * expected->height);
+
+#ifdef HAVE_PIXMAN
+          g_clear_object (&expected);
+          expected = pixman_resize (orig, factors[f][0], factors[f][1]);
+          g_assert_cmpmem (resized->data, resized->width * resized->height,
+                           expected->data, expected->width * expected->height);
+#endif
+        }
+    }
+}
+
+static void
+test_resize_nearest (void)
+{
+  g_autoptr(FpImage) orig = random_image (37, 11);
+  g_autoptr(FpImage) resized = NULL;
+
+  resized = fpi_image_resize_full (orig, 3, 2, FPI_IMAGE_RESIZE_NEAREST);
+  g_assert_cmpuint (resized->width, ==, 37 * 3);
+  g_assert_cmpuint (resized->height, ==, 11 * 2);
+
+  for (guint y = 0; y < resized->height; y++)
+    for (guint x = 0; x < resized->width; x++)
+      g_assert_cmpuint (resized->data[y * resized->width + x], ==,
+                        orig->data[(y / 2) * orig->width + x / 3]);
+}
+
+static void
+test_resize_perf (void)
+{
+  /* elanspi and aes3k style upscaling */
+  const guint sizes[][2] = { { 96, 96 }, { 128, 128 } };
+  const gint iterations = 200;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in performance mode");
+      return;
+    }
+
+  for (guint s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      g_autoptr(FpImage) orig = random_image (sizes[s][0], sizes[s][1]);
+
+      g_test_timer_start ();
+      for (gint i = 0; i < iterations; i++)
+        g_object_unref (fpi_image_resize (orig, 2, 2));
+      g_test_minimized_result (g_test_timer_elapsed () / iterations * 1e6,
+                               "fpi_image_resize (%ux%u, 2x): %.3f us",
+                               sizes[s][0], sizes[s][1],
+                               g_test_timer_last () / iterations * 1e6);
+
+#ifdef HAVE_PIXMAN
+      g_test_timer_start ();
+      for (gint i = 0; i < iterations; i++)
+        g_object_unref (pixman_resize (orig, 2, 2));
+      g_test_minimized_result (g_test_timer_elapsed () / iterations * 1e6,
+                               "pixman (%ux%u, 2x): %.3f us",
+                               sizes[s][0], sizes[s][1],
+                               g_test_timer_last () / iterations * 1e6);
+#endif
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image/pool/recycle", test_image_pool_recycle);
+  g_test_add_func ("/image/pool/max-cached", test_image_pool_max_cached);
+  g_test_add_func ("/image/pool/resized", test_image_pool_resized);
+  g_test_add_func ("/image/pool/outlives-owner", test_image_pool_outlives_owner);
+  g_test_add_func ("/image/stats/std-sq-dev", test_std_sq_dev);
+  g_test_add_func ("/image/stats/batch", test_stats_batch);
+  g_test_add_func ("/image/stats/percentiles", test_percentiles);
+  g_test_add_func ("/image/stats/perf", test_stats_perf);
+  g_test_add_func ("/image/resize/bilinear", test_resize_bilinear);
+  g_test_add_func ("/image/resize/nearest", test_resize_nearest);
+  g_test_add_func ("/image/resize/perf", test_resize_perf);
+
+  return g_test_run ();
+}
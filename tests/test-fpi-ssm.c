@@ -785,6 +785,85 @@ test_ssm_delayed_next_complete (void)
   g_assert_no_error (data->error);
 }
 
+static void
+test_ssm_polled_next (void)
+{
+  g_autoptr(FpiSsm) ssm = ssm_test_new ();
+  FpiSsmTestData *data = fpi_ssm_get_data (ssm);
+  guint polls, new_polls;
+
+  fpi_device_get_poll_stats (fake_device, &polls, NULL, NULL, NULL);
+
+  fpi_ssm_start (ssm, test_ssm_completed_callback);
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_0);
+
+  fpi_ssm_next_state_polled (ssm);
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_0);
+  g_assert_cmpint (fpi_ssm_get_cur_state (ssm), ==, FPI_TEST_SSM_STATE_0);
+
+  fpi_device_get_poll_stats (fake_device, &new_polls, NULL, NULL, NULL);
+  g_assert_cmpuint (new_polls, ==, polls + 1);
+
+  while (data->handler_state == FPI_TEST_SSM_STATE_0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_1);
+  g_assert_cmpint (fpi_ssm_get_cur_state (ssm), ==, FPI_TEST_SSM_STATE_1);
+  g_assert_cmpuint (g_slist_length (data->handlers_chain), ==, 2);
+
+  g_assert_false (data->completed);
+  g_assert_no_error (data->error);
+}
+
+static void
+test_ssm_polled_next_wake (void)
+{
+  g_autoptr(FpiSsm) ssm = ssm_test_new ();
+  FpiSsmTestData *data = fpi_ssm_get_data (ssm);
+
+  fpi_ssm_start (ssm, test_ssm_completed_callback);
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_0);
+
+  fpi_ssm_next_state_polled (ssm);
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_0);
+
+  /* The pending poll runs on the next iteration, without waiting */
+  fpi_device_poll_wake (fake_device);
+  g_main_context_iteration (NULL, FALSE);
+
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_1);
+  g_assert_cmpint (fpi_ssm_get_cur_state (ssm), ==, FPI_TEST_SSM_STATE_1);
+  g_assert_cmpuint (g_slist_length (data->handlers_chain), ==, 2);
+
+  /* Nothing is pending anymore */
+  fpi_device_poll_wake (fake_device);
+
+  g_assert_false (data->completed);
+  g_assert_no_error (data->error);
+}
+
+static void
+test_ssm_polled_next_wake_cancelled (void)
+{
+  g_autoptr(FpiSsm) ssm = ssm_test_new ();
+  FpiSsmTestData *data = fpi_ssm_get_data (ssm);
+
+  fpi_ssm_start (ssm, test_ssm_completed_callback);
+  fpi_ssm_next_state_polled (ssm);
+  fpi_ssm_cancel_delayed_state_change (ssm);
+
+  fpi_device_poll_wake (fake_device);
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  g_assert_cmpint (data->handler_state, ==, FPI_TEST_SSM_STATE_0);
+  g_assert_cmpint (fpi_ssm_get_cur_state (ssm), ==, FPI_TEST_SSM_STATE_0);
+  g_assert_cmpuint (g_slist_length (data->handlers_chain), ==, 1);
+
+  g_assert_false (data->completed);
+  g_assert_no_error (data->error);
+}
+
 static void
 test_ssm_delayed_jump_to_state (void)
 {
@@ -1349,6 +1428,9 @@ main (int argc, char *argv[])
   g_test_add_func ("/ssm/delayed/next/cancel", test_ssm_delayed_next_cancel);
   g_test_add_func ("/ssm/delayed/next/not_started", test_ssm_delayed_next_not_started);
   g_test_add_func ("/ssm/delayed/next/complete", test_ssm_delayed_next_complete);
+  g_test_add_func ("/ssm/polled/next", test_ssm_polled_next);
+  g_test_add_func ("/ssm/polled/next/wake", test_ssm_polled_next_wake);
+  g_test_add_func ("/ssm/polled/next/wake_cancelled", test_ssm_polled_next_wake_cancelled);
   g_test_add_func ("/ssm/delayed/jump_to_state", test_ssm_delayed_jump_to_state);
   g_test_add_func ("/ssm/delayed/jump_to_state/cancel", test_ssm_delayed_jump_to_state_cancel);
   g_test_add_func ("/ssm/delayed/jump_to_state/not_started", test_ssm_delayed_jump_to_state_not_started);
@@ -1213,6 +1213,74 @@ class VirtualDeviceStorage(VirtualDevice):
                           'not-existing-print', False, identify=True)
 
 
+class VirtualDeviceStorageWorkerThread(VirtualDeviceBase):
+
+    driver_name = 'virtual_device_storage'
+
+    @classmethod
+    def setUpClass(cls):
+        super().setUpClass()
+        cls.dev.set_worker_thread(True)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.dev.set_worker_thread(False)
+        super().tearDownClass()
+
+    def tearDown(self):
+        self.dev.set_print_list_cache(False)
+        if self.dev.is_open():
+            self.send_command('CONT')
+            self.dev.clear_storage_sync()
+        super().tearDown()
+
+    def list_prints(self):
+        return {p.props.fpi_data.get_string() for p in self.dev.list_prints_sync()}
+
+    def test_lifecycle(self):
+        self.send_command('INSERT', 'p1')
+        self.assertEqual({'p1'}, self.list_prints())
+
+        p2 = self.enroll_print('p2', FPrint.Finger.LEFT_LITTLE)
+        self.assertEqual({'p1', 'p2'}, self.list_prints())
+
+        self.dev.delete_print_sync(p2)
+        self.assertEqual({'p1'}, self.list_prints())
+
+        self.start_verify(p2, identify=False)
+        self.wait_timeout(100)
+        self.assertFalse(self._verify_completed)
+
+        self.cancel_verify()
+        self.assertTrue(self._verify_error.matches(Gio.io_error_quark(),
+                                                   Gio.IOErrorEnum.CANCELLED))
+
+        self.dev.close_sync()
+        self.assertFalse(self.dev.is_open())
+        self.dev.open_sync()
+        self.assertEqual({'p1'}, self.list_prints())
+
+    def test_list_cache(self):
+        hits, misses = self.dev.get_print_list_cache_stats()
+        self.dev.set_print_list_cache(True)
+
+        self.send_command('INSERT', 'p1')
+        self.assertEqual({'p1'}, self.list_prints())
+        self.assertEqual({'p1'}, self.list_prints())
+        self.assertEqual(self.dev.get_print_list_cache_stats(),
+                         (hits + 1, misses + 1))
+
+        self.enroll_print('p2', FPrint.Finger.LEFT_LITTLE)
+        self.assertEqual({'p1', 'p2'}, self.list_prints())
+        self.assertEqual(self.dev.get_print_list_cache_stats(),
+                         (hits + 1, misses + 2))
+
+        self.dev.set_print_list_cache(False)
+        self.assertEqual({'p1', 'p2'}, self.list_prints())
+        self.assertEqual(self.dev.get_print_list_cache_stats(),
+                         (hits + 1, misses + 2))
+
+
 if __name__ == '__main__':
     try:
         gi.require_version('FPrint', '2.0')